@@ -4,7 +4,7 @@ QMAKE_TARGET_PRODUCT = "EyeRecToo"
 QMAKE_TARGET_DESCRIPTION = ""
 QMAKE_TARGET_COPYRIGHT = "Thiago Santini"
 
-QT       += core gui multimedia
+QT       += core gui multimedia concurrent
 
 greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 
@@ -26,11 +26,20 @@ TURBOJPEGPATH="$${TOP}/deps/libjpeg-turbo-1.5.90/"
 #DEFINES += STARBURST
 #DEFINES += SWIRSKI
 
+# Debugging: counts heap allocations per thread (e.g., to check that pupil detection doesn't allocate)
+#DEFINES += COUNT_ALLOCATIONS
+
 SOURCES +=\
     $${TOP}/src/main.cpp\
     $${TOP}/src/MainWindow.cpp \
     $${TOP}/src/utils.cpp\
     $${TOP}/src/FrameGrabber.cpp \
+    $${TOP}/src/FramePool.cpp \
+    $${TOP}/src/AllocationCounter.cpp \
+    $${TOP}/src/WorkerPool.cpp \
+    $${TOP}/src/ClockModel.cpp \
+    $${TOP}/src/ReplaySource.cpp \
+    $${TOP}/src/Channel.cpp \
     $${TOP}/src/Camera.cpp \
     $${TOP}/src/ImageProcessor.cpp \
     $${TOP}/src/EyeImageProcessor.cpp \
@@ -56,12 +65,23 @@ SOURCES +=\
 	$${TOP}/src/ERWidget.cpp \
 	$${TOP}/src/pupil-tracking/PuReST.cpp \
 	$${TOP}/src/pupil-detection/PuRe.cpp \
+	$${TOP}/src/pupil-detection/EdgeFilter.cpp \
+	$${TOP}/src/pupil-detection/ContourSet.cpp \
+	$${TOP}/src/pupil-detection/EllipseSampler.cpp \
 	$${TOP}/src/pupil-tracking/PupilTrackingMethod.cpp
 
 HEADERS  += \
     $${TOP}/src/MainWindow.h\
     $${TOP}/src/utils.h \
     $${TOP}/src/FrameGrabber.h \
+    $${TOP}/src/FramePool.h \
+    $${TOP}/src/AllocationCounter.h \
+    $${TOP}/src/WorkerPool.h \
+    $${TOP}/src/ClockModel.h \
+    $${TOP}/src/ReplaySource.h \
+    $${TOP}/src/Mailbox.h \
+    $${TOP}/src/Channel.h \
+    $${TOP}/src/TimeSeries.h \
     $${TOP}/src/Camera.h \
     $${TOP}/src/ImageProcessor.h \
     $${TOP}/src/EyeImageProcessor.h \
@@ -89,6 +109,10 @@ HEADERS  += \
 	$${TOP}/src/ERWidget.h \
 	$${TOP}/src/pupil-tracking/PupilTrackingMethod.h \
 	$${TOP}/src/pupil-detection/PuRe.h \
+	$${TOP}/src/pupil-detection/Workspace.h \
+	$${TOP}/src/pupil-detection/EdgeFilter.h \
+	$${TOP}/src/pupil-detection/ContourSet.h \
+	$${TOP}/src/pupil-detection/EllipseSampler.h \
 	$${TOP}/src/pupil-tracking/PuReST.h
 
 FORMS    += \
@@ -0,0 +1,123 @@
+#include "AllocationCounter.h"
+
+#ifdef COUNT_ALLOCATIONS
+
+#include <cerrno>
+#include <cstdlib>
+#include <new>
+
+static thread_local unsigned long long gAllocations = 0;
+
+unsigned long long AllocationCounter::count()
+{
+    return gAllocations;
+}
+
+void AllocationCounter::credit(const unsigned long long &allocations)
+{
+    gAllocations += allocations;
+}
+
+#ifdef __GLIBC__
+
+/* Interpose malloc itself, so allocations that bypass operator new (e.g.,
+ * cv::fastMalloc) are counted too. The default operator new ends up here,
+ * so it is not replaced. free() needs no replacement either.
+ */
+extern "C" {
+
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void *p, size_t size);
+void* __libc_memalign(size_t alignment, size_t size);
+
+void* malloc(size_t size)
+{
+    gAllocations++;
+    return __libc_malloc(size);
+}
+
+void* calloc(size_t count, size_t size)
+{
+    gAllocations++;
+    return __libc_calloc(count, size);
+}
+
+void* realloc(void *p, size_t size)
+{
+    gAllocations++;
+    return __libc_realloc(p, size);
+}
+
+void* memalign(size_t alignment, size_t size)
+{
+    gAllocations++;
+    return __libc_memalign(alignment, size);
+}
+
+void* aligned_alloc(size_t alignment, size_t size)
+{
+    return memalign(alignment, size);
+}
+
+int posix_memalign(void **p, size_t alignment, size_t size)
+{
+    if (alignment % sizeof(void*) != 0 || (alignment & (alignment - 1)) != 0)
+        return EINVAL;
+    *p = memalign(alignment, size);
+    return *p ? 0 : ENOMEM;
+}
+
+}
+
+#else
+
+void* operator new(std::size_t size)
+{
+    gAllocations++;
+    void *p = std::malloc(size > 0 ? size : 1);
+    if (!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+void* operator new[](std::size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void *p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void *p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void *p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void *p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+#endif
+
+#else
+
+unsigned long long AllocationCounter::count()
+{
+    return 0;
+}
+
+void AllocationCounter::credit(const unsigned long long &allocations)
+{
+    (void) allocations;
+}
+
+#endif
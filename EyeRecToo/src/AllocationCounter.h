@@ -0,0 +1,22 @@
+#ifndef ALLOCATIONCOUNTER_H
+#define ALLOCATIONCOUNTER_H
+
+/* Debugging aid: counts heap allocations made by the calling thread.
+ *
+ * Only active with DEFINES += COUNT_ALLOCATIONS. With glibc, malloc and its
+ * variants are replaced, so everything is counted: operator new, cv::Mat
+ * storage, and OpenCV's internal fastMalloc / cvAlloc scratch buffers.
+ * Elsewhere only the global operator new is replaced, which covers cv::Mat
+ * storage (its UMatData is new'ed) but not fastMalloc.
+ *
+ * Work a WorkerPool runs on behalf of a thread is credited to that thread.
+ */
+class AllocationCounter
+{
+public:
+    static unsigned long long count();
+    // Adds allocations made by another thread on behalf of this one
+    static void credit(const unsigned long long &allocations);
+};
+
+#endif // ALLOCATIONCOUNTER_H
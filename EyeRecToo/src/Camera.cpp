@@ -11,8 +11,14 @@ QMutex Camera::setCameraMutex;
 Camera::Camera(QString id, QObject *parent)
     : QObject(parent),
       colorCode(CV_8UC3),
+      decodeScale(DECODE_SCALE_AUTO_FULL_WHEN_RECORDING),
+      decodeThreads(0),
+      y16Bits(0),
+      recording(false),
       camera(NULL),
       frameGrabber(NULL),
+      replaySource(NULL),
+      replaySpeed(1),
       retriesLeft(0),
       maxRetries(15)
 {
@@ -24,6 +30,11 @@ Camera::Camera(QString id, QObject *parent)
     connect(ui, SIGNAL(setCamera(QCameraInfo)), this, SLOT(setCamera(QCameraInfo)) );
     connect(ui, SIGNAL(setViewfinderSettings(QCameraViewfinderSettings)), this, SLOT(setViewfinderSettings(QCameraViewfinderSettings)) );
 	connect(ui, SIGNAL(setColorCode(int)), this, SLOT(setColorCode(int)) );
+	connect(ui, SIGNAL(setDecodeScale(int)), this, SLOT(setDecodeScale(int)) );
+	connect(ui, SIGNAL(setDecodeThreads(int)), this, SLOT(setDecodeThreads(int)) );
+	connect(ui, SIGNAL(setY16Bits(int)), this, SLOT(setY16Bits(int)) );
+	connect(ui, SIGNAL(setReplay(QString)), this, SLOT(setReplay(QString)) );
+	connect(ui, SIGNAL(setReplaySpeed(double)), this, SLOT(setReplaySpeed(double)) );
 	connect(ui, SIGNAL(setParameter(QString,float)), this, SLOT(setParameter(QString,float)) );
 	settings = new QSettings(gCfgDir + "/" + id + " Camera.ini", QSettings::IniFormat);
 }
@@ -55,6 +66,11 @@ void Camera::reset()
         frameGrabber->deleteLater();
         frameGrabber = NULL;
 	}
+
+	if (replaySource) {
+		replaySource->deleteLater();
+		replaySource = NULL;
+	}
 }
 
 QCameraViewfinderSettings Camera::getViewfinderSettings(const QCameraInfo cameraInfo)
@@ -97,6 +113,9 @@ QCameraViewfinderSettings Camera::getViewfinderSettings(const QCameraInfo camera
 				 || setting.pixelFormat() == QVideoFrame::Format_RGB24
 				 || setting.pixelFormat() == QVideoFrame::Format_YUYV
 				 || setting.pixelFormat() == QVideoFrame::Format_UYVY
+				 || setting.pixelFormat() == QVideoFrame::Format_NV12
+				 || setting.pixelFormat() == QVideoFrame::Format_Y8
+				 || setting.pixelFormat() == QVideoFrame::Format_Y16
 				 || setting.pixelFormat() == QVideoFrame::Format_Jpeg ) {
 
                 if (recommended.isNull())
@@ -141,6 +160,7 @@ void Camera::setCamera(const QCameraInfo &cameraInfo, QCameraViewfinderSettings
     QMutexLocker setCameraLocker(&setCameraMutex);
 
 	reset();
+	replayFile.clear();
 
 	QString msg = "No camera selected";
 	QList<QCameraViewfinderSettings> settingsList;
@@ -153,6 +173,9 @@ void Camera::setCamera(const QCameraInfo &cameraInfo, QCameraViewfinderSettings
         qInfo() << id << "Opening" << cameraInfo.description();
         camera = new QCamera(cameraInfo.deviceName().toUtf8());
 		frameGrabber = new FrameGrabber(id, colorCode);
+		updateDecodeSize();
+		frameGrabber->setDecodeThreads(decodeThreads);
+		frameGrabber->setY16Bits(y16Bits);
 
         camera->load();
         if (camera->state() == QCamera::UnloadedState) {
@@ -196,13 +219,120 @@ void Camera::setCamera(const QCameraInfo &cameraInfo, QCameraViewfinderSettings
     qInfo() << id << msg;
 }
 
+void Camera::setReplay(QString fileName)
+{
+	QMutexLocker setCameraLocker(&setCameraMutex);
+
+	// Open it first, so a broken replay leaves the current source running
+	ReplaySource *source = new ReplaySource(id, colorCode);
+	if (!source->open(fileName)) {
+		delete source;
+		qWarning() << id << "Failed to open replay" << fileName;
+		if (!camera && !replaySource)
+			emit noCamera("Failed to open replay.");
+		return;
+	}
+
+	// The camera description and settings are kept to return to them later
+	reset();
+	replaySource = source;
+	replayFile = fileName;
+	connect(replaySource, SIGNAL(newFrame(Timestamp, cv::Mat)),
+			this, SIGNAL(newFrame(Timestamp, cv::Mat)) );
+	connect(replaySource, SIGNAL(finished()),
+			this, SLOT(replayFinished()) );
+	replaySource->setSpeed(replaySpeed);
+	replaySource->start();
+
+	fps = replaySource->fps();
+	saveCfg();
+	qInfo() << id << replaySource->description();
+}
+
+void Camera::setReplaySpeed(double speed)
+{
+	replaySpeed = speed;
+	if (replaySource)
+		replaySource->setSpeed(replaySpeed);
+	saveCfg();
+}
+
+void Camera::frameConsumed()
+{
+	if (replaySource)
+		replaySource->acknowledge();
+}
+
+void Camera::replayFinished()
+{
+	emit noCamera("Replay finished.");
+}
+
 void Camera::setColorCode(int code)
 {
     colorCode = code;
     QMetaObject::invokeMethod(frameGrabber, "setColorCode", Q_ARG(int, colorCode));
+	if (replaySource)
+		replaySource->setColorCode(colorCode);
     saveCfg();
 }
 
+void Camera::setDecodeScale(int decodeScale)
+{
+	this->decodeScale = decodeScale;
+	updateDecodeSize();
+	saveCfg();
+}
+
+void Camera::setDecodeThreads(int decodeThreads)
+{
+	this->decodeThreads = decodeThreads;
+	if (frameGrabber)
+		QMetaObject::invokeMethod(frameGrabber, "setDecodeThreads", Q_ARG(int, decodeThreads));
+	saveCfg();
+}
+
+void Camera::setY16Bits(int bits)
+{
+	y16Bits = bits;
+	if (frameGrabber)
+		QMetaObject::invokeMethod(frameGrabber, "setY16Bits", Q_ARG(int, y16Bits));
+	saveCfg();
+}
+
+void Camera::setRequiredSize(QSize size)
+{
+	requiredSize = size;
+	updateDecodeSize();
+}
+
+void Camera::setRecording(bool recording)
+{
+	this->recording = recording;
+	updateDecodeSize();
+}
+
+QSize Camera::decodeSize()
+{
+	/* The processor input (data.input) defines the coordinate frame for the
+	 * pupil / gaze and the recorded video, so we never go below it. An empty
+	 * size means the processor wants the native resolution.
+	 */
+	if (decodeScale == DECODE_SCALE_FULL)
+		return QSize();
+	if (decodeScale == DECODE_SCALE_AUTO_FULL_WHEN_RECORDING && recording)
+		return QSize();
+	if (!requiredSize.isValid() || requiredSize.isEmpty())
+		return QSize();
+	return requiredSize;
+}
+
+void Camera::updateDecodeSize()
+{
+	if (frameGrabber)
+		QMetaObject::invokeMethod(frameGrabber, "setDecodeSize", Q_ARG(QSize, decodeSize()));
+}
+
 void Camera::setParameter(QString what, float value)
 {
 	if (!camera)
@@ -275,22 +405,30 @@ void Camera::setValuesUI()
 
 void Camera::showOptions()
 {
-    QMetaObject::invokeMethod(ui, "update", Q_ARG(QCameraInfo, currentCameraInfo), Q_ARG(int, colorCode));
+    QMetaObject::invokeMethod(ui, "update", Q_ARG(QCameraInfo, currentCameraInfo), Q_ARG(int, colorCode), Q_ARG(int, decodeScale), Q_ARG(int, decodeThreads), Q_ARG(int, y16Bits), Q_ARG(QString, replayFile), Q_ARG(double, replaySpeed));
     QMetaObject::invokeMethod(ui, "show");
 }
 
 void Camera::saveCfg()
 {
     settings->sync();
-    settings->setValue("description", iniStr(currentCameraInfo.description()));
-    settings->setValue("deviceName", iniStr(currentCameraInfo.deviceName()));
-    settings->setValue("width", currentViewfinderSettings.resolution().width());
-    settings->setValue("height", currentViewfinderSettings.resolution().height());
-    settings->setValue("fps", currentViewfinderSettings.maximumFrameRate());
-    settings->setValue("format", currentViewfinderSettings.pixelFormat());
-    settings->setValue("wPxRatio", currentViewfinderSettings.pixelAspectRatio().width());
-    settings->setValue("hPxRatio", currentViewfinderSettings.pixelAspectRatio().height());
+    // While replaying, the camera keys keep describing the camera to return to
+    if (!replaySource) {
+        settings->setValue("description", iniStr(currentCameraInfo.description()));
+        settings->setValue("deviceName", iniStr(currentCameraInfo.deviceName()));
+        settings->setValue("width", currentViewfinderSettings.resolution().width());
+        settings->setValue("height", currentViewfinderSettings.resolution().height());
+        settings->setValue("fps", currentViewfinderSettings.maximumFrameRate());
+        settings->setValue("format", currentViewfinderSettings.pixelFormat());
+        settings->setValue("wPxRatio", currentViewfinderSettings.pixelAspectRatio().width());
+        settings->setValue("hPxRatio", currentViewfinderSettings.pixelAspectRatio().height());
+    }
     settings->setValue("colorCode", colorCode);
+    settings->setValue("decodeScale", decodeScale);
+    settings->setValue("decodeThreads", decodeThreads);
+    settings->setValue("y16Bits", y16Bits);
+    settings->setValue("replayFile", replayFile);
+    settings->setValue("replaySpeed", replaySpeed);
 }
 
 void Camera::loadCfg()
@@ -332,6 +470,23 @@ void Camera::loadCfg()
     viewFinderSetting.setPixelFormat( format );
 
     set(settings, "colorCode", colorCode);
+    set(settings, "decodeScale", decodeScale);
+    set(settings, "decodeThreads", decodeThreads);
+    set(settings, "y16Bits", y16Bits);
+    set(settings, "replaySpeed", replaySpeed);
+
+	// A replay takes precedence; e.g., for profiling on machines without cameras.
+	// If it can't be opened anymore, fall back to the camera.
+	QString replay;
+	set(settings, "replayFile", replay);
+	if (!replay.isEmpty()) {
+		setReplay(replay);
+		if (replaySource) {
+			currentCameraInfo = info;
+			currentViewfinderSettings = viewFinderSetting;
+			return;
+		}
+	}
 
 	setCamera(info, viewFinderSetting);
 
@@ -16,11 +16,16 @@
 #include <QFormLayout>
 #include <QDoubleSpinBox>
 #include <QFileInfo>
+#include <QSpinBox>
+#include <QFileDialog>
 
 #include "opencv/cv.h"
 
 #include "FrameGrabber.h"
+#include "ReplaySource.h"
 
+// How much of the frame the grabber decodes; the reduced modes only apply to JPEG
+enum DecodeScale { DECODE_SCALE_FULL = 0, DECODE_SCALE_AUTO = 1, DECODE_SCALE_AUTO_FULL_WHEN_RECORDING = 2 };
 
 class CameraUI : public QDialog
 {
@@ -45,6 +50,21 @@ public:
         hBoxLayout->addWidget(devicesBox);
         layout->addWidget(box);
 
+		replaySpeedBox = new QDoubleSpinBox();
+		replaySpeedBox->setMinimum(0);
+		replaySpeedBox->setMaximum(100);
+		replaySpeedBox->setSingleStep(1);
+		replaySpeedBox->setValue(1);
+		replaySpeedBox->setSuffix("x");
+		replaySpeedBox->setSpecialValueText("As fast as possible");
+		hBoxLayout = new QHBoxLayout();
+		box = new QGroupBox("Replay Speed:");
+		box->setWhatsThis("Pacing when replaying a recording (select \"Replay recording...\" as device).\n1x is real time; 0 replays as fast as possible.");
+		box->setToolTip(box->whatsThis());
+		box->setLayout(hBoxLayout);
+		hBoxLayout->addWidget(replaySpeedBox);
+		layout->addWidget(box);
+
         settingsBox = new QComboBox();
         hBoxLayout = new QHBoxLayout();
         box = new QGroupBox("Format:");
@@ -61,6 +81,28 @@ public:
         hBoxLayout->addWidget(colorBox);
 		layout->addWidget(box);
 
+		decodeScaleBox = new QComboBox();
+		decodeScaleBox->addItem("Full", QVariant(DECODE_SCALE_FULL));
+		decodeScaleBox->addItem("Auto", QVariant(DECODE_SCALE_AUTO));
+		decodeScaleBox->addItem("Auto (full when recording)", QVariant(DECODE_SCALE_AUTO_FULL_WHEN_RECORDING));
+		decodeThreadsBox = new QSpinBox();
+		decodeThreadsBox->setMinimum(0);
+		decodeThreadsBox->setMaximum(QThread::idealThreadCount());
+		formLayout = new QFormLayout();
+		box = new QGroupBox("Decoding:");
+		box->setWhatsThis("Scale: Auto decodes JPEG frames at the smallest scale (1/2, 1/4, 1/8) that still covers the image processor input size; Full always decodes at the camera resolution.\nThreads: number of threads decoding JPEG frames in parallel; 0 decodes in the camera thread.\nY16 Depth: significant bits of 16 bit grayscale frames, which are scaled to 8 bits accordingly; Auto detects them from the brightest pixels seen.");
+		box->setToolTip(box->whatsThis());
+		box->setLayout(formLayout);
+		formLayout->addRow(new QLabel("Scale:"), decodeScaleBox);
+		formLayout->addRow(new QLabel("Threads:"), decodeThreadsBox);
+		y16BitsBox = new QSpinBox();
+		y16BitsBox->setMinimum(7);
+		y16BitsBox->setMaximum(16);
+		y16BitsBox->setSpecialValueText("Auto");
+		y16BitsBox->setSuffix(" bits");
+		formLayout->addRow(new QLabel("Y16 Depth:"), y16BitsBox);
+		layout->addWidget(box);
+
 		// Sliders are prettier and easier, but spinboxes are more accurate; unfortunatelly, that's what we favor.
 		bool useSliders = false;
 		QComboBox *parBox;
@@ -92,7 +134,7 @@ public:
 		//parBox->addItem("Aperture", 8);
 
 		box->setLayout(formLayout);
-		layout->addWidget(box, 0, 1, 3, 1);
+		layout->addWidget(box, 0, 1, 5, 1);
 
         setLayout(layout);
         connect(devicesBox, SIGNAL(currentIndexChanged(int)),
@@ -101,6 +143,14 @@ public:
                 this, SLOT(settingsChanged(int)) );
         connect(colorBox, SIGNAL(currentIndexChanged(int)),
                 this, SLOT(colorChanged(int)) );
+		connect(decodeScaleBox, SIGNAL(currentIndexChanged(int)),
+				this, SLOT(decodeScaleChanged(int)) );
+		connect(decodeThreadsBox, SIGNAL(valueChanged(int)),
+				this, SIGNAL(setDecodeThreads(int)) );
+		connect(y16BitsBox, SIGNAL(valueChanged(int)),
+				this, SLOT(y16BitsChanged(int)) );
+		connect(replaySpeedBox, SIGNAL(valueChanged(double)),
+				this, SIGNAL(setReplaySpeed(double)) );
 	}
 
 	void setValue(QDoubleSpinBox *sb, double val) {
@@ -126,7 +176,7 @@ public:
 	}
 
 public slots:
-    void update(QCameraInfo current, int colorCode)
+    void update(QCameraInfo current, int colorCode, int decodeScale, int decodeThreads, int y16Bits, QString replayFile, double replaySpeed)
     {
         QSignalBlocker blocker(this);
         devicesBox->clear();
@@ -145,11 +195,23 @@ public slots:
             if (cameras[i] == current)
                 curIdx = i + 1; // remember we have none as the first option
         }
+		if (!replayFile.isEmpty()) {
+			devicesBox->addItem(QString("Replay %1").arg(QFileInfo(replayFile).fileName()), replayFile);
+			curIdx = devicesBox->count() - 1;
+		}
+		devicesBox->addItem("Replay recording...", QString());
         devicesBox->setCurrentIndex(curIdx);
+		replaySpeedBox->setValue(replaySpeed);
 
         for (int i=0; i<colorBox->count(); i++)
             if (colorBox->itemData(i).toInt() == colorCode)
                 colorBox->setCurrentIndex(i);
+
+		for (int i=0; i<decodeScaleBox->count(); i++)
+			if (decodeScaleBox->itemData(i).toInt() == decodeScale)
+				decodeScaleBox->setCurrentIndex(i);
+		decodeThreadsBox->setValue(decodeThreads);
+		y16BitsBox->setValue(y16Bits > 0 ? y16Bits : y16BitsBox->minimum());
     }
 
     void updateSettings(QList<QCameraViewfinderSettings> settingsList, QCameraViewfinderSettings current)
@@ -164,7 +226,11 @@ public slots:
             if (settingsList[i].pixelFormat() != QVideoFrame::Format_Jpeg
                     && settingsList[i].pixelFormat() != QVideoFrame::Format_RGB32
                     && settingsList[i].pixelFormat() != QVideoFrame::Format_YUYV
-                    && settingsList[i].pixelFormat() != QVideoFrame::Format_RGB24)
+                    && settingsList[i].pixelFormat() != QVideoFrame::Format_RGB24
+                    && settingsList[i].pixelFormat() != QVideoFrame::Format_UYVY
+                    && settingsList[i].pixelFormat() != QVideoFrame::Format_NV12
+                    && settingsList[i].pixelFormat() != QVideoFrame::Format_Y8
+                    && settingsList[i].pixelFormat() != QVideoFrame::Format_Y16)
                 continue;
             v.setValue(settingsList[i]);
             settingsBox->addItem(toQString(settingsList[i]), v);
@@ -178,12 +244,30 @@ signals:
     void setCamera(QCameraInfo cameraInfo);
     void setViewfinderSettings(QCameraViewfinderSettings settings);
 	void setColorCode(int code);
+	void setDecodeScale(int decodeScale);
+	void setDecodeThreads(int decodeThreads);
+	void setY16Bits(int bits);
+	void setReplay(QString fileName);
+	void setReplaySpeed(double speed);
 	void setParameter(QString what, float value);
 
 private slots:
-    void deviceChanged(int i) { emit setCamera(devicesBox->itemData(i).value<QCameraInfo>());}
+    void deviceChanged(int i) {
+		QVariant v = devicesBox->itemData(i);
+		if (v.type() != QVariant::String) {
+			emit setCamera(v.value<QCameraInfo>());
+			return;
+		}
+		QString replayFile = v.toString();
+		if (replayFile.isEmpty())
+			replayFile = QFileDialog::getOpenFileName(this, "Replay recording", QString(), "Recordings (*.mp4 *.avi)");
+		if (!replayFile.isEmpty())
+			emit setReplay(replayFile);
+	}
     void settingsChanged(int i) { emit setViewfinderSettings(settingsBox->itemData(i).value<QCameraViewfinderSettings>());}
 	void colorChanged(int i) { emit setColorCode(colorBox->itemData(i).value<int>()); }
+	void decodeScaleChanged(int i) { emit setDecodeScale(decodeScaleBox->itemData(i).value<int>()); }
+	void y16BitsChanged(int bits) { emit setY16Bits(bits < 8 ? 0 : bits); }
 	void sliderReleased() {
 		QSlider *slider = static_cast<QSlider*>( QObject::sender() );
 		emit setParameter(slider->objectName(), slider->value() / 100.0);
@@ -201,6 +285,10 @@ private:
     QComboBox *devicesBox;
     QComboBox *settingsBox;
     QComboBox *colorBox;
+	QComboBox *decodeScaleBox;
+	QSpinBox *decodeThreadsBox;
+	QSpinBox *y16BitsBox;
+	QDoubleSpinBox *replaySpeedBox;
 
 	void addSlider(QFormLayout *formLayout, QString label ) {
 		QSlider *slider = new QSlider( Qt::Horizontal );
@@ -254,7 +342,15 @@ public slots:
     void setViewfinderSettings(QCameraViewfinderSettings settings);
     void setCamera(const QCameraInfo &cameraInfo);
     void setCamera(const QCameraInfo &cameraInfo, QCameraViewfinderSettings settings);
+	void setReplay(QString fileName);
+	void setReplaySpeed(double speed);
+	void frameConsumed();
 	void setColorCode(int code);
+	void setDecodeScale(int decodeScale);
+	void setDecodeThreads(int decodeThreads);
+	void setY16Bits(int bits);
+	void setRequiredSize(QSize size);
+	void setRecording(bool recording);
 	void setParameter(QString what, float value);
 	void setValuesUI();
 	void showOptions();
@@ -267,8 +363,20 @@ private:
     QString id;
     int colorCode;
 
+	int decodeScale;
+	int decodeThreads;
+	int y16Bits;
+	QSize requiredSize;
+	bool recording;
+	QSize decodeSize();
+	void updateDecodeSize();
+
     FrameGrabber *frameGrabber;
 
+	ReplaySource *replaySource;
+	QString replayFile;
+	double replaySpeed;
+
     QCameraViewfinderSettings getViewfinderSettings(const QCameraInfo cameraInfo);
 
     QSettings *settings;
@@ -319,6 +427,7 @@ private:
 
 private slots:
 	void reset();
+	void replayFinished();
 };
 
 #endif // CAMERA_H
@@ -71,22 +71,23 @@ CameraWidget::CameraWidget(QString id, ImageProcessor::Type type, QWidget *paren
     switch (type) {
         case ImageProcessor::Eye:
             imageProcessor->eyeProcessorUI = new EyeImageProcessorUI;
-            connect(imageProcessor, SIGNAL(newData(EyeData)),
-                    this, SLOT(preview(EyeData)) );
-            connect(imageProcessor, SIGNAL(newData(EyeData)),
-                    this, SIGNAL(newData(EyeData)) );
+			previewSubscription = imageProcessor->eyeData->subscribe("Preview", this,
+				[this](const EyeData &data) { preview(data); }, ChannelSubscription::LATEST );
             break;
 		case ImageProcessor::Field:
 			imageProcessor->fieldProcessorUI = new FieldImageProcessorUI;
-            connect(imageProcessor, SIGNAL(newData(FieldData)),
-                this, SLOT(preview(FieldData)) );
-            connect(imageProcessor, SIGNAL(newData(FieldData)),
-                this, SIGNAL(newData(FieldData)) );
+			previewSubscription = imageProcessor->fieldData->subscribe("Preview", this,
+				[this](const FieldData &data) { preview(data); }, ChannelSubscription::LATEST );
             break;
     }
+	connect(imageProcessor, SIGNAL(newInputSize(QSize)),
+		camera, SLOT(setRequiredSize(QSize)) );
     QMetaObject::invokeMethod(imageProcessor, "create");
 	connect(camera, SIGNAL(newFrame(Timestamp, const cv::Mat&)),
-        imageProcessor, SIGNAL(process(Timestamp, const cv::Mat&)) );
+		imageProcessor, SLOT(enqueue(Timestamp, const cv::Mat&)), Qt::DirectConnection );
+	// Backpressure for replays as fast as possible
+	connect(imageProcessor, SIGNAL(consumed()),
+		camera, SLOT(frameConsumed()) );
 
     // Data Recorder
     recorderThread = new QThread();
@@ -96,6 +97,16 @@ CameraWidget::CameraWidget(QString id, ImageProcessor::Type type, QWidget *paren
     recorder = new DataRecorderThread(id, type == ImageProcessor::Eye ? EyeData().header() : FieldData().header());
     recorder->moveToThread(recorderThread);
 	QMetaObject::invokeMethod(recorder, "create");
+	// Enabled while recording
+	DataRecorderThread *r = recorder;
+	if (type == ImageProcessor::Eye)
+		recorderSubscription = imageProcessor->eyeData->subscribe("Recorder", recorder,
+			[r](const EyeData &data) { if (r->dataRecorder) r->dataRecorder->newData(data); },
+			ChannelSubscription::LOSSLESS, false );
+	else
+		recorderSubscription = imageProcessor->fieldData->subscribe("Recorder", recorder,
+			[r](const FieldData &data) { if (r->dataRecorder) r->dataRecorder->newData(data); },
+			ChannelSubscription::LOSSLESS, false );
 
     // GUI
     optionsGroup = new QActionGroup(this);
@@ -134,6 +145,11 @@ CameraWidget::~CameraWidget()
         camera = NULL;
     }
 
+	// The camera thread pushes frames straight into the image processor mailbox;
+	// make sure it's gone before the processor is
+	cameraThread->quit();
+	cameraThread->wait();
+
     if (imageProcessor) {
         imageProcessor->deleteLater();
         imageProcessor = NULL;
@@ -149,9 +165,6 @@ CameraWidget::~CameraWidget()
 		cameraCalibration = NULL;
 	}
 
-    cameraThread->quit();
-    cameraThread->wait();
-
     processorThread->quit();
     processorThread->wait();
 
@@ -172,7 +185,7 @@ void CameraWidget::preview(Timestamp t, const cv::Mat &frame)
     ui->viewFinder->setPixmap(QPixmap::fromImage(scaled));
 }
 
-void CameraWidget::preview(EyeData data)
+void CameraWidget::preview(const EyeData &data)
 {
     if (data.input.empty()) // if there's no eye image, don't update
         return;
@@ -207,7 +220,7 @@ void CameraWidget::preview(EyeData data)
 	sendCameraCalibrationSample(data.input);
 }
 
-void CameraWidget::preview(FieldData data)
+void CameraWidget::preview(const FieldData &data)
 {
     // We only update the camera frame rate here. Viewfinder is updated
     // based on the signal from the gaze estimation stage
@@ -240,6 +253,11 @@ void CameraWidget::preview(const DataTuple &data)
 
 void CameraWidget::updateFrameRate(Timestamp t)
 {
+	// The preview only sees the latest data; count the frames it skipped too
+	unsigned long coalesced = previewSubscription->coalesced();
+	frameCount += 1 + coalesced - previewCoalesced;
+	previewCoalesced = coalesced;
+
 	// Simpler version since the status bar update showed some overhead
 	// during tests with OpenGL
 	if (tq.size() == 0) {
@@ -249,15 +267,18 @@ void CameraWidget::updateFrameRate(Timestamp t)
 				)
 			);
 		tq.push_back(t);
+		fq.push_back(frameCount);
 		lastFrameRateUpdate = t;
 		return;
 	}
 
 	tq.push_back(t);
+	fq.push_back(frameCount);
 	if (tq.size() > 30) {
 		tq.pop_front();
+		fq.pop_front();
 		if (tq.back() - lastFrameRateUpdate > 100) { // update every 100 ms
-			double fps = (tq.size()-1) / (1.0e-3*( tq.back() - tq.front() ) );
+			double fps = (fq.back() - fq.front()) / (1.0e-3*( tq.back() - tq.front() ) );
 			lastFrameRateUpdate = tq.back();
 			ui->statusbar->showMessage(
 				QString("%1 @ %2 FPS").arg(
@@ -300,20 +321,16 @@ void CameraWidget::options(QAction* action)
 void CameraWidget::startRecording()
 {
     ui->menubar->setEnabled(false);
+    QMetaObject::invokeMethod(camera, "setRecording", Q_ARG(bool, true));
     QMetaObject::invokeMethod(recorder, "startRecording", Q_ARG(double, camera->fps));
-    connect(imageProcessor, SIGNAL(newData(EyeData)),
-            recorder, SIGNAL(newData(EyeData)) );
-    connect(imageProcessor, SIGNAL(newData(FieldData)),
-            recorder, SIGNAL(newData(FieldData)) );
+	recorderSubscription->setEnabled(true);
 }
 
 void CameraWidget::stopRecording()
 {
-	disconnect(imageProcessor, SIGNAL(newData(EyeData)),
-			recorder, SIGNAL(newData(EyeData)) );
-	disconnect(imageProcessor, SIGNAL(newData(FieldData)),
-			recorder, SIGNAL(newData(FieldData)) );
+	recorderSubscription->setEnabled(false);
 	QMetaObject::invokeMethod(recorder, "stopRecording", Qt::QueuedConnection);
+	QMetaObject::invokeMethod(camera, "setRecording", Qt::QueuedConnection, Q_ARG(bool, false));
     ui->menubar->setEnabled(true);
 }
 
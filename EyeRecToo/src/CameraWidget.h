@@ -41,17 +41,18 @@ public:
     explicit CameraWidget(QString id, ImageProcessor::Type type, QWidget *parent = 0);
 	~CameraWidget();
 
+	Channel<EyeData>* eyeData() const { return imageProcessor->eyeData; }
+	Channel<FieldData>* fieldData() const { return imageProcessor->fieldData; }
+
 signals:
     void setCamera(QCameraInfo cameraInfo);
     void newROI(QPointF sROI, QPointF eROI);
-    void newData(EyeData data);
-    void newData(FieldData data);
 	void newClick(Timestamp,QPoint,QSize);
 
 public slots:
     void preview(Timestamp t, const cv::Mat &frame);
-    void preview(EyeData data);
-    void preview(FieldData data);
+    void preview(const EyeData &data);
+    void preview(const FieldData &data);
     void preview(const DataTuple &data);
     void options(QAction* action);
     void noCamera(QString msg);
@@ -83,10 +84,16 @@ private:
     DataRecorderThread *recorder;
 	QThread *recorderThread;
 
+	ChannelSubscription *previewSubscription;
+	ChannelSubscription *recorderSubscription;
+
     QActionGroup *optionsGroup;
     QAction *optionAction;
 
 	std::deque<Timestamp> tq;
+	std::deque<unsigned long> fq;
+	unsigned long frameCount = 0;
+	unsigned long previewCoalesced = 0;
 	Timestamp lastFrameRateUpdate;
     void updateFrameRate(Timestamp t);
 
@@ -0,0 +1,36 @@
+#include "Channel.h"
+
+ChannelSubscription::ChannelSubscription(const QString &channel, const QString &name, QObject *receiver, Mode mode) :
+    mode(mode),
+    enabled(true),
+    coalescedCount(0),
+    queueIdx(0),
+    latencyIdx(0),
+    coalescedIdx(0),
+    receiver(receiver),
+    notified(false)
+{
+    QString id = channel + " ->";
+    if (mode == LOSSLESS)
+        queueIdx = gPerformanceMonitor.enrolStatistic(id, name + " Queue");
+    else
+        coalescedIdx = gPerformanceMonitor.enrolStatistic(id, name + " Coalesced");
+    latencyIdx = gPerformanceMonitor.enrolStatistic(id, name + " Latency (ms)");
+
+    moveToThread(receiver->thread());
+}
+
+void ChannelSubscription::notify()
+{
+    // At most one pending drain, no matter how many values arrive meanwhile
+    if ( !notified.exchange(true) )
+        QMetaObject::invokeMethod(this, "drain", Qt::QueuedConnection);
+}
+
+void ChannelSubscription::drain()
+{
+    notified = false;
+    if (!receiver)
+        return;
+    deliverPending();
+}
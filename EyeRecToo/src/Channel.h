@@ -0,0 +1,212 @@
+#ifndef CHANNEL_H
+#define CHANNEL_H
+
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include <QObject>
+#include <QMutex>
+#include <QPointer>
+#include <QString>
+
+#include "Mailbox.h"
+#include "utils.h"
+
+/* Typed data channels between pipeline stages.
+ *
+ * A channel has a single publisher and any number of subscribers. Published
+ * values are wrapped once in a shared immutable payload, so the fan-out doesn't
+ * copy them, and handed to each subscriber in its receiver's thread.
+ *
+ * Subscriptions are either lossless (every value, in order) or latest (a value
+ * not delivered yet is replaced by a newer one; e.g., for previews). Both are
+ * lock-free single producer / single consumer buffers from Mailbox.h; a
+ * lossless subscriber that falls more than a ring behind spills into a locked
+ * overflow queue rather than losing values. Delivery takes a queued call into
+ * the receiver's thread, at most one pending per subscription. Disabling
+ * a subscription stops new values but still delivers the ones already queued,
+ * like disconnecting a queued signal would.
+ *
+ * Subscriptions live as long as their channel; receivers must outlive neither,
+ * but deliveries to a destroyed receiver are skipped.
+ */
+class ChannelSubscription : public QObject
+{
+    Q_OBJECT
+public:
+    enum Mode { LOSSLESS, LATEST };
+
+    ChannelSubscription(const QString &channel, const QString &name, QObject *receiver, Mode mode);
+    virtual ~ChannelSubscription() {}
+
+    void setEnabled(bool enabled) { this->enabled = enabled; }
+    bool isEnabled() const { return enabled; }
+    Mode getMode() const { return mode; }
+    unsigned long coalesced() const { return coalescedCount; }
+
+protected:
+    Mode mode;
+    std::atomic<bool> enabled;
+    std::atomic<unsigned long> coalescedCount;
+    unsigned int queueIdx;
+    unsigned int latencyIdx;
+    unsigned int coalescedIdx;
+
+    void notify();
+    virtual void deliverPending() = 0;
+
+private:
+    QPointer<QObject> receiver;
+    std::atomic<bool> notified;
+
+private slots:
+    void drain();
+};
+
+template<class T>
+class Channel
+{
+public:
+    typedef std::shared_ptr<const T> Payload;
+    typedef std::function<void(const T&)> Callback;
+
+    explicit Channel(const QString &name) : name(name) {}
+    ~Channel()
+    {
+        for (auto s = subscriptions.begin(); s != subscriptions.end(); ++s)
+            (*s)->deleteLater();
+    }
+
+    // The callback runs in the receiver's thread
+    ChannelSubscription* subscribe(const QString &subscriber, QObject *receiver, Callback callback,
+                                   ChannelSubscription::Mode mode = ChannelSubscription::LOSSLESS, bool enabled = true)
+    {
+        Subscription *s = new Subscription(name, subscriber, receiver, callback, mode);
+        s->setEnabled(enabled);
+        QMutexLocker locker(&mutex);
+        subscriptions.push_back(s);
+        return s;
+    }
+
+    void publish(const T &value)
+    {
+        Payload payload;
+        publish(value, payload);
+    }
+
+    void publish(const Payload &payload)
+    {
+        Payload p = payload;
+        publish(*payload, p);
+    }
+
+private:
+    class Subscription : public ChannelSubscription
+    {
+    public:
+        Subscription(const QString &channel, const QString &name, QObject *receiver, Callback callback, Mode mode) :
+            ChannelSubscription(channel, name, receiver, mode),
+            callback(callback)
+        {
+            if (mode == LATEST)
+                latest.reset(new TripleBuffer<Item>());
+            else
+                fifo.reset(new BoundedFifo<Item>(RingSize));
+            overflowing = false;
+        }
+
+        void push(const Payload &payload, const qint64 &ns)
+        {
+            Item item = { payload, ns };
+            if (mode == LATEST) {
+                if (latest->push(item)) {
+                    coalescedCount++;
+                    gPerformanceMonitor.incrementStatistic(coalescedIdx);
+                }
+            } else if ( overflowing.load(std::memory_order_acquire) || !fifo->push(item) ) {
+                // Keeps the order: the consumer drains the ring before the overflow, and
+                // nothing goes into the ring again until the overflow is empty
+                QMutexLocker locker(&overflowMutex);
+                overflow.push_back(item);
+                overflowing.store(true, std::memory_order_release);
+            }
+            notify();
+        }
+
+    protected:
+        void deliverPending() override
+        {
+            // Only what's here already; later values come with their own notification
+            size_t pending = 1;
+            if (mode == LOSSLESS) {
+                pending = fifo->size();
+                if (overflowing.load(std::memory_order_acquire)) {
+                    QMutexLocker locker(&overflowMutex);
+                    pending += overflow.size();
+                }
+                gPerformanceMonitor.setStatistic(queueIdx, pending);
+            }
+
+            Item item;
+            for (; pending > 0 && pop(item); pending--) {
+                gPerformanceMonitor.setStatistic(latencyIdx, 1.0e-6 * (gTimer.nsecsElapsed() - item.publishedNs));
+                callback(*item.payload);
+            }
+        }
+
+    private:
+        struct Item {
+            Payload payload;
+            qint64 publishedNs;
+        };
+
+        bool pop(Item &item)
+        {
+            if (mode == LATEST)
+                return latest->pop(item);
+            if (fifo->pop(item))
+                return true;
+            if (!overflowing.load(std::memory_order_acquire))
+                return false;
+            QMutexLocker locker(&overflowMutex);
+            if (overflow.empty())
+                return false;
+            item = overflow.front();
+            overflow.pop_front();
+            if (overflow.empty())
+                overflowing.store(false, std::memory_order_release);
+            return true;
+        }
+
+        static const size_t RingSize = 256;
+
+        Callback callback;
+        std::unique_ptr< TripleBuffer<Item> > latest; // LATEST only
+        std::unique_ptr< BoundedFifo<Item> > fifo; // LOSSLESS only
+        QMutex overflowMutex;
+        std::deque<Item> overflow;
+        std::atomic<bool> overflowing;
+    };
+
+    void publish(const T &value, Payload &payload)
+    {
+        qint64 ns = gTimer.nsecsElapsed();
+        QMutexLocker locker(&mutex);
+        for (auto s = subscriptions.begin(); s != subscriptions.end(); ++s) {
+            if ( !(*s)->isEnabled() )
+                continue;
+            if (!payload) // only pay for the copy if someone is listening
+                payload = std::make_shared<const T>(value);
+            (*s)->push(payload, ns);
+        }
+    }
+
+    QString name;
+    QMutex mutex;
+    std::vector<Subscription*> subscriptions;
+};
+
+#endif // CHANNEL_H
@@ -0,0 +1,82 @@
+#include "ClockModel.h"
+
+#include <cmath>
+#include <algorithm>
+
+// Process noise per elapsed ms: ~0.1 ms of offset wander and ~1 ppm of skew change per minute
+static const double qOffset = 1.7e-7;
+static const double qSkew = 1.7e-17;
+// Measurement noise floor, since the host timer has ms resolution
+static const double minR = 0.25;
+
+ClockModel::ClockModel() :
+    outliers(0)
+{
+    reset();
+}
+
+void ClockModel::reset()
+{
+    initialized = false;
+    lastDevice = 0;
+    offset = 0;
+    skew = 0;
+    P[0][0] = 100;  // ~10 ms
+    P[0][1] = P[1][0] = 0;
+    P[1][1] = 1e-8; // ~100 ppm
+    residualVar = 1;
+    consecutiveOutliers = 0;
+}
+
+Timestamp ClockModel::update(const Timestamp &host, const qint64 &device)
+{
+    double z = host - device;
+
+    if (!initialized) {
+        offset = z;
+        lastDevice = device;
+        initialized = true;
+        return host;
+    }
+
+    // Predict
+    double dt = device - lastDevice;
+    lastDevice = device;
+    offset += skew * dt;
+    double p00 = P[0][0] + dt*(P[1][0] + P[0][1]) + dt*dt*P[1][1] + qOffset*fabs(dt);
+    double p01 = P[0][1] + dt*P[1][1];
+    double p11 = P[1][1] + qSkew*fabs(dt);
+    P[0][0] = p00;
+    P[0][1] = P[1][0] = p01;
+    P[1][1] = p11;
+
+    // Update
+    double R = std::max<double>(residualVar, minR);
+    double S = P[0][0] + R;
+    double y = z - offset;
+    if (y*y > gate*gate*S) {
+        outliers++;
+        if (++consecutiveOutliers > maxConsecutiveOutliers) {
+            qWarning() << "Clock model lost track; restarting.";
+            reset();
+            return update(host, device);
+        }
+        return device + qRound64(offset);
+    }
+    consecutiveOutliers = 0;
+
+    double k0 = P[0][0] / S;
+    double k1 = P[1][0] / S;
+    offset += k0*y;
+    skew += k1*y;
+    p00 = (1-k0)*P[0][0];
+    p01 = (1-k0)*P[0][1];
+    p11 = P[1][1] - k1*P[0][1];
+    P[0][0] = p00;
+    P[0][1] = P[1][0] = p01;
+    P[1][1] = p11;
+
+    residualVar = 0.99*residualVar + 0.01*y*y;
+
+    return device + qRound64(offset);
+}
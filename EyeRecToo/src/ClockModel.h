@@ -0,0 +1,43 @@
+#ifndef CLOCKMODEL_H
+#define CLOCKMODEL_H
+
+#include <cmath>
+
+#include "utils.h"
+
+/* Online model of a device clock relative to gTimer.
+ *
+ * host - device = offset + skew * (device - last device timestamp)
+ *
+ * Both offset and skew are tracked with a small Kalman filter so the model
+ * follows the (slow) drift of the camera clock during long recordings.
+ * Measurements delayed well beyond the jitter (e.g., the camera thread
+ * was busy) are gated out, and a persistent mismatch (e.g., the device
+ * clock was reset) restarts the model.
+ */
+class ClockModel
+{
+public:
+    ClockModel();
+    void reset();
+    // Feeds a new (host, device) pair and returns the corrected host timestamp for device
+    Timestamp update(const Timestamp &host, const qint64 &device);
+
+    double driftPpm() const { return 1.0e6 * skew; }
+    double jitterMs() const { return sqrt(residualVar); }
+    unsigned long int outlierCount() const { return outliers; }
+
+private:
+    bool initialized;
+    qint64 lastDevice;
+    double offset, skew;
+    double P[2][2];
+    double residualVar;
+    unsigned long int outliers;
+    unsigned int consecutiveOutliers;
+
+    static constexpr double gate = 4;
+    static constexpr unsigned int maxConsecutiveOutliers = 30;
+};
+
+#endif // CLOCKMODEL_H
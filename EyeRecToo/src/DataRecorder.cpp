@@ -59,17 +59,17 @@ void DataRecorder::stopRecording()
     videoWriter = NULL;
 }
 
-void DataRecorder::newData(EyeData eyeData)
+void DataRecorder::newData(const EyeData &eyeData)
 {
     storeData(eyeData);
 }
 
-void DataRecorder::newData(FieldData fieldData)
+void DataRecorder::newData(const FieldData &fieldData)
 {
     storeData(fieldData);
 }
 
-void DataRecorder::newData(DataTuple dataTuple)
+void DataRecorder::newData(const DataTuple &dataTuple)
 {
 	// Note that the Journal data recorder isn't registered with the
     // performance monitor since it's cheap to store its data.
@@ -93,7 +93,7 @@ bool DataRecorder::splitVideoFile()
 }
 
 template <class T>
-void DataRecorder::storeData(T &data)
+void DataRecorder::storeData(const T &data)
 {
     if (firstFrame) {
         firstFrame = false;
@@ -25,9 +25,9 @@ public slots:
     void startRecording(double fps);
     void startRecording();
     void stopRecording();
-    void newData(EyeData eyeData);
-    void newData(FieldData fieldData);
-    void newData(DataTuple dataTuple);
+    void newData(const EyeData &eyeData);
+    void newData(const FieldData &fieldData);
+    void newData(const DataTuple &dataTuple);
 
 private:
     QString id;
@@ -41,7 +41,7 @@ private:
     QFileInfo currentVideoFileInfo;
 
     template <class T>
-    void storeData(T &data);
+    void storeData(const T &data);
     bool splitVideoFile();
     double fps;
 
@@ -26,14 +26,33 @@ EyeImageProcessor::EyeImageProcessor(QString id, QObject *parent)
     updateConfig();
 
 	pmIdx = gPerformanceMonitor.enrol(id, "Image Processor");
+	truncatedIdx = gPerformanceMonitor.enrolStatistic(id, "Truncated Detections");
+	cappedIdx = gPerformanceMonitor.enrolStatistic(id, "Capped Tracking Searches");
+	coarseReusesIdx = gPerformanceMonitor.enrolStatistic(id, "Coarse ROI Reuses");
+	coarseSavedIdx = gPerformanceMonitor.enrolStatistic(id, "Coarse Detection Saved (ms)");
+	coarseStabilityIdx = gPerformanceMonitor.enrolStatistic(id, "Coarse ROI Stability");
+	pool = FramePool::get(id);
+#ifdef COUNT_ALLOCATIONS
+	allocationsIdx = gPerformanceMonitor.enrolStatistic(id, "Detection Allocations");
+#endif
 
 	pupilTrackingMethod = new PuReST();
+	pupilTrackingMethod->setParallelDetection(cfg.parallelDetectionInterval);
 }
 
 void EyeImageProcessor::updateConfig()
 {
     QMutexLocker locker(&cfgMutex);
     cfg.load(settings);
+    emit newInputSize( QSize(cfg.inputSize.width, cfg.inputSize.height) );
+    emit newQueueSize(cfg.queueSize);
+    coarse.framesLeft = 0;
+
+    // The detection method might be changed or used directly from now on
+    if (pupilTrackingMethod) {
+        pupilTrackingMethod->waitForDetection();
+        pupilTrackingMethod->setParallelDetection(cfg.parallelDetectionInterval);
+    }
 
     pupilDetectionMethod = NULL;
     for (int i=0; i<availablePupilDetectionMethods.size(); i++)
@@ -43,6 +62,8 @@ void EyeImageProcessor::updateConfig()
 
 EyeImageProcessor::~EyeImageProcessor()
 {
+    delete pupilTrackingMethod; // waits for a parallel detection still using the methods below
+
     for (int i=0; i<availablePupilDetectionMethods.size(); i++)
         delete availablePupilDetectionMethods[i];
     availablePupilDetectionMethods.clear();
@@ -63,7 +84,7 @@ void EyeImageProcessor::process(Timestamp timestamp, const Mat &frame)
 
 	Q_ASSERT_X(frame.data != data.input.data, "Eye Image Processing", "Previous and current input image matches!");
 	if (cfg.inputSize.width > 0 && cfg.inputSize.height > 0) {
-		data.input = Mat(cfg.inputSize, frame.type() );
+		pool->attach(data.input);
 		resize(frame, data.input, cfg.inputSize);
 	}
 	else {
@@ -78,6 +99,7 @@ void EyeImageProcessor::process(Timestamp timestamp, const Mat &frame)
 
 	data.pupil = Pupil();
 	data.validPupil = false;
+	data.detectionTruncated = false;
 	if (pupilDetectionMethod != NULL)  {
 		Rect userROI = Rect(
 				Point(sROI.x() * data.input.cols, sROI.y() * data.input.rows),
@@ -92,6 +114,7 @@ void EyeImageProcessor::process(Timestamp timestamp, const Mat &frame)
 		 *  From here on, our reference frame is the scaled user ROI
 		 */
 		Mat downscaled;
+		pool->attach(downscaled);
 		resize(data.input(userROI), downscaled, Size(),
 			   scalingFactor, scalingFactor,
 			   INTER_AREA);
@@ -100,7 +123,7 @@ void EyeImageProcessor::process(Timestamp timestamp, const Mat &frame)
         // If the user wants a coarse location and the method has none embedded,
         // we further constrain the search using the generic one
         if (!pupilDetectionMethod->hasCoarseLocation() && cfg.coarseDetection) {
-            coarseROI = PupilDetectionMethod::coarsePupilDetection( downscaled, 0.5f, 60, 40);
+            coarseROI = coarseDetection(downscaled, userROI);
             data.coarseROI = Rect(
                                  userROI.tl() + coarseROI.tl() / scalingFactor,
                                  userROI.tl() + coarseROI.br() / scalingFactor
@@ -108,14 +131,34 @@ void EyeImageProcessor::process(Timestamp timestamp, const Mat &frame)
         } else
             data.coarseROI = Rect();
 
+		// Whatever is left of the budget after queueing and preprocessing
+		Deadline deadline;
+		if (cfg.detectionBudgetMs > 0 && gPerformanceMonitor.isRealTime())
+			deadline.set( timestamp + cfg.detectionBudgetMs - gTimer.elapsed() );
+
+#ifdef COUNT_ALLOCATIONS
+		unsigned long long allocations = AllocationCounter::count();
+#endif
         if (cfg.tracking && pupilTrackingMethod) {
-			pupilTrackingMethod->run(timestamp, downscaled, coarseROI, data.pupil, *pupilDetectionMethod);
+			pupilTrackingMethod->run(timestamp, downscaled, coarseROI, data.pupil, *pupilDetectionMethod, deadline);
+			if (pupilTrackingMethod->capped())
+				gPerformanceMonitor.incrementStatistic(cappedIdx);
 		} else {
-			pupilDetectionMethod->run( downscaled, coarseROI, data.pupil );
+			pupilDetectionMethod->run( downscaled, coarseROI, data.pupil, -1, -1, deadline );
 			// TODO: expose this to the user
 			if ( ! pupilDetectionMethod->hasConfidence() )
 				data.pupil.confidence = PupilDetectionMethod::outlineContrastConfidence(downscaled, data.pupil);
         }
+#ifdef COUNT_ALLOCATIONS
+		gPerformanceMonitor.setStatistic(allocationsIdx, AllocationCounter::count() - allocations);
+#endif
+
+		data.detectionTruncated = deadline.truncated();
+		if (data.detectionTruncated)
+			gPerformanceMonitor.incrementStatistic(truncatedIdx);
+
+		// Low confidence suggests the coarse ROI may have cut off the pupil
+		coarse.pupilFound = data.pupil.confidence > 0.66 && coarseROI.contains(data.pupil.center);
 
 		if (data.pupil.center.x > 0 && data.pupil.center.y > 0) {
 			// Upscale
@@ -133,6 +176,38 @@ void EyeImageProcessor::process(Timestamp timestamp, const Mat &frame)
     emit newData(data);
 }
 
+Rect EyeImageProcessor::coarseDetection(const Mat &downscaled, const Rect &userROI)
+{
+	bool reuse = coarse.framesLeft > 0 &&
+		coarse.pupilFound &&
+		coarse.size == downscaled.size() &&
+		coarse.userROI == userROI;
+	if (reuse) {
+		coarse.framesLeft--;
+		gPerformanceMonitor.incrementStatistic(coarseReusesIdx);
+		gPerformanceMonitor.incrementStatistic(coarseSavedIdx, coarse.costMs);
+		return coarse.roi;
+	}
+
+	QElapsedTimer timer;
+	timer.start();
+	Rect roi = PupilDetectionMethod::coarsePupilDetection( downscaled, 0.5f, 60, 40);
+	coarse.costMs = 1e-6 * timer.nsecsElapsed();
+
+	// Overlap with the previous ROI (intersection over union); close to one
+	// means refreshing more often is unlikely to pay off
+	if (coarse.size == downscaled.size() && coarse.roi.area() > 0) {
+		int intersection = (roi & coarse.roi).area();
+		gPerformanceMonitor.setStatistic(coarseStabilityIdx, intersection / (double) (roi.area() + coarse.roi.area() - intersection) );
+	}
+
+	coarse.roi = roi;
+	coarse.userROI = userROI;
+	coarse.size = downscaled.size();
+	coarse.framesLeft = cfg.coarseRefreshInterval - 1;
+	return roi;
+}
+
 void EyeImageProcessor::newROI(QPointF sROI, QPointF eROI)
 {
     QMutexLocker locker(&cfgMutex);
@@ -33,6 +33,8 @@
 #include "pupil-tracking/PupilTrackingMethod.h"
 
 #include "utils.h"
+#include "FramePool.h"
+#include "AllocationCounter.h"
 
 class EyeData : public InputData {
 public:
@@ -41,12 +43,14 @@ public:
         input = cv::Mat();
 		pupil = Pupil();
         validPupil = false;
+        detectionTruncated = false;
         processingTimestamp = 0;
     }
 
     cv::Mat input;
 	Pupil pupil;
 	bool validPupil;
+	bool detectionTruncated; // the detection budget ran out
 	cv::Rect coarseROI;
 
     // TODO: header, toQString, and the reading from file (see the Calibration class) should be unified
@@ -68,6 +72,8 @@ public:
 		tmp.append(prefix + "pupil.confidence");
 		tmp.append(gDataSeparator);
 		tmp.append(prefix + "pupil.valid");
+        tmp.append(gDataSeparator);
+		tmp.append(prefix + "pupil.truncated");
         tmp.append(gDataSeparator);
 		tmp.append(prefix + "processingTime");
         tmp.append(gDataSeparator);
@@ -92,6 +98,8 @@ public:
         tmp.append(gDataSeparator);
         tmp.append(QString::number(validPupil));
         tmp.append(gDataSeparator);
+        tmp.append(QString::number(detectionTruncated));
+        tmp.append(gDataSeparator);
         tmp.append(QString::number(processingTimestamp));
         tmp.append(gDataSeparator);
         return tmp;
@@ -112,7 +120,11 @@ public:
 		  coarseDetection(false),
 		  processingDownscalingFactor(1),
 		  pupilDetectionMethod(PuRe::desc.c_str()),
-		  tracking(true)
+		  tracking(true),
+		  queueSize(0),
+		  detectionBudgetMs(0),
+		  coarseRefreshInterval(1),
+		  parallelDetectionInterval(0)
     {}
 
     cv::Size inputSize;
@@ -122,6 +134,10 @@ public:
     double processingDownscalingFactor;
 	QString pupilDetectionMethod;
 	bool tracking;
+	int queueSize;
+	int detectionBudgetMs; // counted from the frame timestamp; 0 for unlimited
+	int coarseRefreshInterval; // in frames
+	int parallelDetectionInterval; // in frames; 0 disables it
 
     void save(QSettings *settings)
     {
@@ -134,6 +150,10 @@ public:
 		settings->setValue("processingDownscalingFactor", processingDownscalingFactor);
         settings->setValue("pupilDetectionMethod", pupilDetectionMethod);
 		settings->setValue("tracking", tracking);
+		settings->setValue("queueSize", queueSize);
+		settings->setValue("detectionBudgetMs", detectionBudgetMs);
+		settings->setValue("coarseRefreshInterval", coarseRefreshInterval);
+		settings->setValue("parallelDetectionInterval", parallelDetectionInterval);
 	}
 
     void load(QSettings *settings)
@@ -147,6 +167,10 @@ public:
 		set(settings, "processingDownscalingFactor", processingDownscalingFactor);
         set(settings, "pupilDetectionMethod", pupilDetectionMethod);
 		set(settings, "tracking", tracking);
+		set(settings, "queueSize", queueSize);
+		set(settings, "detectionBudgetMs", detectionBudgetMs);
+		set(settings, "coarseRefreshInterval", coarseRefreshInterval);
+		set(settings, "parallelDetectionInterval", parallelDetectionInterval);
 	}
 };
 
@@ -207,6 +231,13 @@ public:
         box->setLayout(hBoxLayout);
         hBoxLayout->addWidget(new QLabel("Downscaling Factor:"));
         hBoxLayout->addWidget(downscalingSB);
+        queueSizeSB = new QSpinBox();
+        queueSizeSB->setMaximum(64);
+        queueSizeSB->setSpecialValueText("Latest only");
+        queueSizeSB->setWhatsThis("Frames waiting for processing.\nLatest only: a new frame replaces the pending one (counted as coalesced).\nOtherwise: frames are processed in order, and new frames are dropped when the queue is full.");
+        queueSizeSB->setToolTip(queueSizeSB->whatsThis());
+        hBoxLayout->addWidget(new QLabel("Queue:"));
+        hBoxLayout->addWidget(queueSizeSB);
         layout->addWidget(box);
 
 
@@ -219,12 +250,33 @@ public:
 		coarseDetectionBox->setWhatsThis("Estimate a coarse location for the pupil location prior to detection.");
 		coarseDetectionBox->setToolTip(box->whatsThis());
 		formLayout->addRow( new QLabel("Coarse Detection:"), coarseDetectionBox );
+		coarseRefreshSB = new QSpinBox();
+		coarseRefreshSB->setRange(1, 300);
+		coarseRefreshSB->setSuffix(" frames");
+		coarseRefreshSB->setSpecialValueText("Every frame");
+		coarseRefreshSB->setWhatsThis("How often the coarse location is recomputed.\nIn between, the previous one is reused as long as the pupil is found inside it with high confidence.");
+		coarseRefreshSB->setToolTip(coarseRefreshSB->whatsThis());
+		formLayout->addRow( new QLabel("Coarse Refresh:"), coarseRefreshSB );
 		pupilDetectionComboBox = new QComboBox();
 		formLayout->addRow(pupilDetectionComboBox);
 		trackingBox = new QCheckBox();
 		trackingBox->setWhatsThis("Track the pupil after detection using PuReST.");
 		trackingBox->setToolTip(box->whatsThis());
 		formLayout->addRow( new QLabel("PuReST (Santini et al. 2018b):"), trackingBox );
+		parallelDetectionSB = new QSpinBox();
+		parallelDetectionSB->setMaximum(300);
+		parallelDetectionSB->setSuffix(" frames");
+		parallelDetectionSB->setSpecialValueText("Off");
+		parallelDetectionSB->setWhatsThis("While tracking, also run the full detection in the background every so many frames (or whenever the tracking confidence drops) to validate the track.");
+		parallelDetectionSB->setToolTip(parallelDetectionSB->whatsThis());
+		formLayout->addRow( new QLabel("Parallel Detection:"), parallelDetectionSB );
+		detectionBudgetSB = new QSpinBox();
+		detectionBudgetSB->setMaximum(1000);
+		detectionBudgetSB->setSuffix(" ms");
+		detectionBudgetSB->setSpecialValueText("Unlimited");
+		detectionBudgetSB->setWhatsThis("Time from frame capture until the detection must finish.\nWhen it runs out, supporting methods (PuRe) return the best pupil found so far and the sample is marked as truncated.");
+		detectionBudgetSB->setToolTip(detectionBudgetSB->whatsThis());
+		formLayout->addRow( new QLabel("Budget:"), detectionBudgetSB );
 		layout->addWidget(box);
 
         applyButton = new QPushButton("Apply");
@@ -250,7 +302,9 @@ public slots:
         widthSB->setValue(cfg.inputSize.width);
         heightSB->setValue(cfg.inputSize.height);
 		downscalingSB->setValue(cfg.processingDownscalingFactor);
+		queueSizeSB->setValue(cfg.queueSize);
 		coarseDetectionBox->setChecked(cfg.coarseDetection);
+		coarseRefreshSB->setValue(cfg.coarseRefreshInterval);
         for (int i=0; i<flipComboBox->count(); i++)
             if (flipComboBox->itemData(i).toInt() == cfg.flip)
                 flipComboBox->setCurrentIndex(i);
@@ -258,6 +312,8 @@ public slots:
             if (pupilDetectionComboBox->itemData(i).toString() == cfg.pupilDetectionMethod)
                 pupilDetectionComboBox->setCurrentIndex(i);
 		trackingBox->setChecked(cfg.tracking);
+		parallelDetectionSB->setValue(cfg.parallelDetectionInterval);
+		detectionBudgetSB->setValue(cfg.detectionBudgetMs);
 		move(pos);
         show();
     }
@@ -267,10 +323,14 @@ public slots:
         cfg.inputSize.width = widthSB->value();
         cfg.inputSize.height = heightSB->value();
 		cfg.processingDownscalingFactor = downscalingSB->value();
+		cfg.queueSize = queueSizeSB->value();
 		cfg.flip = (CVFlip) flipComboBox->currentData().toInt();
 		cfg.coarseDetection = coarseDetectionBox->isChecked();
+		cfg.coarseRefreshInterval = coarseRefreshSB->value();
         cfg.pupilDetectionMethod = pupilDetectionComboBox->currentData().toString();
 		cfg.tracking = trackingBox->isChecked();
+		cfg.parallelDetectionInterval = parallelDetectionSB->value();
+		cfg.detectionBudgetMs = detectionBudgetSB->value();
 		cfg.save(settings);
         emit updateConfig();
 	}
@@ -280,9 +340,13 @@ private:
     QSpinBox *widthSB, *heightSB;
 	QCheckBox *undistortBox;
 	QCheckBox *coarseDetectionBox;
+	QSpinBox *coarseRefreshSB;
 	QComboBox *flipComboBox;
 	QDoubleSpinBox *downscalingSB;
+	QSpinBox *queueSizeSB;
 	QCheckBox *trackingBox;
+	QSpinBox *parallelDetectionSB;
+	QSpinBox *detectionBudgetSB;
 };
 
 class EyeImageProcessor : public QObject
@@ -298,6 +362,8 @@ public:
 
 signals:
     void newData(EyeData data);
+    void newInputSize(QSize size);
+    void newQueueSize(int size);
 
 public slots:
 	void process(Timestamp t, const cv::Mat &frame);
@@ -313,6 +379,25 @@ private:
 	PupilTrackingMethod *pupilTrackingMethod;
 
 	unsigned int pmIdx;
+	unsigned int truncatedIdx;
+	unsigned int cappedIdx;
+
+	// Temporal coarse detection: the last coarse ROI (in the downscaled user
+	// ROI) is reused until it is due or the pupil is lost
+	struct {
+		cv::Rect roi;
+		cv::Rect userROI;
+		cv::Size size;
+		int framesLeft;
+		bool pupilFound;
+		double costMs; // of the last computation, i.e., saved by each reuse
+	} coarse;
+	unsigned int coarseReusesIdx, coarseSavedIdx, coarseStabilityIdx;
+	cv::Rect coarseDetection(const cv::Mat &downscaled, const cv::Rect &userROI);
+	FramePool *pool;
+#ifdef COUNT_ALLOCATIONS
+	unsigned int allocationsIdx;
+#endif
 };
 
 #endif // EYEIMAGEPROCESSOR_H
@@ -26,12 +26,15 @@ FieldImageProcessor::FieldImageProcessor(QString id, QObject *parent)
 	//printMarkers(); // TODO: parametrize me
 
     pmIdx = gPerformanceMonitor.enrol(id, "Image Processor");
+	pool = FramePool::get(id);
 }
 
 void FieldImageProcessor::updateConfig()
 {
     QMutexLocker locker(&cfgMutex);
     cfg.load(settings);
+    emit newInputSize( QSize(cfg.inputSize.width, cfg.inputSize.height) );
+    emit newQueueSize(cfg.queueSize);
     forceSanitize = true;
 }
 
@@ -52,7 +55,7 @@ void FieldImageProcessor::process(Timestamp timestamp, const Mat &frame)
     data.timestamp = timestamp;
 
     if (cfg.inputSize.width > 0 && cfg.inputSize.height > 0) {
-        data.input = Mat(cfg.inputSize, frame.type() );
+        pool->attach(data.input);
         resize(frame, data.input, cfg.inputSize);
     }
 	else {
@@ -69,6 +72,7 @@ void FieldImageProcessor::process(Timestamp timestamp, const Mat &frame)
 	if (data.undistorted) {
 		if (cameraCalibration) {
 			Mat tmp;
+			pool->attach(tmp);
 			cameraCalibration->undistort(data.input, tmp);
 			data.input = tmp;
 		}
@@ -82,6 +86,7 @@ void FieldImageProcessor::process(Timestamp timestamp, const Mat &frame)
     vector<vector<Point2f> > corners;
 	Mat downscaled;
 	if (cfg.processingDownscalingFactor > 1) {
+		pool->attach(downscaled);
         resize(data.input, downscaled, Size(),
                1/cfg.processingDownscalingFactor,
                1/cfg.processingDownscalingFactor,
@@ -25,6 +25,7 @@
 #include "InputWidget.h"
 
 #include "utils.h"
+#include "FramePool.h"
 
 class Marker {
 public:
@@ -162,7 +163,8 @@ public:
           collectionMarkerSizeMeters(0.10),
           processingDownscalingFactor(2),
           undistort(false),
-		  markerDetectionMethod("")
+		  markerDetectionMethod(""),
+		  queueSize(0)
     {
     }
 
@@ -173,6 +175,7 @@ public:
     double processingDownscalingFactor;
     bool undistort;
     QString markerDetectionMethod;
+    int queueSize;
 
     void save(QSettings *settings)
     {
@@ -185,6 +188,7 @@ public:
         settings->setValue("processingDownscalingFactor", processingDownscalingFactor);
         settings->setValue("undistort", undistort);
         settings->setValue("markerDetectionMethod", markerDetectionMethod);
+        settings->setValue("queueSize", queueSize);
     }
 
     void load(QSettings *settings)
@@ -198,6 +202,7 @@ public:
         set(settings, "processingDownscalingFactor", processingDownscalingFactor);
         set(settings, "undistort", undistort);
         set(settings, "markerDetectionMethod", markerDetectionMethod);
+        set(settings, "queueSize", queueSize);
     }
 };
 
@@ -256,6 +261,13 @@ public:
         box->setLayout(hBoxLayout);
         hBoxLayout->addWidget(new QLabel("Downscaling Factor:"));
         hBoxLayout->addWidget(downscalingSB);
+        queueSizeSB = new QSpinBox();
+        queueSizeSB->setMaximum(64);
+        queueSizeSB->setSpecialValueText("Latest only");
+        queueSizeSB->setWhatsThis("Frames waiting for processing.\nLatest only: a new frame replaces the pending one (counted as coalesced).\nOtherwise: frames are processed in order, and new frames are dropped when the queue is full.");
+        queueSizeSB->setToolTip(queueSizeSB->whatsThis());
+        hBoxLayout->addWidget(new QLabel("Queue:"));
+        hBoxLayout->addWidget(queueSizeSB);
         layout->addWidget(box);
 
         hBoxLayout = new QHBoxLayout();
@@ -315,6 +327,7 @@ public slots:
         cmIdSB->setValue(cfg.collectionMarkerId);
         cmSizeSB->setValue(cfg.collectionMarkerSizeMeters);
         downscalingSB->setValue(cfg.processingDownscalingFactor);
+        queueSizeSB->setValue(cfg.queueSize);
         for (int i=0; i<markerDetectionComboBox->count(); i++)
             if (markerDetectionComboBox->itemData(i).toString() == cfg.markerDetectionMethod)
                 markerDetectionComboBox->setCurrentIndex(i);
@@ -331,6 +344,7 @@ public slots:
         cfg.collectionMarkerId = cmIdSB->value();
         cfg.collectionMarkerSizeMeters = cmSizeSB->value();
         cfg.processingDownscalingFactor = downscalingSB->value();
+        cfg.queueSize = queueSizeSB->value();
         cfg.markerDetectionMethod = markerDetectionComboBox->currentData().toString();
         cfg.save(settings);
         emit updateConfig();
@@ -344,6 +358,7 @@ private:
     QSpinBox *cmIdSB;
     QDoubleSpinBox *cmSizeSB;
     QDoubleSpinBox *downscalingSB;
+    QSpinBox *queueSizeSB;
     QComboBox *markerDetectionComboBox;
 };
 
@@ -358,6 +373,8 @@ public:
 
 signals:
     void newData(FieldData data);
+    void newInputSize(QSize size);
+    void newQueueSize(int size);
 
 public slots:
     void process(Timestamp t, const cv::Mat &frame);
@@ -383,6 +400,7 @@ private:
     void sanitizeCameraParameters(cv::Size size);
 
     unsigned int pmIdx;
+	FramePool *pool;
 };
 
 #endif // FIELDIMAGEPROCESSOR_H
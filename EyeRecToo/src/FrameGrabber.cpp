@@ -7,15 +7,15 @@ FrameGrabber::FrameGrabber(QString id, int code, QObject *parent) :
     QAbstractVideoSurface(parent),
     id(id),
     code(code),
-    yuvBuffer(NULL),
-    yuvBufferSize(0),
-	timestampOffset(0),
-	timeoutMs(2e3)
+	timeoutMs(2e3),
+	y16Bits(0),
+	y16DetectedBits(8),
+	maxDecodeQueueSize(0),
+	stopDecoding(false),
+	nextSeq(0),
+	nextEmitSeq(0),
+	decodeTimeMs(0)
 {
-#ifdef TURBOJPEG
-    tjh = tjInitDecompress();
-#endif
-
     watchdog = new QTimer(this);
     connect(watchdog, SIGNAL(timeout()), this, SIGNAL(timedout()));
 
@@ -24,15 +24,19 @@ FrameGrabber::FrameGrabber(QString id, int code, QObject *parent) :
 	watchdog->start(15e3);
 
     pmIdx = gPerformanceMonitor.enrol(id, "Frame Grabber");
+    pool = FramePool::get(id);
+    decodeQueueIdx = gPerformanceMonitor.enrolStatistic(id, "Decode Queue");
+    decodeTimeIdx = gPerformanceMonitor.enrolStatistic(id, "Decode Time (ms)");
+    clockDriftIdx = gPerformanceMonitor.enrolStatistic(id, "Clock Drift (ppm)");
+    clockJitterIdx = gPerformanceMonitor.enrolStatistic(id, "Clock Jitter (ms)");
+    clockOutliersIdx = gPerformanceMonitor.enrolStatistic(id, "Clock Outliers");
 }
 
 FrameGrabber::~FrameGrabber()
 {
+    stopDecodeWorkers();
     watchdog->stop();
     watchdog->deleteLater();
-#ifdef TURBOJPEG
-    tjDestroy(tjh);
-#endif
 }
 
 QList<QVideoFrame::PixelFormat> FrameGrabber::supportedPixelFormats(QAbstractVideoBuffer::HandleType handleType) const
@@ -42,7 +46,11 @@ QList<QVideoFrame::PixelFormat> FrameGrabber::supportedPixelFormats(QAbstractVid
             << QVideoFrame::Format_Jpeg
             << QVideoFrame::Format_RGB32
 			<< QVideoFrame::Format_YUYV
-			<< QVideoFrame::Format_RGB24;
+			<< QVideoFrame::Format_RGB24
+			<< QVideoFrame::Format_UYVY
+			<< QVideoFrame::Format_NV12
+			<< QVideoFrame::Format_Y8
+			<< QVideoFrame::Format_Y16;
             //<< QVideoFrame::Format_ARGB32_Premultiplied
             //<< QVideoFrame::Format_RGB565
             //<< QVideoFrame::Format_RGB555
@@ -87,13 +95,10 @@ bool FrameGrabber::present(const QVideoFrame &frame)
 
     QVariant ft = frame.metaData("timestamp");
 	if (ft.isValid() ) {
-		if ( timestampOffsetEstimators.size() < 30) {
-			// Use median of first N frames to estimate the offset
-			timestampOffsetEstimators.emplace_back( t - ft.toInt() );
-			std::sort(timestampOffsetEstimators.begin(), timestampOffsetEstimators.end());
-			timestampOffset = timestampOffsetEstimators[ 0.5*(timestampOffsetEstimators.size()-1) ];
-		}
-		t = ft.toInt() + timestampOffset;
+		t = clockModel.update(t, ft.toLongLong());
+		gPerformanceMonitor.setStatistic(clockDriftIdx, clockModel.driftPpm());
+		gPerformanceMonitor.setStatistic(clockJitterIdx, clockModel.jitterMs());
+		gPerformanceMonitor.setStatistic(clockOutliersIdx, clockModel.outlierCount());
 	}
 
     if (!frame.isValid())
@@ -101,19 +106,44 @@ bool FrameGrabber::present(const QVideoFrame &frame)
 
     QVideoFrame copy(frame);
     Mat cvFrame;
+    pool->attach(cvFrame);
 
 	copy.map(QAbstractVideoBuffer::ReadOnly);
     bool success = false;
     switch (frame.pixelFormat()) {
         case QVideoFrame::Format_Jpeg:
+            if (!decodeWorkers.empty()) {
+                success = enqueue(copy, t);
+                copy.unmap();
+                if (success)
+                    watchdog->start(timeoutMs);
+                else
+                    gPerformanceMonitor.account(pmIdx);
+                return success;
+            }
             success = jpeg2bmp(copy, cvFrame);
             break;
         case QVideoFrame::Format_RGB32:
             success = rgb32_2bmp(copy, cvFrame);
             break;
+        case QVideoFrame::Format_RGB24:
+            success = rgb24_2bmp(copy, cvFrame);
+            break;
         case QVideoFrame::Format_YUYV:
 			success = yuyv_2bmp(copy, cvFrame);
 			break;
+		case QVideoFrame::Format_UYVY:
+			success = uyvy_2bmp(copy, cvFrame);
+			break;
+		case QVideoFrame::Format_NV12:
+			success = nv12_2bmp(copy, cvFrame);
+			break;
+		case QVideoFrame::Format_Y8:
+			success = y8_2bmp(copy, cvFrame);
+			break;
+		case QVideoFrame::Format_Y16:
+			success = y16_2bmp(copy, cvFrame);
+			break;
 		default:
 			qWarning() << "Unknown pixel format:" << frame.pixelFormat();
             break;
@@ -134,10 +164,72 @@ void FrameGrabber::setColorCode(int code)
     this->code = code;
 }
 
-bool FrameGrabber::jpeg2bmp(const QVideoFrame &in, cv::Mat &cvFrame)
+void FrameGrabber::setY16Bits(int bits)
+{
+    y16Bits = bits > 0 ? qBound(8, bits, 16) : 0;
+}
+
+void FrameGrabber::setDecodeSize(QSize size)
 {
-    unsigned char *frame = const_cast<unsigned char*>(in.bits());
-    int len = in.mappedBytes();
+    if (size == decodeSize)
+        return;
+    decodeSize = size;
+    if (decodeSize.isValid() && !decodeSize.isEmpty())
+        qInfo() << id << "Decoding at the smallest scale covering" << decodeSize;
+    else
+        qInfo() << id << "Decoding at full resolution";
+}
+
+JpegDecoder::JpegDecoder()
+#ifdef TURBOJPEG
+    : yuvBuffer(NULL),
+      yuvBufferSize(0)
+#endif
+{
+#ifdef TURBOJPEG
+    tjh = tjInitDecompress();
+    scalingFactors = tjGetScalingFactors(&nScalingFactors);
+#endif
+}
+
+JpegDecoder::~JpegDecoder()
+{
+#ifdef TURBOJPEG
+    tjDestroy(tjh);
+    delete[] yuvBuffer;
+#endif
+}
+
+#ifdef TURBOJPEG
+void JpegDecoder::scaledSize(const int &width, const int &height, const QSize &decodeSize, int &scaledWidth, int &scaledHeight)
+{
+    scaledWidth = width;
+    scaledHeight = height;
+    if (!decodeSize.isValid() || decodeSize.isEmpty() || !scalingFactors)
+        return;
+
+    // Pick the smallest IDCT scaling that still covers the requested size so
+    // downstream resizing never has to upsample
+    for (int i=0; i<nScalingFactors; i++) {
+        const tjscalingfactor &sf = scalingFactors[i];
+        if (sf.num > sf.denom)
+            continue;
+        int w = TJSCALED(width, sf);
+        int h = TJSCALED(height, sf);
+        if (w < decodeSize.width() || h < decodeSize.height())
+            continue;
+        if (w*h < scaledWidth*scaledHeight) {
+            scaledWidth = w;
+            scaledHeight = h;
+        }
+    }
+}
+#endif
+
+bool JpegDecoder::decode(const unsigned char *data, const int &len, const int &code, const QSize &decodeSize, FramePool *pool, cv::Mat &cvFrame)
+{
+    unsigned char *frame = const_cast<unsigned char*>(data);
+    pool->attach(cvFrame);
 
 #ifdef TURBOJPEG
     int width, height, subsamp, res;
@@ -148,45 +240,234 @@ bool FrameGrabber::jpeg2bmp(const QVideoFrame &in, cv::Mat &cvFrame)
         return false;
     }
 
-    long unsigned int bufSize = tjBufSizeYUV(width, height, subsamp);
+    int scaledWidth, scaledHeight;
+    scaledSize(width, height, decodeSize, scaledWidth, scaledHeight);
+    width = scaledWidth;
+    height = scaledHeight;
+
+    if (code == CV_8UC1) {
+        /* Grayscale requested: let libjpeg-turbo write the luma straight into
+         * the output frame. Chroma is never decoded and there's no
+         * intermediate YUV pass to copy the Y plane out of.
+         */
+        cvFrame.create(height, width, CV_8UC1);
+        res = tjDecompress2( tjh, frame, len, cvFrame.data, width, (int) cvFrame.step, height, TJPF_GRAY, 0);
+        if (res < 0)
+        {
+            qWarning() << QString("Frame drop; failed to decompress: ").append(tjGetErrorStr());
+            return false;
+        }
+        return true;
+    }
+
+    // The YUV buffer is scratch only; nothing downstream ever references it
+    long unsigned int bufSize = tjBufSizeYUV2(width, 4, height, subsamp);
     if (bufSize != yuvBufferSize)
     {
         //qInfo() << "YUV buffer size changed";
         yuvBufferSize = bufSize;
-        delete yuvBuffer;
+        delete[] yuvBuffer;
         yuvBuffer = new unsigned char[yuvBufferSize];
     }
 
-    res = tjDecompressToYUV( tjh, frame, len, yuvBuffer, 0);
+    // Scaled decoding happens in the DCT domain, so we only pay for the pixels we keep
+    res = tjDecompressToYUV2( tjh, frame, len, yuvBuffer, width, 4, height, 0);
     if (res < 0)
     {
         qWarning() << QString("Frame drop; failed to decompress: ").append(tjGetErrorStr());
         return false;
     }
 
-	cvFrame = Mat(height, width, code);
-    int decode = code == CV_8UC3 ? TJPF_BGR : TJPF_GRAY;
-    res = tjDecodeYUV(tjh, yuvBuffer, 4, subsamp, cvFrame.data, width, 0, height, decode, 0);
+	cvFrame.create(height, width, CV_8UC3);
+    res = tjDecodeYUV(tjh, yuvBuffer, 4, subsamp, cvFrame.data, width, (int) cvFrame.step, height, TJPF_BGR, 0);
     if (res < 0)
     {
         qWarning() << QString("Frame drop; failed to decode: ").append(tjGetErrorStr());
         return false;
     }
 #else
-    std::vector<char> data(frame, frame+len);
-    if (code == CV_8U)
-        cvFrame = imdecode(Mat(data), CV_LOAD_IMAGE_GRAYSCALE);
-    else
-        cvFrame = imdecode(Mat(data), CV_LOAD_IMAGE_COLOR);
+    // The reduced modes need the native size, which we only know from previous frames
+    int reduction = 1;
+    if (decodeSize.isValid() && !decodeSize.isEmpty() && nativeSize.area() > 0)
+        while (reduction < 8
+               && nativeSize.width / (2*reduction) >= decodeSize.width()
+               && nativeSize.height / (2*reduction) >= decodeSize.height() )
+            reduction *= 2;
+
+    int flags;
+    switch (reduction) {
+        case 2:
+            flags = code == CV_8U ? IMREAD_REDUCED_GRAYSCALE_2 : IMREAD_REDUCED_COLOR_2;
+            break;
+        case 4:
+            flags = code == CV_8U ? IMREAD_REDUCED_GRAYSCALE_4 : IMREAD_REDUCED_COLOR_4;
+            break;
+        case 8:
+            flags = code == CV_8U ? IMREAD_REDUCED_GRAYSCALE_8 : IMREAD_REDUCED_COLOR_8;
+            break;
+        default:
+            flags = code == CV_8U ? CV_LOAD_IMAGE_GRAYSCALE : CV_LOAD_IMAGE_COLOR;
+            break;
+    }
+
+    cvFrame = imdecode(Mat(1, len, CV_8U, frame), flags);
+    nativeSize = Size(reduction*cvFrame.cols, reduction*cvFrame.rows);
 #endif
 
     return true;
 }
 
+bool FrameGrabber::jpeg2bmp(const QVideoFrame &in, cv::Mat &cvFrame)
+{
+    QElapsedTimer elapsed;
+    elapsed.start();
+    bool success = jpegDecoder.decode(in.bits(), in.mappedBytes(), code, decodeSize, pool, cvFrame);
+    decodeTimeMs = 0.9*decodeTimeMs + 0.1*1.0e-6*elapsed.nsecsElapsed();
+    gPerformanceMonitor.setStatistic(decodeTimeIdx, decodeTimeMs);
+    return success;
+}
+
+void FrameGrabber::setDecodeThreads(int n)
+{
+    stopDecodeWorkers();
+    if (n <= 0)
+        return;
+
+    // Bound the latency we are willing to buffer; beyond that we drop
+    maxDecodeQueueSize = 2*n;
+    stopDecoding = false;
+    for (int i=0; i<n; i++) {
+        DecodeWorker *worker = new DecodeWorker(this);
+        worker->start(QThread::TimeCriticalPriority);
+        decodeWorkers.push_back(worker);
+    }
+    qInfo() << id << "Decoding with" << n << "threads";
+}
+
+void FrameGrabber::stopDecodeWorkers()
+{
+    if (decodeWorkers.empty())
+        return;
+
+    decodeMutex.lock();
+    stopDecoding = true;
+    decodeCondition.wakeAll();
+    decodeMutex.unlock();
+    for (auto w = decodeWorkers.begin(); w != decodeWorkers.end(); w++) {
+        (*w)->wait();
+        delete *w;
+    }
+    decodeWorkers.clear();
+
+    // Whatever was still pending is lost; restart the sequence
+    decodeMutex.lock();
+    while (!decodeQueue.empty()) {
+        spareBytes.push_back( std::move(decodeQueue.front().bytes) );
+        decodeQueue.pop_front();
+    }
+    nextSeq = 0;
+    decodeMutex.unlock();
+    reorderMutex.lock();
+    reorderBuffer.clear();
+    nextEmitSeq = 0;
+    reorderMutex.unlock();
+    gPerformanceMonitor.setStatistic(decodeQueueIdx, 0);
+}
+
+bool FrameGrabber::enqueue(const QVideoFrame &in, const Timestamp &t)
+{
+    QMutexLocker locker(&decodeMutex);
+    if (decodeQueue.size() >= maxDecodeQueueSize)
+        return false;
+
+    DecodeJob job;
+    job.seq = nextSeq++;
+    job.t = t;
+    job.code = code;
+    job.decodeSize = decodeSize;
+    if (!spareBytes.empty()) {
+        job.bytes = std::move(spareBytes.back());
+        spareBytes.pop_back();
+    }
+    job.bytes.assign(in.bits(), in.bits() + in.mappedBytes());
+    decodeQueue.push_back( std::move(job) );
+    gPerformanceMonitor.setStatistic(decodeQueueIdx, decodeQueue.size());
+    decodeCondition.wakeOne();
+    return true;
+}
+
+void FrameGrabber::decodeLoop(JpegDecoder &decoder)
+{
+    QElapsedTimer elapsed;
+    for (;;) {
+        decodeMutex.lock();
+        while (decodeQueue.empty() && !stopDecoding)
+            decodeCondition.wait(&decodeMutex);
+        if (stopDecoding) {
+            decodeMutex.unlock();
+            return;
+        }
+        DecodeJob job = std::move(decodeQueue.front());
+        decodeQueue.pop_front();
+        gPerformanceMonitor.setStatistic(decodeQueueIdx, decodeQueue.size());
+        decodeMutex.unlock();
+
+        Mat cvFrame;
+        elapsed.start();
+        if (!decoder.decode(job.bytes.data(), (int) job.bytes.size(), job.code, job.decodeSize, pool, cvFrame))
+            cvFrame = Mat();
+        double elapsedMs = 1.0e-6*elapsed.nsecsElapsed();
+
+        decodeMutex.lock();
+        spareBytes.push_back( std::move(job.bytes) );
+        decodeMutex.unlock();
+
+        deliver(job.seq, job.t, cvFrame, elapsedMs);
+    }
+}
+
+void FrameGrabber::deliver(const quint64 &seq, const Timestamp &t, const cv::Mat &cvFrame, const double &elapsedMs)
+{
+    QMutexLocker locker(&reorderMutex);
+    decodeTimeMs = 0.9*decodeTimeMs + 0.1*elapsedMs;
+    gPerformanceMonitor.setStatistic(decodeTimeIdx, decodeTimeMs);
+
+    reorderBuffer[seq] = std::make_pair(t, cvFrame);
+    // Emitting while holding the lock keeps the queued events in capture order
+    for (auto r = reorderBuffer.begin(); r != reorderBuffer.end() && r->first == nextEmitSeq; r = reorderBuffer.erase(r)) {
+        nextEmitSeq++;
+        if (r->second.second.empty())
+            gPerformanceMonitor.account(pmIdx);
+        else
+            emit newFrame(r->second.first, r->second.second);
+    }
+}
+
+void DecodeWorker::run()
+{
+    grabber->decodeLoop(decoder);
+}
+
+bool FrameGrabber::wrap(const QVideoFrame &in, const int &rows, const int &type, cv::Mat &wrapped)
+{
+    /* Note that this only wraps the mapped data, which doesn't outlive
+     * present(); every converter below must write to a new frame.
+     * why abs? Some cameras seem to report some negative frame sizes for DirectShow; I'm looking at you Grasshopper!
+     */
+    int cols = abs(in.width());
+    size_t step = in.bytesPerLine() > 0 ? in.bytesPerLine() : cols * CV_ELEM_SIZE(type);
+    // some of the cheaper cameras tend to mess up the data for the first frames
+    if ( rows * step > (size_t) in.mappedBytes() || cols * CV_ELEM_SIZE(type) > step)
+        return false;
+    wrapped = Mat(rows, cols, type, (void*) in.bits(), step);
+    return true;
+}
+
 bool FrameGrabber::rgb32_2bmp(const QVideoFrame &in, cv::Mat &cvFrame)
 {
-    // why abs? Some cameras seem to report some negative frame sizes for DirectShow; I'm looking at you Grasshopper!
-    Mat rgba = Mat(abs(in.height()), abs(in.width()), CV_8UC4, (void*) in.bits());
+    Mat rgba;
+    if (!wrap(in, abs(in.height()), CV_8UC4, rgba))
+        return false;
     if (code == CV_8UC3)
         cvtColor(rgba, cvFrame, CV_BGRA2BGR);
     else
@@ -194,17 +475,91 @@ bool FrameGrabber::rgb32_2bmp(const QVideoFrame &in, cv::Mat &cvFrame)
     return true;
 }
 
+bool FrameGrabber::rgb24_2bmp(const QVideoFrame &in, cv::Mat &cvFrame)
+{
+    Mat rgb;
+    if (!wrap(in, abs(in.height()), CV_8UC3, rgb))
+        return false;
+    if (code == CV_8UC3)
+        cvtColor(rgb, cvFrame, CV_RGB2BGR);
+    else
+        cvtColor(rgb, cvFrame, CV_RGB2GRAY);
+    return true;
+}
+
 bool FrameGrabber::yuyv_2bmp(const QVideoFrame &in, cv::Mat &cvFrame)
 {
-	// some of the cheaper cameras tend to mess up the data for the first frames
-	if (abs(in.height()) * abs(in.width()) * 2 > in.mappedBytes())
-			return false;
-	Mat yuyv = Mat(abs(in.height()), abs(in.width()), CV_8UC2, (void*) in.bits());
+	Mat yuyv;
+	if (!wrap(in, abs(in.height()), CV_8UC2, yuyv))
+		return false;
 	if (code == CV_8UC3)
 		cvtColor(yuyv, cvFrame, CV_YUV2BGR_YUYV);
 	else
-		cvtColor(yuyv, cvFrame, CV_YUV2GRAY_YUYV);
+		extractChannel(yuyv, cvFrame, 0); // luma is every other byte; plain copy, no conversion
     return true;
 }
 
-//TODO: add support for other frame formats
+bool FrameGrabber::uyvy_2bmp(const QVideoFrame &in, cv::Mat &cvFrame)
+{
+	Mat uyvy;
+	if (!wrap(in, abs(in.height()), CV_8UC2, uyvy))
+		return false;
+	if (code == CV_8UC3)
+		cvtColor(uyvy, cvFrame, CV_YUV2BGR_UYVY);
+	else
+		extractChannel(uyvy, cvFrame, 1);
+	return true;
+}
+
+bool FrameGrabber::nv12_2bmp(const QVideoFrame &in, cv::Mat &cvFrame)
+{
+	// Y plane followed by the interleaved half resolution UV plane, same stride
+	int rows = abs(in.height());
+	Mat nv12;
+	if (!wrap(in, rows + rows/2, CV_8UC1, nv12))
+		return false;
+	if (code == CV_8UC3)
+		cvtColor(nv12, cvFrame, CV_YUV2BGR_NV12);
+	else
+		nv12.rowRange(0, rows).copyTo(cvFrame);
+	return true;
+}
+
+bool FrameGrabber::y8_2bmp(const QVideoFrame &in, cv::Mat &cvFrame)
+{
+	Mat y8;
+	if (!wrap(in, abs(in.height()), CV_8UC1, y8))
+		return false;
+	if (code == CV_8UC3)
+		cvtColor(y8, cvFrame, CV_GRAY2BGR);
+	else
+		y8.copyTo(cvFrame);
+	return true;
+}
+
+bool FrameGrabber::y16_2bmp(const QVideoFrame &in, cv::Mat &cvFrame)
+{
+	Mat y16;
+	if (!wrap(in, abs(in.height()), CV_16UC1, y16))
+		return false;
+
+	// Sensors deliver their 10 or 12 bits in the low bits; map them to the full 8 bit range
+	int bits = y16Bits;
+	if (bits <= 0) {
+		double maxValue;
+		minMaxLoc(y16, NULL, &maxValue);
+		while (y16DetectedBits < 16 && maxValue >= (1 << y16DetectedBits))
+			y16DetectedBits++;
+		bits = y16DetectedBits;
+	}
+	double scale = 255.0 / ( (1 << bits) - 1 );
+
+	if (code == CV_8UC3) {
+		Mat y8;
+		pool->attach(y8);
+		y16.convertTo(y8, CV_8U, scale);
+		cvtColor(y8, cvFrame, CV_GRAY2BGR);
+	} else
+		y16.convertTo(cvFrame, CV_8U, scale);
+	return true;
+}
@@ -7,6 +7,11 @@
 #include <QThread>
 #include <QTimer>
 #include <QDebug>
+#include <QMutex>
+#include <QWaitCondition>
+
+#include <deque>
+#include <map>
 
 #include <opencv/cv.hpp>
 
@@ -15,6 +20,42 @@
 #endif
 
 #include "utils.h"
+#include "FramePool.h"
+#include "ClockModel.h"
+
+// JPEG decoding state; one per decoding thread
+class JpegDecoder
+{
+public:
+    JpegDecoder();
+    ~JpegDecoder();
+    bool decode(const unsigned char *frame, const int &len, const int &code, const QSize &decodeSize, FramePool *pool, cv::Mat &cvFrame);
+
+private:
+#ifdef TURBOJPEG
+    tjhandle tjh;
+    unsigned char* yuvBuffer;
+    long unsigned int yuvBufferSize;
+    tjscalingfactor *scalingFactors;
+    int nScalingFactors;
+    void scaledSize(const int &width, const int &height, const QSize &decodeSize, int &scaledWidth, int &scaledHeight);
+#else
+    cv::Size nativeSize;
+#endif
+};
+
+class FrameGrabber;
+
+class DecodeWorker : public QThread
+{
+public:
+    DecodeWorker(FrameGrabber *grabber) : grabber(grabber) {}
+    JpegDecoder decoder;
+protected:
+    void run() override;
+private:
+    FrameGrabber *grabber;
+};
 
 class FrameGrabber : public QAbstractVideoSurface
 {
@@ -31,24 +72,70 @@ signals:
 public slots:
     bool present(const QVideoFrame &frame);
     void setColorCode(int code);
+    void setDecodeSize(QSize size);
+    void setDecodeThreads(int n);
+    // Significant bits of Y16 frames (e.g., 10 or 12 for most sensors); 0 detects them
+    void setY16Bits(int bits);
 
 private:
+    friend class DecodeWorker;
     QTimer *watchdog;
     int timeoutMs;
-	Timestamp timestampOffset;
-	std::vector<Timestamp> timestampOffsetEstimators;
-#ifdef TURBOJPEG
-    tjhandle tjh;
-#endif
+	ClockModel clockModel;
+	unsigned int clockDriftIdx;
+	unsigned int clockJitterIdx;
+	unsigned int clockOutliersIdx;
     QString id;
     int code;
-    unsigned char* yuvBuffer;
-    long unsigned int yuvBufferSize;
+    // Smallest frame size we must deliver; invalid means full resolution
+    QSize decodeSize;
+    JpegDecoder jpegDecoder;
+    bool wrap(const QVideoFrame &in, const int &rows, const int &type, cv::Mat &wrapped);
     bool jpeg2bmp(const QVideoFrame &in, cv::Mat &cvFrame);
     bool rgb32_2bmp(const QVideoFrame &in, cv::Mat &cvFrame);
+    bool rgb24_2bmp(const QVideoFrame &in, cv::Mat &cvFrame);
     bool yuyv_2bmp(const QVideoFrame &in, cv::Mat &cvFrame);
+    bool uyvy_2bmp(const QVideoFrame &in, cv::Mat &cvFrame);
+    bool nv12_2bmp(const QVideoFrame &in, cv::Mat &cvFrame);
+    bool y8_2bmp(const QVideoFrame &in, cv::Mat &cvFrame);
+    bool y16_2bmp(const QVideoFrame &in, cv::Mat &cvFrame);
+    int y16Bits;
+    int y16DetectedBits; // only grows, so the brightness doesn't flicker
 
     unsigned int pmIdx;
+    FramePool *pool;
+
+    /* Optional asynchronous JPEG decoding: present() only copies the
+     * compressed data; the workers decode and the results are emitted in
+     * capture order.
+     */
+    struct DecodeJob {
+        quint64 seq;
+        Timestamp t;
+        int code;
+        QSize decodeSize;
+        std::vector<unsigned char> bytes;
+    };
+    std::vector<DecodeWorker*> decodeWorkers;
+    QMutex decodeMutex;
+    QWaitCondition decodeCondition;
+    std::deque<DecodeJob> decodeQueue;
+    std::vector< std::vector<unsigned char> > spareBytes;
+    unsigned int maxDecodeQueueSize;
+    bool stopDecoding;
+    quint64 nextSeq;
+
+    QMutex reorderMutex;
+    std::map<quint64, std::pair<Timestamp, cv::Mat> > reorderBuffer;
+    quint64 nextEmitSeq;
+    double decodeTimeMs;
+    unsigned int decodeQueueIdx;
+    unsigned int decodeTimeIdx;
+
+    bool enqueue(const QVideoFrame &in, const Timestamp &t);
+    void decodeLoop(JpegDecoder &decoder);
+    void deliver(const quint64 &seq, const Timestamp &t, const cv::Mat &cvFrame, const double &elapsedMs);
+    void stopDecodeWorkers();
 };
 
 #endif // FRAMEGRABBER_H
@@ -0,0 +1,98 @@
+#include "FramePool.h"
+
+#include <QMap>
+
+#include "utils.h"
+
+using namespace std;
+using namespace cv;
+
+FramePool* FramePool::get(const QString &id)
+{
+    static QMutex registryMutex;
+    static QMap<QString, FramePool*> registry;
+
+    QMutexLocker locker(&registryMutex);
+    if (!registry.contains(id))
+        registry[id] = new FramePool(id);
+    return registry[id];
+}
+
+FramePool::FramePool(const QString &id) :
+    id(id),
+    maxPerSize(16)
+{
+    hitsIdx = gPerformanceMonitor.enrolStatistic(id, "Frame Pool Hits");
+    missesIdx = gPerformanceMonitor.enrolStatistic(id, "Frame Pool Misses");
+}
+
+FramePool::~FramePool()
+{
+    for (auto a = available.begin(); a != available.end(); a++)
+        for (auto u = a->second.begin(); u != a->second.end(); u++) {
+            fastFree((*u)->origdata);
+            delete *u;
+        }
+    available.clear();
+}
+
+UMatData* FramePool::allocate(int dims, const int* sizes, int type, void* data, size_t* step, int flags, UMatUsageFlags usageFlags) const
+{
+    // User data is just wrapped; nothing for us to recycle
+    if (data)
+        return Mat::getStdAllocator()->allocate(dims, sizes, type, data, step, flags, usageFlags);
+
+    size_t total = CV_ELEM_SIZE(type);
+    for (int i = dims-1; i >= 0; i--) {
+        if (step)
+            step[i] = total;
+        total *= sizes[i];
+    }
+
+    {
+        QMutexLocker locker(&mutex);
+        auto a = available.find(total);
+        if (a != available.end() && !a->second.empty()) {
+            UMatData *u = a->second.back();
+            a->second.pop_back();
+            gPerformanceMonitor.incrementStatistic(hitsIdx);
+            return u;
+        }
+        gPerformanceMonitor.incrementStatistic(missesIdx);
+    }
+
+    UMatData *u = new UMatData(this);
+    u->data = u->origdata = (uchar*) fastMalloc(total);
+    u->size = total;
+    return u;
+}
+
+bool FramePool::allocate(UMatData* data, int accessflags, UMatUsageFlags usageFlags) const
+{
+    Q_UNUSED(accessflags);
+    Q_UNUSED(usageFlags);
+    return data != NULL;
+}
+
+void FramePool::deallocate(UMatData* u) const
+{
+    if (!u)
+        return;
+    CV_Assert(u->urefcount == 0);
+    CV_Assert(u->refcount == 0);
+
+    {
+        QMutexLocker locker(&mutex);
+        vector<UMatData*> &bucket = available[u->size];
+        if (bucket.size() < maxPerSize) {
+            if (bucket.capacity() < maxPerSize)
+                bucket.reserve(maxPerSize);
+            u->data = u->origdata;
+            bucket.push_back(u);
+            return;
+        }
+    }
+
+    fastFree(u->origdata);
+    delete u;
+}
@@ -0,0 +1,47 @@
+#ifndef FRAMEPOOL_H
+#define FRAMEPOOL_H
+
+#include <map>
+#include <vector>
+
+#include <QString>
+#include <QMutex>
+
+#include <opencv2/core.hpp>
+
+/* Per camera pool of frame buffers.
+ *
+ * Mats created through the pool (see attach()) return their buffer to it once
+ * the last reference is dropped -- regardless of the thread -- so in steady
+ * state no frame storage is allocated at all. Buffers are keyed by their size
+ * in bytes.
+ *
+ * Pools live throughout the whole program life time: frames may still be
+ * queued somewhere (e.g., the recorder) after their camera is gone.
+ */
+class FramePool : public cv::MatAllocator
+{
+public:
+    static FramePool* get(const QString &id);
+
+    // Releases m; its next create() (also implicit ones, e.g., as output of cvtColor) draws from the pool
+    void attach(cv::Mat &m) { m.release(); m.allocator = this; }
+
+    cv::UMatData* allocate(int dims, const int* sizes, int type, void* data, size_t* step, int flags, cv::UMatUsageFlags usageFlags) const override;
+    bool allocate(cv::UMatData* data, int accessflags, cv::UMatUsageFlags usageFlags) const override;
+    void deallocate(cv::UMatData* data) const override;
+
+private:
+    explicit FramePool(const QString &id);
+    ~FramePool();
+
+    QString id;
+    mutable QMutex mutex;
+    mutable std::map<size_t, std::vector<cv::UMatData*> > available;
+    unsigned int maxPerSize;
+
+    unsigned int hitsIdx;
+    unsigned int missesIdx;
+};
+
+#endif // FRAMEPOOL_H
@@ -9,7 +9,8 @@ GazeEstimation::GazeEstimation(QObject *parent)
       isCalibrating(false),
 	  gazeEstimationMethod(NULL),
 	  lastOverlayIdx(0),
-      settings(NULL)
+      settings(NULL),
+      output("Gaze Estimation")
 {
     availableGazeEstimationMethods.push_back( new PolyFit(PolyFit::POLY_1_X_Y_XY_XX_YY_XYY_YXX_XXYY) );
     availableGazeEstimationMethods.push_back( new PolyFit(PolyFit::POLY_1_X_Y_XY) );
@@ -316,7 +317,7 @@ void GazeEstimation::estimate(DataTuple dataTuple)
 
     drawGazeEstimationInfo(dataTuple);
 
-    emit gazeEstimationDone(dataTuple);
+    output.publish(dataTuple);
 }
 
 void GazeEstimation::printAccuracyInfo(const cv::Mat &errors, const QString &which, const double &diagonal, float &mu, float &sigma)
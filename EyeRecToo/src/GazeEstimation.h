@@ -184,9 +184,9 @@ public:
     ~GazeEstimation();
     QSettings *settings;
     std::vector<GazeEstimationMethod*> availableGazeEstimationMethods;
+    Channel<DataTuple> output;
 
 signals:
-    void gazeEstimationDone(DataTuple dataTuple);
     void calibrationFinished(bool status, QString msg);
 
 public slots:
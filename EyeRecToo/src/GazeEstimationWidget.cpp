@@ -15,7 +15,9 @@ GazeEstimationWidget::GazeEstimationWidget(QString id, QWidget *parent) :
     lastStatus(false),
 	calibrationRequested(false),
 	isRecording(false),
-    ui(new Ui::GazeEstimationWidget)
+    ui(new Ui::GazeEstimationWidget),
+	samplingSubscription(NULL),
+	markerCollectionSubscription(NULL)
 {
     ui->setupUi(this);
 
@@ -45,11 +47,6 @@ GazeEstimationWidget::GazeEstimationWidget(QString id, QWidget *parent) :
     connect(this, SIGNAL(setCalibrating(bool)),
             gazeEstimation, SLOT(setCalibrating(bool)) );
 
-    connect(this, SIGNAL(inDataTuple(DataTuple)),
-            gazeEstimation, SLOT(estimate(DataTuple)) );
-    connect(gazeEstimation, SIGNAL(gazeEstimationDone(DataTuple)),
-            this, SIGNAL(outDataTuple(DataTuple)) );
-
     connect(gazeEstimation, SIGNAL(calibrationFinished(bool,QString)),
             this, SLOT(updateStatus(bool,QString)) );
 
@@ -173,6 +170,21 @@ GazeEstimationWidget::~GazeEstimationWidget()
     gazeEstimationThread->wait();
 }
 
+void GazeEstimationWidget::setInput(Channel<DataTuple> *input)
+{
+	GazeEstimation *ge = gazeEstimation;
+	input->subscribe("Gaze Estimation", gazeEstimation,
+		[ge](const DataTuple &dataTuple) { ge->estimate(dataTuple); } );
+
+	// Enabled on demand
+	samplingSubscription = input->subscribe("Calibration Sampling", this,
+		[this](const DataTuple &dataTuple) { newSample(dataTuple); },
+		ChannelSubscription::LOSSLESS, false);
+	markerCollectionSubscription = input->subscribe("Marker Collection", this,
+		[this](const DataTuple &dataTuple) { collectMarkerTuple(dataTuple); },
+		ChannelSubscription::LOSSLESS, false);
+}
+
 /*
  * Sampling from mouse selection
 */
@@ -186,7 +198,8 @@ void GazeEstimationWidget::startSampling(Timestamp timestamp, QPoint calibration
                      calibrationPoint.x() / double(previewSize.width()),
                      calibrationPoint.y() / double(previewSize.height())
                     );
-    connect(this, SIGNAL(inDataTuple(DataTuple)), this, SLOT(newSample(DataTuple)) );
+    if (samplingSubscription)
+        samplingSubscription->setEnabled(true);
     QTimer::singleShot(cfg.samplingTimeMs, this, SLOT(finishSampling()));
 }
 template <typename T>
@@ -205,8 +218,8 @@ double median(T begin, T end) {
 void GazeEstimationWidget::finishSampling()
 {
     isSampling = false;
-    disconnect(this, SIGNAL(inDataTuple(DataTuple)),
-               this, SLOT(newSample(DataTuple)) );
+    if (samplingSubscription)
+        samplingSubscription->setEnabled(false);
 
     if (samples.size() == 0)
         return;
@@ -238,8 +251,8 @@ void GazeEstimationWidget::finishSampling()
 void GazeEstimationWidget::newSample(DataTuple dataTuple)
 {
     dataTuple.field.collectionMarker.center =  cv::Point3f(
-                        dataTuple.field.input.cols*fieldRatio.x,
-                        dataTuple.field.input.rows*fieldRatio.y,
+                        dataTuple.field.width*fieldRatio.x,
+                        dataTuple.field.height*fieldRatio.y,
                         0 );
     samples.push_back(dataTuple);
 }
@@ -369,7 +382,8 @@ void GazeEstimationWidget::toggleMarkerCollection()
 void GazeEstimationWidget::enableMarkerCollection()
 {
 	if (isCollecting) {
-		connect(this, SIGNAL(inDataTuple(DataTuple)), this, SLOT(collectMarkerTuple(DataTuple)) );
+		if (markerCollectionSubscription)
+			markerCollectionSubscription->setEnabled(true);
 		collectedSound.play();
 		isMarkerCollectionEnabled = true;
 	}
@@ -377,7 +391,8 @@ void GazeEstimationWidget::enableMarkerCollection()
 
 void GazeEstimationWidget::disableMarkerCollection()
 {
-	disconnect(this, SIGNAL(inDataTuple(DataTuple)), this, SLOT(collectMarkerTuple(DataTuple)) );
+	if (markerCollectionSubscription)
+		markerCollectionSubscription->setEnabled(false);
 	if (isCollecting)
 		collectedSound.play();
 	isMarkerCollectionEnabled = false;
@@ -26,9 +26,10 @@ public:
 	explicit GazeEstimationWidget(QString id, QWidget *parent = 0);
     ~GazeEstimationWidget();
 
+	void setInput(Channel<DataTuple> *input);
+	Channel<DataTuple>* output() const { return &gazeEstimation->output; }
+
 signals:
-    void inDataTuple(DataTuple dataTuple);
-    void outDataTuple(DataTuple dataTuple);
     void newClick(Timestamp timestamp, QPoint calibrationPoint, QSize previewSize);
     void resetCalibration(CollectionTuple::TupleType);
     void newTuple(CollectionTuple tuple);
@@ -49,6 +50,8 @@ private:
     QThread *gazeEstimationThread;
     Ui::GazeEstimationWidget *ui;
     GazeEstimation *gazeEstimation;
+	ChannelSubscription *samplingSubscription;
+	ChannelSubscription *markerCollectionSubscription;
     GazeEstimationConfig cfg;
     QSettings *settings;
 
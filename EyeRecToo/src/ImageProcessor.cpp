@@ -7,9 +7,19 @@ ImageProcessor::ImageProcessor(QString id, Type type, QObject *parent)
       eyeProcessor(NULL),
       fieldProcessor(NULL),
       eyeProcessorUI(NULL),
-      fieldProcessorUI(NULL)
+      fieldProcessorUI(NULL),
+	  eyeData(NULL),
+	  fieldData(NULL),
+	  notified(false),
+	  coalesced(0)
 {
     Q_UNUSED(parent)
+	pmIdx = gPerformanceMonitor.enrol(id, "Processor Mailbox");
+	coalescedIdx = gPerformanceMonitor.enrolStatistic(id, "Coalesced Frames");
+	if (type == Eye)
+		eyeData = new Channel<EyeData>(id);
+	else
+		fieldData = new Channel<FieldData>(id);
 }
 
 ImageProcessor::~ImageProcessor()
@@ -20,12 +30,14 @@ ImageProcessor::~ImageProcessor()
                 eyeProcessor->deleteLater();
             if (eyeProcessorUI)
             eyeProcessorUI->deleteLater();
+            delete eyeData;
             break;
         case Field:
             if (fieldProcessor)
                 fieldProcessor->deleteLater();
             if (fieldProcessorUI)
                 fieldProcessorUI->deleteLater();
+            delete fieldData;
             break;
         default:
             break;
@@ -46,7 +58,12 @@ void ImageProcessor::create()
 					eyeProcessor, SLOT(updateConfig()) );
 
                 connect(eyeProcessor, SIGNAL(newData(EyeData)),
-						this, SIGNAL(newData(EyeData)) );
+						this, SLOT(publish(EyeData)) );
+				connect(eyeProcessor, SIGNAL(newInputSize(QSize)),
+						this, SIGNAL(newInputSize(QSize)) );
+				connect(eyeProcessor, SIGNAL(newQueueSize(int)),
+						this, SLOT(setQueueSize(int)) );
+				eyeProcessor->updateConfig(); // announce the initial input and queue sizes
 
                 // GUI
                 connect(this, SIGNAL(showOptions(QPoint)),
@@ -71,7 +88,12 @@ void ImageProcessor::create()
 					fieldProcessor, SLOT(updateConfig()) );
 
                 connect(fieldProcessor, SIGNAL(newData(FieldData)),
-                        this, SIGNAL(newData(FieldData)) );
+                        this, SLOT(publish(FieldData)) );
+				connect(fieldProcessor, SIGNAL(newInputSize(QSize)),
+						this, SIGNAL(newInputSize(QSize)) );
+				connect(fieldProcessor, SIGNAL(newQueueSize(int)),
+						this, SLOT(setQueueSize(int)) );
+				fieldProcessor->updateConfig(); // announce the initial input and queue sizes
 
                 connect(this, SIGNAL(showOptions(QPoint)),
                         fieldProcessorUI, SLOT(showOptions(QPoint)) );
@@ -84,3 +106,44 @@ void ImageProcessor::create()
                 break;
         }
 }
+
+void ImageProcessor::enqueue(Timestamp t, const cv::Mat &frame)
+{
+	Frame f = { t, frame };
+	if ( !mailbox.push(f) ) {
+		gPerformanceMonitor.account(pmIdx);
+		emit consumed();
+		return;
+	}
+
+	// Only this thread reports the counter; it only ever grows
+	unsigned long c = mailbox.coalesced();
+	if (c != coalesced) {
+		gPerformanceMonitor.incrementStatistic(coalescedIdx, c - coalesced);
+		coalesced = c;
+	}
+
+	// At most one pending dispatch, no matter how many frames arrive meanwhile
+	if ( !notified.exchange(true) )
+		QMetaObject::invokeMethod(this, "dispatch", Qt::QueuedConnection);
+}
+
+void ImageProcessor::dispatch()
+{
+	notified = false;
+
+	Frame f;
+	if ( !mailbox.pop(f) )
+		return;
+	emit process(f.t, f.frame);
+	emit consumed();
+
+	// Let other events (e.g., config updates) through between frames
+	if ( !mailbox.empty() && !notified.exchange(true) )
+		QMetaObject::invokeMethod(this, "dispatch", Qt::QueuedConnection);
+}
+
+void ImageProcessor::setQueueSize(int size)
+{
+	mailbox.setCapacity( size > 0 ? size : 0 );
+}
@@ -1,11 +1,15 @@
 #ifndef IMAGEPROCESSOR_H
 #define IMAGEPROCESSOR_H
 
+#include <atomic>
+
 #include <QObject>
 
 #include "EyeImageProcessor.h"
 #include "FieldImageProcessor.h"
 
+#include "Channel.h"
+#include "Mailbox.h"
 #include "utils.h"
 
 class ImageProcessor : public QObject
@@ -20,16 +24,29 @@ public:
 	EyeImageProcessorUI* eyeProcessorUI;
 	FieldImageProcessorUI* fieldProcessorUI;
 
+	// Processing results; only the one matching the type exists
+	Channel<EyeData> *eyeData;
+	Channel<FieldData> *fieldData;
+
 signals:
     void process(Timestamp t, cv::Mat frame);
     void showOptions(QPoint pos);
     void newROI(QPointF sROI, QPointF eROI);
-    void newData(EyeData data);
-    void newData(FieldData data);
+    void newInputSize(QSize size);
 	void updateConfig();
+	// A frame given to enqueue() was processed or rejected
+	void consumed();
 
 public slots:
     void create();
+	void setQueueSize(int size);
+	// Producer side of the camera -> processor hop; runs directly in the camera thread
+	void enqueue(Timestamp t, const cv::Mat &frame);
+
+private slots:
+	void dispatch();
+	void publish(const EyeData &data) { eyeData->publish(data); }
+	void publish(const FieldData &data) { fieldData->publish(data); }
 
 private:
     QString id;
@@ -37,6 +54,16 @@ private:
 	EyeImageProcessor* eyeProcessor;
 	FieldImageProcessor* fieldProcessor;
 
+	struct Frame {
+		Timestamp t;
+		cv::Mat frame;
+	};
+	Mailbox<Frame> mailbox;
+	std::atomic<bool> notified;
+	unsigned long coalesced;
+	unsigned int pmIdx;
+	unsigned int coalescedIdx;
+
 };
 
 #endif // IMAGEPROCESSOR_H
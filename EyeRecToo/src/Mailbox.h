@@ -0,0 +1,180 @@
+#ifndef MAILBOX_H
+#define MAILBOX_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+/* Lock-free single producer / single consumer latest value (triple buffer).
+ *
+ * A newer value overwrites one that wasn't consumed yet; neither side ever
+ * waits for the other.
+ */
+template<class T>
+class TripleBuffer
+{
+public:
+    TripleBuffer() : back(0), front(1), middle(2) {}
+
+    // Producer side; returns true if an unconsumed value was overwritten
+    bool push(const T &value)
+    {
+        buffers[back] = value;
+        unsigned int previous = middle.exchange(back | DIRTY, std::memory_order_acq_rel);
+        back = previous & ~DIRTY;
+        return (previous & DIRTY) != 0;
+    }
+
+    // Consumer side
+    bool pop(T &value)
+    {
+        if ( !pending() )
+            return false;
+        front = middle.exchange(front, std::memory_order_acq_rel) & ~DIRTY;
+        value = buffers[front];
+        buffers[front] = T(); // don't hold on to the payload
+        return true;
+    }
+
+    bool pending() const { return (middle.load(std::memory_order_acquire) & DIRTY) != 0; }
+
+private:
+    static const unsigned int DIRTY = 4;
+
+    // back is owned by the producer, front by the consumer
+    T buffers[3];
+    unsigned int back;
+    unsigned int front;
+    std::atomic<unsigned int> middle;
+};
+
+/* Lock-free single producer / single consumer bounded FIFO (ring buffer).
+ *
+ * Values pushed while limit values are queued are rejected; the limit may be
+ * anything up to the preallocated size.
+ */
+template<class T>
+class BoundedFifo
+{
+public:
+    explicit BoundedFifo(size_t maxSize) :
+        ring(maxSize > 0 ? maxSize : 1),
+        head(0),
+        tail(0)
+    {}
+
+    // Producer side; returns false if the value was rejected
+    bool push(const T &value) { return push(value, ring.size()); }
+    bool push(const T &value, size_t limit)
+    {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (t - head.load(std::memory_order_acquire) >= std::min<size_t>(limit, ring.size()))
+            return false;
+        ring[t % ring.size()] = value;
+        tail.store(t+1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side
+    bool pop(T &value)
+    {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (h == tail.load(std::memory_order_acquire))
+            return false;
+        T &slot = ring[h % ring.size()];
+        value = slot;
+        slot = T(); // don't hold on to the payload
+        head.store(h+1, std::memory_order_release);
+        return true;
+    }
+
+    bool empty() const { return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire); }
+    // Approximate from other threads
+    size_t size() const { return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire); }
+    size_t maxSize() const { return ring.size(); }
+
+private:
+    std::vector<T> ring;
+    std::atomic<size_t> head;
+    std::atomic<size_t> tail;
+};
+
+/* Lock-free single producer / single consumer mailbox.
+ *
+ * Capacity 0 keeps only the latest value: a newer value overwrites one that
+ * wasn't consumed yet (counted as coalesced). This is implemented as a triple
+ * buffer, so neither side ever waits for the other.
+ *
+ * Capacity N > 0 is a bounded FIFO; values pushed while it's full are
+ * rejected (counted as dropped).
+ *
+ * The capacity may be changed by the consumer at any time. Values queued in
+ * the FIFO are still delivered after switching to capacity 0, before the
+ * latest value. A latest value left over after switching to a FIFO is older
+ * than anything queued since, so it's discarded (counted as coalesced) to
+ * keep the values in order.
+ */
+template<class T>
+class Mailbox
+{
+public:
+    explicit Mailbox(unsigned int maxCapacity = 64) :
+        fifo(maxCapacity),
+        capacity(0),
+        coalescedCount(0),
+        droppedCount(0)
+    {}
+
+    // Producer side; returns false if the value was rejected
+    bool push(const T &value)
+    {
+        unsigned int c = capacity.load(std::memory_order_acquire);
+        if (c == 0) {
+            if (latest.push(value))
+                coalescedCount.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+
+        if ( !fifo.push(value, c) ) {
+            droppedCount.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        return true;
+    }
+
+    // Consumer side
+    bool pop(T &value)
+    {
+        if (capacity.load(std::memory_order_acquire) > 0 && latest.pop(value)) {
+            value = T();
+            coalescedCount.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        if (fifo.pop(value))
+            return true;
+        return latest.pop(value);
+    }
+
+    bool empty() const
+    {
+        return fifo.empty() && !latest.pending();
+    }
+
+    void setCapacity(unsigned int c) { capacity.store( c <= fifo.maxSize() ? c : (unsigned int) fifo.maxSize(), std::memory_order_release); }
+    unsigned int getCapacity() const { return capacity.load(std::memory_order_relaxed); }
+    unsigned long coalesced() const { return coalescedCount.load(std::memory_order_relaxed); }
+    unsigned long dropped() const { return droppedCount.load(std::memory_order_relaxed); }
+    // Approximate from other threads
+    size_t size() const { return fifo.size() + (latest.pending() ? 1 : 0); }
+
+private:
+    TripleBuffer<T> latest;
+    BoundedFifo<T> fifo;
+
+    std::atomic<unsigned int> capacity;
+    std::atomic<unsigned long> coalescedCount;
+    std::atomic<unsigned long> droppedCount;
+};
+
+#endif // MAILBOX_H
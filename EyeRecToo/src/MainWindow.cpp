@@ -71,14 +71,23 @@ MainWindow::MainWindow(QWidget *parent) :
 
     /*
      * Synchronizer
+     *
+     * Runs in its own thread together with the network stream, so the timing
+     * critical path doesn't depend on the GUI event loop
      */
+    synchronizerThread = new QThread();
+    synchronizerThread->setObjectName("Synchronizer");
+    synchronizerThread->start();
+    synchronizerThread->setPriority( (QThread::Priority) cfg.synchronizerPriority );
     synchronizer = new Synchronizer();
-    connect(lEyeWidget,  SIGNAL(newData(EyeData)),
-            synchronizer, SLOT(newLeftEyeData(EyeData)), Qt::QueuedConnection);
-    connect(rEyeWidget,  SIGNAL(newData(EyeData)),
-            synchronizer, SLOT(newRightEyeData(EyeData)) );
-    connect(fieldWidget, SIGNAL(newData(FieldData)),
-            synchronizer, SLOT(newFieldData(FieldData)) );
+    synchronizer->moveToThread(synchronizerThread);
+	Synchronizer *sync = synchronizer;
+	lEyeWidget->eyeData()->subscribe("Synchronizer", synchronizer,
+		[sync](const EyeData &data) { sync->newLeftEyeData(data); } );
+	rEyeWidget->eyeData()->subscribe("Synchronizer", synchronizer,
+		[sync](const EyeData &data) { sync->newRightEyeData(data); } );
+	fieldWidget->fieldData()->subscribe("Synchronizer", synchronizer,
+		[sync](const FieldData &data) { sync->newFieldData(data); } );
 
     /*
      * Synchronous elements
@@ -86,13 +95,13 @@ MainWindow::MainWindow(QWidget *parent) :
 	gazeEstimationWidget = new GazeEstimationWidget("Gaze Estimation Widget");
 	gazeEstimationWidget->setDefaults( false );
 	setupWidget(gazeEstimationWidget, settings, ui->gazeEstimation);
-    connect(synchronizer, SIGNAL(newData(DataTuple)),
-            gazeEstimationWidget, SIGNAL(inDataTuple(DataTuple)) );
+	gazeEstimationWidget->setInput(&synchronizer->output);
     connect(fieldWidget, SIGNAL(newClick(Timestamp,QPoint,QSize)),
             gazeEstimationWidget, SIGNAL(newClick(Timestamp,QPoint,QSize)) );
 
-    connect(gazeEstimationWidget, SIGNAL(outDataTuple(DataTuple)),
-            fieldWidget, SLOT(preview(DataTuple)) );
+	CameraWidget *fw = fieldWidget;
+	fieldPreviewSubscription = gazeEstimationWidget->output()->subscribe("Field Preview", fieldWidget,
+		[fw](const DataTuple &data) { fw->preview(data); }, ChannelSubscription::LATEST );
 
     journalThread = new QThread();
     journalThread->setObjectName("Journal");
@@ -101,11 +110,18 @@ MainWindow::MainWindow(QWidget *parent) :
     journal = new DataRecorderThread("Journal", DataTuple().header());
     journal->moveToThread(journalThread);
     QMetaObject::invokeMethod(journal, "create");
+	// Enabled while recording
+	DataRecorderThread *j = journal;
+	journalSubscription = gazeEstimationWidget->output()->subscribe("Journal", journal,
+		[j](const DataTuple &data) { if (j->dataRecorder) j->dataRecorder->newData(data); },
+		ChannelSubscription::LOSSLESS, false );
 
     networkStream = new NetworkStream();
-
-    networkStream->start(2002);
-    connect(gazeEstimationWidget, SIGNAL(outDataTuple(DataTuple)), networkStream, SLOT(push(DataTuple)) );
+    networkStream->moveToThread(synchronizerThread);
+    QMetaObject::invokeMethod(networkStream, "start", Q_ARG(int, 2002));
+	NetworkStream *ns = networkStream;
+	gazeEstimationWidget->output()->subscribe("Network Stream", networkStream,
+		[ns](const DataTuple &data) { ns->push(data); } );
 
 	performanceMonitorWidget = new PerformanceMonitorWidget("Performance Monitor Widget");
 	performanceMonitorWidget->setDefaults( false );
@@ -251,6 +267,8 @@ void MainWindow::closeEvent(QCloseEvent *event)
         synchronizer->deleteLater();
         synchronizer = NULL;
     }
+    synchronizerThread->quit();
+    synchronizerThread->wait();
 
     if (settings) {
         settings->deleteLater();
@@ -375,16 +393,14 @@ void MainWindow::on_recordingToggle_clicked()
         ui->changePwdButton->setEnabled(false);
         emit startRecording();
         ui->recordingToggle->setText("Finish");
-        connect(gazeEstimationWidget, SIGNAL(outDataTuple(DataTuple)),
-                journal, SIGNAL(newData(DataTuple)) );
+        journalSubscription->setEnabled(true);
         QTimer::singleShot(500, this, SLOT(effectiveRecordingStart())); // TODO: right now we wait a predefined amount of time; ideally, we should wait for an ack from everyone involved
         ui->recordingToggle->setEnabled(false);
         recStartSound.play();
     } else {
         qInfo() << "Record stopped (Subject:" << ui->subject->text() << ")";
         emit stopRecording();
-        disconnect(gazeEstimationWidget, SIGNAL(outDataTuple(DataTuple)),
-                journal, SIGNAL(newData(DataTuple)) );
+        journalSubscription->setEnabled(false);
 		storeMetaDataTail();
 		killTimer(elapsedTimeUpdateTimer);
         elapsedTime.invalidate();
@@ -466,15 +482,13 @@ void MainWindow::on_performanceMonitor_clicked()
 
 void MainWindow::freezeCameraImages()
 {
-	disconnect(gazeEstimationWidget, SIGNAL(outDataTuple(DataTuple)),
-		fieldWidget, SLOT(preview(DataTuple)) );
+	fieldPreviewSubscription->setEnabled(false);
 	// TODO: freeze eye cameras
 }
 
 void MainWindow::unfreezeCameraImages()
 {
-	connect(gazeEstimationWidget, SIGNAL(outDataTuple(DataTuple)),
-		fieldWidget, SLOT(preview(DataTuple)) );
+	fieldPreviewSubscription->setEnabled(true);
 	// TODO: unfreeze eye cameras
 }
 
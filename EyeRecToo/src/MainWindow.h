@@ -35,22 +35,26 @@ class MainWindowConfig
 {
 public:
     MainWindowConfig() :
-	workingDirectory("./")
+	workingDirectory("./"),
+	synchronizerPriority(QThread::HighPriority)
     {}
 
     void save(QSettings *settings)
     {
         settings->sync();
 		settings->setValue("workingDirectory", workingDirectory);
+		settings->setValue("synchronizerPriority", synchronizerPriority);
     }
 
     void load(QSettings *settings)
     {
         settings->sync();
         set(settings, "workingDirectory", workingDirectory);
+		set(settings, "synchronizerPriority", synchronizerPriority);
 	}
 
 	QString workingDirectory;
+	int synchronizerPriority; // QThread::Priority of the synchronization and output thread
 
 };
 
@@ -78,11 +82,14 @@ private:
     CameraWidget * lEyeWidget;
     CameraWidget * rEyeWidget;
     CameraWidget *fieldWidget;
+    QThread *synchronizerThread;
     Synchronizer *synchronizer;
     GazeEstimationWidget *gazeEstimationWidget;
     QThread *journalThread;
     DataRecorderThread *journal;
     NetworkStream * networkStream;
+	ChannelSubscription *fieldPreviewSubscription;
+	ChannelSubscription *journalSubscription;
     LogWidget *logWidget;
 	PerformanceMonitorWidget *performanceMonitorWidget;
 	CommandManager commandManager;
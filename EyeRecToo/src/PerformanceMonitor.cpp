@@ -15,17 +15,33 @@
  *
  * 3) enrolled.size() == droppedFrameCount.size()
  *
+ * 4) Enrollment may happen from any thread (e.g., processors and camera
+ * threads set themselves up concurrently), so it is serialized by a mutex.
+ * We reserve some room so late enrollments don't move the counters under a
+ * writer.
+ *
+ * 5) Statistics are updated from several threads (e.g., a frame pool from
+ * both the camera and processor threads), so they are atomic; their slots
+ * are preallocated and published by the statistics count.
+ *
  */
 
 PerformanceMonitor::PerformanceMonitor() :
 	frameDropEnabled(false),
     delayedFrameCount(0)
 {
-
+	enrolled.reserve(256);
+	droppedFrameCount.reserve(256);
+	enrolledStatistics.reserve(MaxStatistics);
+	for (unsigned int i = 0; i <= MaxStatistics; i++)
+		statistics[i].store(0);
+	statisticsCount.store(0);
+	realTime.store(true);
 }
 
 unsigned int PerformanceMonitor::enrol(const QString &id, const QString &stage)
 {
+    QMutexLocker locker(&enrolMutex);
     unsigned int idx = 0;
     QString name = id + " " + stage;
 
@@ -41,9 +57,49 @@ unsigned int PerformanceMonitor::enrol(const QString &id, const QString &stage)
     return idx;
 }
 
+unsigned int PerformanceMonitor::enrolStatistic(const QString &id, const QString &name)
+{
+	QMutexLocker locker(&enrolMutex);
+	unsigned int idx = 0;
+	QString fullName = id + " " + name;
+
+	for (idx = 0; idx < enrolledStatistics.size(); idx++)
+		if (enrolledStatistics[idx] == fullName)
+			return idx;
+
+	if (idx >= MaxStatistics) {
+		qWarning() << "Too many statistics; not displaying" << fullName;
+		return MaxStatistics;
+	}
+
+	enrolledStatistics.push_back( fullName );
+	statisticsCount.store( (unsigned int) enrolledStatistics.size(), std::memory_order_release);
+
+	return idx;
+}
+
+void PerformanceMonitor::incrementStatistic(const unsigned int &idx, const double &value)
+{
+	double current = statistics[idx].load(std::memory_order_relaxed);
+	while ( !statistics[idx].compare_exchange_weak(current, current + value, std::memory_order_relaxed) )
+		;
+}
+
+QString PerformanceMonitor::getEnrolledStatistic(const unsigned int &idx)
+{
+	QMutexLocker locker(&enrolMutex);
+	return idx < enrolledStatistics.size() ? enrolledStatistics[idx] : QString();
+}
+
+void PerformanceMonitor::resetStatistics()
+{
+	for (unsigned int i = 0; i <= MaxStatistics; i++)
+		statistics[i].store(0, std::memory_order_relaxed);
+}
+
 bool PerformanceMonitor::shouldDrop(const unsigned int &idx, const int &delay, const int &maxDelay)
 {
-	if (delay > maxDelay) {
+	if (delay > maxDelay && isRealTime()) {
         droppedFrameCount[idx]++;
         return frameDropEnabled;
     }
@@ -60,5 +116,7 @@ void PerformanceMonitor::report()
     qInfo() << "Performance Report:";
     for (unsigned int i = 0; i < enrolled.size(); i++)
         qInfo() << enrolled[i] << "dropped" << droppedFrameCount[i] << "frames.";
+	for (unsigned int i = 0; i < enrolledStatisticsCount(); i++)
+		qInfo() << getEnrolledStatistic(i) << ":" << getStatistic(i);
 }
 
@@ -1,8 +1,10 @@
 #ifndef PERFORMANCEMONITOR_H
 #define PERFORMANCEMONITOR_H
 
+#include <atomic>
 #include <vector>
 
+#include <QMutex>
 #include <QString>
 
 class PerformanceMonitor
@@ -17,13 +19,36 @@ public:
     QString getEnrolled(const unsigned int &idx) { return idx < enrolled.size() ? enrolled[idx] : QString(); }
 	unsigned int enrolledCount() { return (unsigned int) enrolled.size(); }
 	void setFrameDrop(bool enabled = true) { frameDropEnabled = enabled; }
+	// Off while frames aren't paced in real time (e.g., a replay as fast as
+	// possible); their lateness is meaningless then, so nothing is dropped for it
+	void setRealTime(bool enabled = true) { realTime.store(enabled, std::memory_order_relaxed); }
+	bool isRealTime() const { return realTime.load(std::memory_order_relaxed); }
+
+	// Free-form statistics (e.g., buffer pool hits), displayed next to the dropped frames.
+	// Any thread may enrol and update them.
+	unsigned int enrolStatistic(const QString &id, const QString &name);
+	void setStatistic(const unsigned int &idx, const double &value) { statistics[idx].store(value, std::memory_order_relaxed); }
+	void incrementStatistic(const unsigned int &idx, const double &value = 1);
+	double getStatistic(const unsigned int &idx) { return statistics[idx].load(std::memory_order_relaxed); }
+	QString getEnrolledStatistic(const unsigned int &idx);
+	unsigned int enrolledStatisticsCount() { return statisticsCount.load(std::memory_order_acquire); }
+	void resetStatistics();
 
 	void report();
 
 private:
     std::vector<QString> enrolled;
+    QMutex enrolMutex;
+
+    // Preallocated, so slots never move under a writer; the extra one takes
+    // enrollments beyond the maximum and isn't displayed
+    enum { MaxStatistics = 256 };
+    std::atomic<double> statistics[MaxStatistics+1];
+    std::atomic<unsigned int> statisticsCount;
+    std::vector<QString> enrolledStatistics;
     unsigned int delayedFrameCount;
 	bool frameDropEnabled;
+	std::atomic<bool> realTime;
 };
 
 #endif // PERFORMANCEMONITOR_H
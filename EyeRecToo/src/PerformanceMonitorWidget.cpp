@@ -7,6 +7,7 @@ PerformanceMonitorWidget::PerformanceMonitorWidget(QString id, QWidget *parent)
 	ERWidget(id, parent),
     updateTimeMs(250),
     formLayout(NULL),
+	statisticsLayout(NULL),
     ui(new Ui::PerformanceMonitorWidget)
 {
     ui->setupUi(this);
@@ -19,6 +20,7 @@ PerformanceMonitorWidget::PerformanceMonitorWidget(QString id, QWidget *parent)
 PerformanceMonitorWidget::~PerformanceMonitorWidget()
 {
     clear();
+	clearStatistics();
     delete ui;
 }
 
@@ -51,6 +53,35 @@ void PerformanceMonitorWidget::fill()
     ui->droppedFramesBox->setLayout(formLayout);
 }
 
+void PerformanceMonitorWidget::clearStatistics()
+{
+	if (statisticsLayout) {
+		delete statisticsLayout;
+		statisticsLayout = NULL;
+	}
+	for (auto e = enrolledStatistics.begin(); e != enrolledStatistics.end(); e++) {
+		delete e->first;
+		delete e->second;
+	}
+	enrolledStatistics.clear();
+}
+
+void PerformanceMonitorWidget::fillStatistics()
+{
+	clearStatistics();
+
+	statisticsLayout = new QFormLayout();
+	for( unsigned int i=0; i<gPerformanceMonitor.enrolledStatisticsCount(); i++ ) {
+		pair<QLabel*, QLabel*> formPair  = {
+			new QLabel( gPerformanceMonitor.getEnrolledStatistic(i) ),
+			new QLabel( QString::number(gPerformanceMonitor.getStatistic(i)) )
+		};
+		enrolledStatistics.push_back( formPair );
+		statisticsLayout->addRow( formPair.first, formPair.second );
+	}
+	ui->statisticsBox->setLayout(statisticsLayout);
+}
+
 void PerformanceMonitorWidget::update()
 {
     if (gPerformanceMonitor.enrolledCount() != enrolled.size())
@@ -58,6 +89,11 @@ void PerformanceMonitorWidget::update()
     else
         for( unsigned int i=0; i<gPerformanceMonitor.enrolledCount(); i++ )
             enrolled[i].second->setText( QString::number(gPerformanceMonitor.droppedFrameCount[i]) );
+	if (gPerformanceMonitor.enrolledStatisticsCount() != enrolledStatistics.size())
+		fillStatistics();
+	else
+		for( unsigned int i=0; i<gPerformanceMonitor.enrolledStatisticsCount(); i++ )
+			enrolledStatistics[i].second->setText( QString::number(gPerformanceMonitor.getStatistic(i)) );
     QTimer::singleShot(updateTimeMs, this, SLOT(update()) );
 }
 
@@ -67,4 +103,5 @@ void PerformanceMonitorWidget::on_resetCounters_clicked()
     qInfo() << "Resetting counters:";
     for (auto c = gPerformanceMonitor.droppedFrameCount.begin(); c != gPerformanceMonitor.droppedFrameCount.end(); c++)
         *c = 0;
+	gPerformanceMonitor.resetStatistics();
 }
@@ -29,10 +29,14 @@ private:
 
     QFormLayout *formLayout;
     std::vector< std::pair<QLabel*, QLabel*> > enrolled;
+	QFormLayout *statisticsLayout;
+	std::vector< std::pair<QLabel*, QLabel*> > enrolledStatistics;
     unsigned int updateTimeMs;
 
     void clear();
     void fill();
+	void clearStatistics();
+	void fillStatistics();
 
 private slots:
     void update();
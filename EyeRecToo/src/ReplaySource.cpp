@@ -0,0 +1,247 @@
+#include "ReplaySource.h"
+
+#include <QFile>
+#include <QTextStream>
+
+using namespace std;
+using namespace cv;
+
+QMutex ReplaySource::epochMutex;
+int ReplaySource::activeCount = 0;
+Timestamp ReplaySource::epochWall = 0;
+Timestamp ReplaySource::epochRecorded = 0;
+QList<ReplaySource*> ReplaySource::lockstep;
+ReplaySource *ReplaySource::inFlight = NULL;
+
+ReplaySource::ReplaySource(QString id, int code, QObject *parent) :
+    QObject(parent),
+    id(id),
+    code(code),
+    idx(0),
+    speed(1),
+    framerate(0),
+    started(false),
+    wallStart(0),
+    recordedStart(0)
+{
+    timer = new QTimer(this);
+    timer->setSingleShot(true);
+    timer->setTimerType(Qt::PreciseTimer);
+    connect(timer, SIGNAL(timeout()), this, SLOT(next()) );
+    pool = FramePool::get(id);
+}
+
+ReplaySource::~ReplaySource()
+{
+    timer->stop();
+    leave();
+    if (started) {
+        QMutexLocker locker(&epochMutex);
+        activeCount--;
+    }
+}
+
+bool ReplaySource::open(const QString &fileName)
+{
+    this->fileName = fileName;
+
+    // Recorder output: <name>.mp4 and <name>Data.tsv
+    QFileInfo info(fileName);
+    QString dataFileName = info.absolutePath() + "/" + info.completeBaseName() + "Data.tsv";
+    if (!loadTimestamps(dataFileName))
+        return false;
+
+    if (!capture.open(fileName.toStdString())) {
+        qWarning() << id << "Could not open" << fileName;
+        return false;
+    }
+
+    size_t frameCount = (size_t) capture.get(CAP_PROP_FRAME_COUNT);
+    if (frameCount > 0 && frameCount != timestamps.size()) {
+        qWarning() << id << fileName << "has" << frameCount << "frames but" << timestamps.size() << "timestamps; replaying the shortest.";
+        timestamps.resize( std::min<size_t>(frameCount, timestamps.size()) );
+    }
+
+    framerate = capture.get(CAP_PROP_FPS);
+    if (framerate <= 0 && timestamps.size() > 1)
+        framerate = 1.0e3 * (timestamps.size() - 1) / (timestamps.back() - timestamps.front());
+    return !timestamps.empty();
+}
+
+bool ReplaySource::loadTimestamps(const QString &dataFileName)
+{
+    QFile file(dataFileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        qWarning() << id << "Could not open" << dataFileName;
+        return false;
+    }
+
+    QTextStream stream(&file);
+    QStringList header = stream.readLine().split(gDataSeparator);
+    int column = header.indexOf("timestamp");
+    if (column < 0) {
+        qWarning() << id << "No timestamp column in" << dataFileName;
+        return false;
+    }
+
+    timestamps.clear();
+    while (!stream.atEnd()) {
+        QStringList fields = stream.readLine().split(gDataSeparator);
+        if (fields.size() <= column)
+            continue;
+        bool ok;
+        Timestamp t = fields[column].toLongLong(&ok);
+        if (ok)
+            timestamps.push_back(t);
+    }
+    return true;
+}
+
+void ReplaySource::start()
+{
+    if (timestamps.empty())
+        return;
+
+    {
+        // Replays from the same session share the anchor so their timestamps stay comparable
+        QMutexLocker locker(&epochMutex);
+        idx = 0;
+        if (activeCount == 0) {
+            epochWall = gTimer.elapsed();
+            epochRecorded = timestamps.front();
+        }
+        if (!started)
+            activeCount++;
+        wallStart = epochWall;
+        recordedStart = epochRecorded;
+    }
+    started = true;
+
+    if (speed > 0)
+        schedule();
+    else
+        join();
+}
+
+void ReplaySource::setSpeed(double speed)
+{
+    double previous = this->speed;
+    this->speed = speed;
+    if (!started || idx >= timestamps.size())
+        return;
+    rebase(previous);
+    if (speed > 0) {
+        leave();
+        schedule();
+    } else {
+        timer->stop();
+        join();
+    }
+}
+
+void ReplaySource::rebase(double previousSpeed)
+{
+    // Continue from the recorded time reached so far at the previous speed
+    Timestamp now = gTimer.elapsed();
+    if (previousSpeed > 0)
+        recordedStart += (now - wallStart) * previousSpeed;
+    else
+        recordedStart = timestamps[idx];
+    wallStart = now;
+}
+
+void ReplaySource::setColorCode(int code)
+{
+    this->code = code;
+}
+
+void ReplaySource::acknowledge()
+{
+    QMutexLocker locker(&epochMutex);
+    if (inFlight != this)
+        return;
+    inFlight = NULL;
+    advance();
+}
+
+void ReplaySource::join()
+{
+    QMutexLocker locker(&epochMutex);
+    if (!lockstep.contains(this))
+        lockstep.append(this);
+    gPerformanceMonitor.setRealTime(false);
+    advance();
+}
+
+void ReplaySource::leave()
+{
+    QMutexLocker locker(&epochMutex);
+    if (!lockstep.removeOne(this))
+        return;
+    if (inFlight == this)
+        inFlight = NULL;
+    gPerformanceMonitor.setRealTime(lockstep.isEmpty());
+    advance();
+}
+
+void ReplaySource::advance()
+{
+    // Called with the epoch mutex held. The replay with the earliest recorded
+    // frame goes next; indexes only change in next(), which runs for the replay
+    // in flight alone, before it's acknowledged under this mutex
+    if (inFlight)
+        return;
+    ReplaySource *earliest = NULL;
+    for (int i=0; i<lockstep.size(); i++) {
+        ReplaySource *r = lockstep[i];
+        if (r->idx >= r->timestamps.size())
+            continue;
+        if (!earliest || r->timestamps[r->idx] < earliest->timestamps[earliest->idx])
+            earliest = r;
+    }
+    if (!earliest)
+        return;
+    inFlight = earliest;
+    QMetaObject::invokeMethod(earliest, "next", Qt::QueuedConnection);
+}
+
+Timestamp ReplaySource::paced(const Timestamp &recorded) const
+{
+    if (speed > 0)
+        return wallStart + (recorded - recordedStart) / speed;
+    // Unpaced replays stamp through the shared anchor so their streams stay comparable
+    return epochWall + (recorded - epochRecorded);
+}
+
+void ReplaySource::schedule()
+{
+    if (idx >= timestamps.size())
+        return;
+    timer->start( (int) std::max<Timestamp>(0, paced(timestamps[idx]) - gTimer.elapsed()) );
+}
+
+void ReplaySource::next()
+{
+    Mat bgr;
+    pool->attach(bgr);
+    if (idx >= timestamps.size() || !capture.read(bgr)) {
+        qInfo() << id << "Replay finished:" << fileName;
+        idx = timestamps.size();
+        leave();
+        emit finished();
+        return;
+    }
+
+    Mat frame;
+    if (code == CV_8UC1 && bgr.channels() == 3) {
+        pool->attach(frame);
+        cvtColor(bgr, frame, CV_BGR2GRAY);
+    } else
+        frame = bgr;
+
+    Timestamp t = paced(timestamps[idx]);
+    idx++;
+    emit newFrame(t, frame);
+    if (speed > 0)
+        schedule();
+}
@@ -0,0 +1,99 @@
+#ifndef REPLAYSOURCE_H
+#define REPLAYSOURCE_H
+
+#include <vector>
+
+#include <QList>
+#include <QObject>
+#include <QTimer>
+#include <QMutex>
+#include <QFileInfo>
+
+#include <opencv/cv.hpp>
+#include <opencv2/videoio.hpp>
+
+#include "utils.h"
+#include "FramePool.h"
+
+/* Replays a video recorded by the DataRecorder (e.g., LeftEye.mp4) as if it
+ * came from a camera, using the timestamps from the matching data file
+ * (e.g., LeftEyeData.tsv).
+ *
+ * Speed 1 replays in real time, N replays N times faster, and 0 replays as
+ * fast as possible. Recorded timestamps are mapped to gTimer through an
+ * anchor shared by all active replays, so eye and field recordings from the
+ * same session stay in sync:
+ *
+ *     paced = wallStart + (recorded - recordedStart) / speed
+ *
+ * Paced frames are emitted at, and stamped with, their paced time; i.e.,
+ * their timestamps live in gTimer's clock like a camera's do, so latency
+ * checks, detection budgets and synchronization work at any speed. Changing
+ * the speed rebases the anchor at the current position. At speed 1 this is
+ * the recorded timestamp plus a constant offset.
+ *
+ * As fast as possible has no pacing. All such replays advance in lockstep,
+ * one frame at a time in recorded order, and the next frame is only read
+ * once the consumer acknowledges the previous one (see acknowledge()). No
+ * frame is coalesced or dropped on the way, and the streams reach the
+ * synchronizer in the same order every run. Frames are stamped as at speed
+ * 1 from the shared anchor (epochWall + recorded - epochRecorded), so the
+ * stamps are identical every run too. They may lag or lead gTimer, so the
+ * real-time checks are suspended meanwhile (see
+ * PerformanceMonitor::setRealTime()).
+ */
+class ReplaySource : public QObject
+{
+    Q_OBJECT
+public:
+    explicit ReplaySource(QString id, int code, QObject *parent = 0);
+    ~ReplaySource();
+    bool open(const QString &fileName);
+    double fps() const { return framerate; }
+    QString description() const { return QString("Replay %1").arg(QFileInfo(fileName).fileName()); }
+
+signals:
+    void newFrame(Timestamp t, cv::Mat frame);
+    void finished();
+
+public slots:
+    void start();
+    void setSpeed(double speed);
+    void setColorCode(int code);
+    // The previous frame was consumed; advances the replays at speed 0
+    void acknowledge();
+
+private slots:
+    void next();
+
+private:
+    QString id;
+    int code;
+    QString fileName;
+    cv::VideoCapture capture;
+    std::vector<Timestamp> timestamps;
+    size_t idx;
+    double speed;
+    double framerate;
+    bool started;
+    Timestamp wallStart, recordedStart;
+    QTimer *timer;
+    FramePool *pool;
+
+    bool loadTimestamps(const QString &dataFileName);
+    Timestamp paced(const Timestamp &recorded) const;
+    void rebase(double previousSpeed);
+    void schedule();
+    void join();
+    void leave();
+
+    static QMutex epochMutex;
+    static int activeCount;
+    static Timestamp epochWall, epochRecorded;
+    // Replays at speed 0 and the one whose frame wasn't acknowledged yet
+    static QList<ReplaySource*> lockstep;
+    static ReplaySource *inFlight;
+    static void advance();
+};
+
+#endif // REPLAYSOURCE_H
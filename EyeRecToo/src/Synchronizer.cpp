@@ -1,4 +1,9 @@
 #include "Synchronizer.h"
+
+#include <chrono>
+#include <cmath>
+#include <thread>
+
 #include <opencv2/highgui.hpp>
 
 static int gDataTupleId = qRegisterMetaType<DataTuple>("DataTuple");
@@ -7,96 +12,237 @@ using namespace std;
 
 Synchronizer::Synchronizer(QObject *parent)
     : QObject(parent),
-      maxAgeMs(100),
-      safeGuardMs(5),
-      maxListSize(5),
+      output("Synchronizer"),
       updated(false),
-      lastSynchronization(0)
-{
-
-    // TODO: allow user to pick sampling rate
-    bool userSelected = false;
-    if (userSelected) {
-        // This may be dangerous and is in practice much less efficient than
-        // synchronizing one of the cameras as trigger; e.g., due to timer imprecisions
-        int userSynchronizeMs = 8;
-        timer = new QTimer(this);
-        connect(timer, SIGNAL(timeout()),
-                this, SLOT(synchronize()));
-        timer->start(userSynchronizeMs);
-    } else {
-        // Hardware-based triggers
-        // Synchronization priority: Right Eye, Left Eye, Field
-        // E.g., if no right eye is available we use left eye for synchronization and so on
-        timer = new QTimer(this);
-        connect(timer, SIGNAL(timeout()),
-                this, SLOT(updateLists()));
-        timer->start(1e3);
+      lastSynchronization(0),
+      pacer(NULL)
+{
+    settings = new QSettings(gCfgDir + "/" + "Synchronizer.ini", QSettings::IniFormat, this);
+    cfg.load(settings);
+    cfg.save(settings); // there's no UI; this lists the available options in the file
+    lEyeList.setCapacity(cfg.getHistorySize());
+    rEyeList.setCapacity(cfg.getHistorySize());
+    fieldList.setCapacity(cfg.getHistorySize());
+
+    const char *names[STREAM_COUNT] = { "Left Eye", "Right Eye", "Field" };
+    for (int i=0; i<STREAM_COUNT; i++) {
+        streams[i].p50Idx = gPerformanceMonitor.enrolStatistic("Synchronizer", QString("%1 Lateness p50 (ms)").arg(names[i]));
+        streams[i].p95Idx = gPerformanceMonitor.enrolStatistic("Synchronizer", QString("%1 Lateness p95 (ms)").arg(names[i]));
+        streams[i].timeoutsIdx = gPerformanceMonitor.enrolStatistic("Synchronizer", QString("%1 Watermark Timeouts").arg(names[i]));
     }
+    deadlineTimer = new QTimer(this);
+    deadlineTimer->setSingleShot(true);
+    deadlineTimer->setTimerType(Qt::PreciseTimer);
+    connect(deadlineTimer, SIGNAL(timeout()),
+            this, SLOT(flushPending()) );
+
+    if (cfg.outputRateHz > 0) {
+        jitterIdx = gPerformanceMonitor.enrolStatistic("Synchronizer", "Output Jitter (ms)");
+        missedIdx = gPerformanceMonitor.enrolStatistic("Synchronizer", "Missed Output Deadlines");
+        pacer = new SynchronizerPacer(this, cfg.outputRateHz);
+        pacer->setObjectName("Synchronizer Pacer");
+        pacer->start(QThread::TimeCriticalPriority);
+    }
+
+    // Hardware-based triggers
+    // Synchronization priority: Right Eye, Left Eye, Field
+    // E.g., if no right eye is available we use left eye for synchronization and so on
+    // A user selected sampling rate is handled by the pacer instead (see outputRateHz),
+    // since QTimer isn't precise enough for that
+    timer = new QTimer(this);
+    connect(timer, SIGNAL(timeout()),
+            this, SLOT(updateLists()));
+    timer->start(1e3);
 }
 
 Synchronizer::~Synchronizer()
 {
-
+    if (pacer) {
+        pacer->requestInterruption();
+        pacer->wait();
+        delete pacer;
+    }
 }
 
-void Synchronizer::newRightEyeData(EyeData eyeData)
+void Synchronizer::newRightEyeData(const EyeData &eyeData)
 {
-	rEyeList.emplace_back(eyeData);
-    if (rEyeList.size() > maxListSize)
-        rEyeList.pop_front();
+    QMutexLocker locker(&dataMutex);
+	insert(rEyeList, eyeData);
     updated = true;
+    if (pacer) // resampled at a fixed rate instead
+        return;
+    arrived(RIGHT_EYE, eyeData.timestamp);
     if (!rEyeList.empty())
         synchronize(eyeData.timestamp);
 }
 
-void Synchronizer::newLeftEyeData(EyeData eyeData)
+void Synchronizer::newLeftEyeData(const EyeData &eyeData)
 {
-	lEyeList.emplace_back(eyeData);
-    if (lEyeList.size() > maxListSize)
-        lEyeList.pop_front();
+    QMutexLocker locker(&dataMutex);
+	insert(lEyeList, eyeData);
     updated = true;
+    if (pacer) // resampled at a fixed rate instead
+        return;
+    arrived(LEFT_EYE, eyeData.timestamp);
 
     if (rEyeList.empty())
         synchronize(eyeData.timestamp);
 }
 
-void Synchronizer::newFieldData(FieldData fieldData)
+void Synchronizer::newFieldData(const FieldData &fieldData)
 {
-	fieldList.emplace_back(fieldData);
-    if (fieldList.size() > maxListSize)
-        fieldList.pop_front();
+    QMutexLocker locker(&dataMutex);
+	insert(fieldList, fieldData);
     updated = true;
+    if (pacer) // resampled at a fixed rate instead
+        return;
+    arrived(FIELD, fieldData.timestamp);
 
     if (rEyeList.empty() && lEyeList.empty())
         synchronize(fieldData.timestamp);
 }
 
 template<class T>
-T* Synchronizer::getClosestInTime(Timestamp timestamp, list<T> &dataList)
+void Synchronizer::insert(TimeSeries<T> &dataList, const T &data)
 {
-    T *closest = NULL;
-    if (dataList.empty())
-        return closest;
-
-    unsigned int minimum = UINT_MAX;
-    for (auto it = dataList.begin(); it != dataList.end(); ++it) {
-        unsigned int diff = abs( timestamp - it->timestamp);
-        if (diff < minimum) {
-            minimum = diff;
-            closest = &(*it);
+    dataList.insert(data);
+
+    // Only the two newest samples keep their frames, which covers the closest one
+    // for a new trigger; older ones are still paired for their data. Otherwise
+    // the history would hold on to a camera frame per slot
+    for (size_t i = 0; i + 2 < dataList.size(); i++)
+        dataList[i].input.release();
+}
+
+void Synchronizer::arrived(Stream stream, Timestamp timestamp)
+{
+    StreamState &s = streams[stream];
+    s.watermark = max<Timestamp>(s.watermark, timestamp);
+    s.lastArrival = gTimer.elapsed();
+    if (cfg.watermark)
+        flushPending();
+}
+
+void Synchronizer::flushPending()
+{
+    Timestamp now = gTimer.elapsed();
+
+    // Streams that went quiet don't hold tuples back
+    bool active[STREAM_COUNT];
+    for (int i=0; i<STREAM_COUNT; i++)
+        active[i] = streams[i].lastArrival > 0 && now - streams[i].lastArrival <= cfg.maxAgeMs;
+
+    for (auto p = pending.begin(); p != pending.end(); ++p)
+        for (int i=0; i<STREAM_COUNT; i++)
+            if (p->passed[i] < 0 && streams[i].watermark >= p->timestamp)
+                p->passed[i] = now - p->created;
+
+    while (!pending.empty()) {
+        const Pending &p = pending.front();
+        bool complete = true;
+        for (int i=0; i<STREAM_COUNT; i++)
+            if (active[i] && p.passed[i] < 0)
+                complete = false;
+        if (!complete && now - p.created < cfg.watermarkDeadlineMs)
+            break;
+
+        for (int i=0; i<STREAM_COUNT; i++)
+            if (active[i])
+                accountLateness( (Stream) i, p.passed[i]);
+        publishTuple(p.timestamp);
+        pending.pop_front();
+    }
+
+    if (!pending.empty())
+        deadlineTimer->start( max<Timestamp>(0, pending.front().created + cfg.watermarkDeadlineMs - now) );
+}
+
+void Synchronizer::accountLateness(Stream stream, Timestamp lateness)
+{
+    StreamState &s = streams[stream];
+    size_t bin = lateness < 0 ? s.lateness.size()-1 : min<size_t>(lateness, s.lateness.size()-2);
+    s.lateness[bin]++;
+    if (lateness < 0)
+        gPerformanceMonitor.incrementStatistic(s.timeoutsIdx);
+
+    unsigned long total = 0;
+    for (size_t i=0; i<s.lateness.size(); i++)
+        total += s.lateness[i];
+    unsigned long acc = 0;
+    double p50 = -1;
+    for (size_t i=0; i<s.lateness.size()-1; i++) {
+        acc += s.lateness[i];
+        if (p50 < 0 && acc >= 0.5*total)
+            p50 = i;
+        if (acc >= 0.95*total) {
+            gPerformanceMonitor.setStatistic(s.p95Idx, i);
+            break;
         }
     }
+    // Timeouts are at least as late as the deadline
+    if (acc < 0.95*total)
+        gPerformanceMonitor.setStatistic(s.p95Idx, cfg.watermarkDeadlineMs);
+    gPerformanceMonitor.setStatistic(s.p50Idx, p50 < 0 ? cfg.watermarkDeadlineMs : p50);
+}
 
-    if (minimum > maxAgeMs)
+template<class T>
+const T* Synchronizer::getClosestInTime(Timestamp timestamp, const TimeSeries<T> &dataList)
+{
+    if (dataList.empty())
         return NULL;
 
-    return closest;
+    // The closest is either the first sample not older than timestamp or the one before it
+    size_t idx = dataList.lowerBound(timestamp);
+    if (idx == dataList.size() || ( idx > 0 && timestamp - dataList[idx-1].timestamp < dataList[idx].timestamp - timestamp ) )
+        idx--;
+
+    if ( abs(timestamp - dataList[idx].timestamp) > (Timestamp) cfg.maxAgeMs )
+        return NULL;
+
+    return &dataList[idx];
+}
+
+EyeData Synchronizer::getEyeData(Timestamp timestamp, const TimeSeries<EyeData> &dataList)
+{
+    const EyeData *closest = getClosestInTime<EyeData>(timestamp, dataList);
+    if (!closest)
+        return EyeData();
+    if (!cfg.interpolate || closest->timestamp == timestamp)
+        return *closest;
+
+    // Interpolate the pupil between the samples around the timestamp, if both are valid
+    size_t idx = dataList.lowerBound(timestamp);
+    if (idx == 0 || idx == dataList.size())
+        return *closest;
+    const EyeData &a = dataList[idx-1];
+    const EyeData &b = dataList[idx];
+    if ( !a.validPupil || !b.validPupil || b.timestamp - a.timestamp > cfg.maxAgeMs )
+        return *closest;
+
+    float w = (timestamp - a.timestamp) / (float) (b.timestamp - a.timestamp);
+    EyeData eyeData = *closest; // input, ROI, etc. come from the closest sample
+    eyeData.timestamp = timestamp;
+    eyeData.pupil.center = (1-w)*a.pupil.center + w*b.pupil.center;
+    eyeData.pupil.size.width = (1-w)*a.pupil.size.width + w*b.pupil.size.width;
+    eyeData.pupil.size.height = (1-w)*a.pupil.size.height + w*b.pupil.size.height;
+    eyeData.pupil.confidence = (1-w)*a.pupil.confidence + w*b.pupil.confidence;
+    // The ellipse angle is periodic in 180 degrees
+    float da = b.pupil.angle - a.pupil.angle;
+    if (da > 90)
+        da -= 180;
+    else if (da < -90)
+        da += 180;
+    eyeData.pupil.angle = a.pupil.angle + w*da;
+    if (eyeData.pupil.angle < 0)
+        eyeData.pupil.angle += 180;
+    else if (eyeData.pupil.angle >= 180)
+        eyeData.pupil.angle -= 180;
+    return eyeData;
 }
 
 /* Old style synchronization
 template<class T>
-Timestamp Synchronizer::getLatestTimestamp(list<T> &dataList)
+Timestamp Synchronizer::getLatestTimestamp(TimeSeries<T> &dataList)
 {
     // maintain monotonicity of the synchronized signal in exchange of ignoring some information
     // this may happen because we want to synchronize the data based on their timestamps (i.e., how close in time they are)
@@ -134,37 +280,120 @@ void Synchronizer::synchronize(Timestamp timestamp)
         return;
 
     // Make sure we don't overload the thread event loop
-    if (timestamp - lastSynchronization < safeGuardMs)
+    if (timestamp - lastSynchronization < cfg.safeGuardMs)
         return;
 
     lastSynchronization = timestamp;
 
-    FieldData *field = getClosestInTime<FieldData>(timestamp, fieldList);
-    EyeData *lEye = getClosestInTime<EyeData>(timestamp, lEyeList);
-    EyeData *rEye = getClosestInTime<EyeData>(timestamp, rEyeList);
+    if (cfg.watermark) {
+        Pending p = { timestamp, gTimer.elapsed(), { -1, -1, -1 } };
+        pending.push_back(p);
+        flushPending();
+        return;
+    }
+
+    publishTuple(timestamp);
+}
+
+void Synchronizer::publishTuple(Timestamp timestamp)
+{
+    const FieldData *field = getClosestInTime<FieldData>(timestamp, fieldList);
 
     DataTuple dataTuple (
                 timestamp,
-                (lEye ? *lEye : EyeData()),
-                (rEye ? *rEye : EyeData()),
+                getEyeData(timestamp, lEyeList),
+                getEyeData(timestamp, rEyeList),
                 (field ? *field : FieldData())
                 );
 
-    emit newData(dataTuple);
+    output.publish(dataTuple);
 }
 
 template<class T>
-void Synchronizer::removeOld(list<T> &dataList)
+void Synchronizer::removeOld(TimeSeries<T> &dataList)
 {
-    if (dataList.empty())
+    // Unpaced replays may lag behind gTimer without going stale
+    if (dataList.empty() || !gPerformanceMonitor.isRealTime())
         return;
 
-    if (gTimer.elapsed() - dataList.back().timestamp > maxAgeMs)
+    if (gTimer.elapsed() - dataList.back().timestamp > cfg.maxAgeMs)
         dataList.clear();
 }
 void Synchronizer::updateLists()
 {
+    QMutexLocker locker(&dataMutex);
     removeOld(rEyeList);
     removeOld(lEyeList);
     removeOld(fieldList);
 }
+
+template<class T>
+const T* Synchronizer::getHeld(Timestamp timestamp, const TimeSeries<T> &dataList)
+{
+    // Latest sample not newer than timestamp (i.e., zero-order hold)
+    size_t idx = dataList.lowerBound(timestamp + 1);
+    if (idx == 0)
+        return NULL;
+    const T &held = dataList[idx-1];
+    if (timestamp - held.timestamp > cfg.maxAgeMs)
+        return NULL;
+    return &held;
+}
+
+void Synchronizer::resample(Timestamp timestamp)
+{
+    QMutexLocker locker(&dataMutex);
+
+    const FieldData *field = getHeld<FieldData>(timestamp, fieldList);
+    EyeData lEye, rEye;
+    if (cfg.interpolate) {
+        lEye = getEyeData(timestamp, lEyeList);
+        rEye = getEyeData(timestamp, rEyeList);
+    } else {
+        const EyeData *l = getHeld<EyeData>(timestamp, lEyeList);
+        const EyeData *r = getHeld<EyeData>(timestamp, rEyeList);
+        if (l)
+            lEye = *l;
+        if (r)
+            rEye = *r;
+    }
+
+    DataTuple dataTuple(timestamp, lEye, rEye, (field ? *field : FieldData()) );
+    locker.unlock();
+
+    output.publish(dataTuple);
+}
+
+void SynchronizerPacer::run()
+{
+    using namespace std::chrono;
+
+    // gTimer and the steady clock are both monotonic; anchor one to the other
+    // so we can sleep until absolute deadlines (no drift from relative sleeps)
+    steady_clock::time_point base = steady_clock::now();
+    qint64 baseNs = gTimer.nsecsElapsed();
+    const double periodNs = 1.0e9 / rateHz;
+
+    qint64 k = (qint64) ceil(baseNs / periodNs);
+    double jitterMs = 0;
+    while (!isInterruptionRequested()) {
+        qint64 deadlineNs = llround(k * periodNs);
+        this_thread::sleep_until(base + nanoseconds(deadlineNs - baseNs));
+
+        // Skip the slots we overslept instead of bursting through them
+        qint64 lateNs = gTimer.nsecsElapsed() - deadlineNs;
+        if (lateNs >= periodNs) {
+            qint64 missed = (qint64) (lateNs / periodNs);
+            gPerformanceMonitor.incrementStatistic(synchronizer->missedIdx, missed);
+            k += missed;
+            deadlineNs = llround(k * periodNs);
+            lateNs = gTimer.nsecsElapsed() - deadlineNs;
+        }
+        jitterMs = 0.99*jitterMs + 0.01*1.0e-6*std::abs(lateNs);
+        gPerformanceMonitor.setStatistic(synchronizer->jitterIdx, jitterMs);
+
+        // Trail real time so the streams had a chance to deliver the samples around the grid point
+        synchronizer->resample( llround(1.0e-6*deadlineNs) - (Timestamp) synchronizer->cfg.outputDelayMs );
+        k++;
+    }
+}
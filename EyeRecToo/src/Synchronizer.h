@@ -1,14 +1,21 @@
 #ifndef SYNCHRONIZER_H
 #define SYNCHRONIZER_H
 
-#include <list>
+#include <algorithm>
+#include <deque>
+#include <vector>
 
 #include <QTimer>
+#include <QThread>
+#include <QMutex>
 #include <QObject>
 #include <QSize>
+#include <QSettings>
 
+#include "Channel.h"
 #include "EyeImageProcessor.h"
 #include "FieldImageProcessor.h"
+#include "TimeSeries.h"
 
 #include "utils.h"
 
@@ -35,11 +42,85 @@ public:
     QString header() const {
         return QString("sync.timestamp") + gDataSeparator + FieldData().header("field.") + EyeData().header("left.") + EyeData().header("right.");
     }
-    QString toQString() {
+    QString toQString() const {
         return QString::number(timestamp) + gDataSeparator + field.toQString() + lEye.toQString() + rEye.toQString();
     }
 };
 
+class SynchronizerConfig
+{
+public:
+    SynchronizerConfig() :
+        maxAgeMs(100),
+        safeGuardMs(5),
+        historySize(0),
+        interpolate(false),
+        watermark(false),
+        watermarkDeadlineMs(10),
+        outputRateHz(0),
+        outputDelayMs(20)
+    {}
+
+    unsigned int maxAgeMs;
+    unsigned int safeGuardMs;
+    unsigned int historySize; // 0 to fit maxAgeMs (see getHistorySize())
+    bool interpolate;
+    bool watermark;
+    unsigned int watermarkDeadlineMs;
+    double outputRateHz; // 0 to synchronize on the camera triggers instead of a fixed rate
+    unsigned int outputDelayMs;
+
+    // Samples that can still be paired are at most maxAgeMs older than the output
+    // timestamp, or newer than it by up to the output delay; enough for cameras up
+    // to 200 Hz, faster ones need a larger historySize
+    unsigned int getHistorySize() const
+    {
+        if (historySize > 0)
+            return historySize;
+        return (maxAgeMs + std::max<unsigned int>(outputDelayMs, watermarkDeadlineMs)) * 200 / 1000 + 2;
+    }
+
+    void save(QSettings *settings)
+    {
+        settings->sync();
+        settings->setValue("maxAgeMs", maxAgeMs);
+        settings->setValue("safeGuardMs", safeGuardMs);
+        settings->setValue("historySize", historySize);
+        settings->setValue("interpolate", interpolate);
+        settings->setValue("watermark", watermark);
+        settings->setValue("watermarkDeadlineMs", watermarkDeadlineMs);
+        settings->setValue("outputRateHz", outputRateHz);
+        settings->setValue("outputDelayMs", outputDelayMs);
+    }
+
+    void load(QSettings *settings)
+    {
+        settings->sync();
+        set(settings, "maxAgeMs", maxAgeMs);
+        set(settings, "safeGuardMs", safeGuardMs);
+        set(settings, "historySize", historySize);
+        set(settings, "interpolate", interpolate);
+        set(settings, "watermark", watermark);
+        set(settings, "watermarkDeadlineMs", watermarkDeadlineMs);
+        set(settings, "outputRateHz", outputRateHz);
+        set(settings, "outputDelayMs", outputDelayMs);
+    }
+};
+
+class Synchronizer;
+
+// Fixed-rate output: wakes up on an exact grid using absolute deadlines
+class SynchronizerPacer : public QThread
+{
+public:
+    SynchronizerPacer(Synchronizer *synchronizer, double rateHz) : synchronizer(synchronizer), rateHz(rateHz) {}
+protected:
+    void run() override;
+private:
+    Synchronizer *synchronizer;
+    double rateHz;
+};
+
 class Synchronizer : public QObject
 {
     Q_OBJECT
@@ -48,34 +129,64 @@ public:
     explicit Synchronizer(QObject *parent = 0);
     ~Synchronizer();
 
-signals:
-    void newData(DataTuple dataTuple);
+    Channel<DataTuple> output;
 
 public slots:
-    void newLeftEyeData(EyeData eyeData);
-    void newRightEyeData(EyeData eyeData);
-    void newFieldData(FieldData fieldData);
+    void newLeftEyeData(const EyeData &eyeData);
+    void newRightEyeData(const EyeData &eyeData);
+    void newFieldData(const FieldData &fieldData);
     void updateLists();
 
 private:
-    unsigned int maxAgeMs;
-    unsigned int safeGuardMs;
-    unsigned int maxListSize;
-    std::list<EyeData> lEyeList;
-    std::list<EyeData> rEyeList;
-    std::list<FieldData> fieldList;
+    friend class SynchronizerPacer;
+    SynchronizerConfig cfg;
+    QSettings *settings;
+    TimeSeries<EyeData> lEyeList;
+    TimeSeries<EyeData> rEyeList;
+    TimeSeries<FieldData> fieldList;
     bool updated;
     Timestamp lastSynchronization;
 
+    // Watermark mode: a tuple waits until every active stream delivered data
+    // up to its timestamp, or until the deadline expires
+    enum Stream { LEFT_EYE = 0, RIGHT_EYE = 1, FIELD = 2, STREAM_COUNT = 3 };
+    struct StreamState {
+        Timestamp watermark = 0;
+        Timestamp lastArrival = 0;
+        std::vector<unsigned long> lateness = std::vector<unsigned long>(65, 0); // 1 ms bins; the last one counts timeouts
+        unsigned int p50Idx = 0, p95Idx = 0, timeoutsIdx = 0;
+    } streams[STREAM_COUNT];
+    struct Pending {
+        Timestamp timestamp;
+        Timestamp created;
+        Timestamp passed[STREAM_COUNT]; // ms after creation at which each stream caught up (-1 if not yet)
+    };
+    std::deque<Pending> pending;
+    QTimer *deadlineTimer;
+    void arrived(Stream stream, Timestamp timestamp);
+    void accountLateness(Stream stream, Timestamp lateness);
+    void publishTuple(Timestamp timestamp);
+
+    // Fixed-rate mode: the histories are shared with the pacer thread
+    SynchronizerPacer *pacer;
+    QMutex dataMutex;
+    unsigned int jitterIdx;
+    unsigned int missedIdx;
+    void resample(Timestamp timestamp);
+    template<class T> const T* getHeld(Timestamp timestamp, const TimeSeries<T> &dataList);
+
     QTimer *timer;
-    template<class T> T* getClosestInTime(Timestamp timestamp, std::list<T> &dataList);
-    //template<class T> Timestamp getLatestTimestamp(std::list<T> &dataList);
+    template<class T> const T* getClosestInTime(Timestamp timestamp, const TimeSeries<T> &dataList);
+    EyeData getEyeData(Timestamp timestamp, const TimeSeries<EyeData> &dataList);
+    //template<class T> Timestamp getLatestTimestamp(TimeSeries<T> &dataList);
     //Timestamp getLatestTimestamp();
 
-    template<class T> void removeOld(std::list<T> &dataList);
+    template<class T> void removeOld(TimeSeries<T> &dataList);
+    template<class T> void insert(TimeSeries<T> &dataList, const T &data);
 
 private slots:
     void synchronize(Timestamp timestamp=0);
+    void flushPending();
 };
 
 #endif // SYNCHRONIZER_H
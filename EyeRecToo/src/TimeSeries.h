@@ -0,0 +1,78 @@
+#ifndef TIMESERIES_H
+#define TIMESERIES_H
+
+#include <vector>
+
+#include "utils.h"
+
+/* Fixed capacity, timestamp-sorted ring buffer.
+ *
+ * The slots are allocated once and new samples are copy-assigned into them;
+ * when full, the oldest sample is overwritten. T must have a "timestamp"
+ * member.
+ *
+ * Copy-assigning a cv::Mat shares its refcounted buffer rather than copying
+ * into the slot's, so elements holding frames (e.g., EyeData::input) keep
+ * those frames alive until their slot is overwritten, cleared, or the owner
+ * releases them; the Synchronizer does so for all but the newest samples, so
+ * the frames return to the camera's FramePool.
+ */
+template<class T>
+class TimeSeries
+{
+public:
+    explicit TimeSeries(size_t capacity = 64) :
+        buffer(capacity > 0 ? capacity : 1),
+        first(0),
+        count(0)
+    {}
+
+    void setCapacity(size_t capacity)
+    {
+        buffer.assign(capacity > 0 ? capacity : 1, T());
+        clear();
+    }
+    void clear() { first = 0; count = 0; }
+
+    bool empty() const { return count == 0; }
+    size_t size() const { return count; }
+    T& operator[](const size_t &i) { return buffer[(first + i) % buffer.size()]; }
+    const T& operator[](const size_t &i) const { return buffer[(first + i) % buffer.size()]; }
+    const T& front() const { return (*this)[0]; }
+    const T& back() const { return (*this)[count-1]; }
+
+    void insert(const T &value)
+    {
+        if (count == buffer.size()) {
+            first = (first + 1) % buffer.size();
+            count--;
+        }
+
+        // Samples (almost) always arrive in order, so this rarely shifts anything
+        size_t i = count++;
+        for (; i > 0 && (*this)[i-1].timestamp > value.timestamp; i--)
+            (*this)[i] = (*this)[i-1];
+        (*this)[i] = value;
+    }
+
+    // Index of the first sample not older than t; size() if there's none
+    size_t lowerBound(const Timestamp &t) const
+    {
+        size_t lo = 0, hi = count;
+        while (lo < hi) {
+            size_t mid = lo + (hi - lo) / 2;
+            if ((*this)[mid].timestamp < t)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        return lo;
+    }
+
+private:
+    std::vector<T> buffer;
+    size_t first;
+    size_t count;
+};
+
+#endif // TIMESERIES_H
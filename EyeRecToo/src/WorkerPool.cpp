@@ -0,0 +1,17 @@
+#include "WorkerPool.h"
+
+#include <QThread>
+
+WorkerPool::WorkerPool()
+{
+    // Leave most cores to the camera, processing and recording threads
+    helpers = qBound(0, QThread::idealThreadCount() / 2 - 1, (int) MaxHelpers);
+    pool.setMaxThreadCount( qMax(1, helpers) );
+    pool.setExpiryTimeout(-1);
+}
+
+WorkerPool& WorkerPool::shared()
+{
+    static WorkerPool instance;
+    return instance;
+}
@@ -0,0 +1,85 @@
+#ifndef WORKERPOOL_H
+#define WORKERPOOL_H
+
+#include <QAtomicInt>
+#include <QRunnable>
+#include <QSemaphore>
+#include <QThreadPool>
+
+#include "AllocationCounter.h"
+
+/* Small thread pool shared by all image processors (e.g., both eyes).
+ *
+ * run() executes task(worker, item) for every item in [0, count). The calling
+ * thread always takes part as worker 0, and idle pool threads join in as
+ * workers 1..maxWorkers()-1. Items are handed out one at a time from a shared
+ * counter, so whoever is free picks up the next one. Pool threads that are
+ * busy with another caller are simply not used: run() never waits for queued
+ * work to start, only for started helpers to finish.
+ *
+ * Which worker processes which item depends on timing; callers that need
+ * deterministic results should keep per-worker results tagged by item and
+ * reduce them in item order.
+ */
+class WorkerPool
+{
+public:
+    static WorkerPool& shared();
+
+    int maxWorkers() const { return helpers + 1; }
+
+    template<typename Task>
+    void run(const int &count, Task task) {
+        if (count <= 0)
+            return;
+        QAtomicInt next(0);
+        auto work = [&](const int &worker) {
+            for (int item = next.fetchAndAddRelaxed(1); item < count; item = next.fetchAndAddRelaxed(1))
+                task(worker, item);
+        };
+
+        Helper<decltype(work)> started[MaxHelpers];
+        QSemaphore done;
+        int startedCount = 0;
+        for (int i=0; i<helpers && i<count-1; i++) {
+            Helper<decltype(work)> &helper = started[startedCount];
+            helper.work = &work;
+            helper.worker = startedCount + 1;
+            helper.done = &done;
+            if (!pool.tryStart(&helper))
+                break;
+            startedCount++;
+        }
+
+        work(0);
+        done.acquire(startedCount);
+        for (int i=0; i<startedCount; i++)
+            AllocationCounter::credit(started[i].allocations);
+    }
+
+private:
+    WorkerPool();
+
+    enum { MaxHelpers = 3 };
+    QThreadPool pool;
+    int helpers;
+
+    template<typename Work>
+    class Helper : public QRunnable
+    {
+    public:
+        Helper() : work(NULL), worker(0), done(NULL), allocations(0) { setAutoDelete(false); }
+        void run() {
+            unsigned long long before = AllocationCounter::count();
+            (*work)(worker);
+            allocations = AllocationCounter::count() - before;
+            done->release();
+        }
+        Work *work;
+        int worker;
+        QSemaphore *done;
+        unsigned long long allocations;
+    };
+};
+
+#endif // WORKERPOOL_H
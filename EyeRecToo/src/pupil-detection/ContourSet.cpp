@@ -0,0 +1,66 @@
+#include "ContourSet.h"
+
+#include <opencv2/imgproc/imgproc_c.h>
+
+using namespace cv;
+
+ContourSet::ContourSet()
+{
+	storage = cvCreateMemStorage();
+}
+
+ContourSet::~ContourSet()
+{
+	cvReleaseMemStorage(&storage);
+}
+
+void ContourSet::find(const Mat &image, const int &method)
+{
+	points.clear();
+	spans.clear();
+	cvClearMemStorage(storage); // keeps its blocks for the next frame
+
+	CvMat cImage = image;
+	CvSeq *first = NULL;
+	cvFindContours(&cImage, storage, &first, sizeof(CvContour), CV_RETR_LIST, method);
+	if (!first)
+		return;
+
+	// Traverse them like cv::findContours does
+	CvSeq *all = cvTreeToNodeSeq(first, sizeof(CvSeq), storage);
+	CvSeqReader reader;
+	cvStartReadSeq(all, &reader);
+	for (int i=0; i<all->total; i++) {
+		CvSeq *c;
+		CV_READ_SEQ_ELEM(c, reader);
+		Span span = { points.size(), (size_t) c->total };
+		points.resize(span.begin + span.size);
+		cvCvtSeqToArray(c, &points[span.begin]);
+		spans.push_back(span);
+	}
+}
+
+void ContourSet::removeDuplicates(const Size &imageSize)
+{
+	if (visited.size() < (size_t) imageSize.area())
+		visited.resize(imageSize.area(), 0);
+
+	// Latest contours take precedence
+	size_t kept = spans.size();
+	for (size_t i=spans.size(); i-->0;) {
+		const Point *p = &points[spans[i].begin];
+		if (visited[p->y*imageSize.width + p->x])
+			continue;
+		for (size_t j=0; j<spans[i].size; j++)
+			visited[p[j].y*imageSize.width + p[j].x] = 1;
+		spans[--kept] = spans[i];
+	}
+	spans.erase(spans.begin(), spans.begin() + kept);
+
+	// Only marked pixels have to be reset, not the whole image
+	for (auto s=spans.begin(); s!=spans.end(); s++)
+		for (size_t j=0; j<s->size; j++) {
+			const Point &p = points[s->begin + j];
+			visited[p.y*imageSize.width + p.x] = 0;
+		}
+}
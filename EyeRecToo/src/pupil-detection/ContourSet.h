@@ -0,0 +1,77 @@
+#ifndef CONTOURSET_H
+#define CONTOURSET_H
+
+#include <vector>
+
+#include <opencv2/core.hpp>
+#include <opencv2/core/types_c.h>
+
+// Non-owning view over a run of contiguous points
+class PointSpan
+{
+public:
+	PointSpan() : first(NULL), count(0) {}
+	PointSpan(const cv::Point *first, const size_t &count) : first(first), count(count) {}
+	PointSpan(const std::vector<cv::Point> &points) : first(points.data()), count(points.size()) {}
+
+	const cv::Point* begin() const { return first; }
+	const cv::Point* end() const { return first + count; }
+	const cv::Point& operator[](const size_t &i) const { return first[i]; }
+	size_t size() const { return count; }
+	bool empty() const { return count == 0; }
+
+	// Header only (no copy), for passing the points to OpenCV functions
+	cv::Mat mat() const { return cv::Mat( (int) count, 1, CV_32SC2, (void*) first); }
+
+private:
+	const cv::Point *first;
+	size_t count;
+};
+
+/* Contours of a binary image in flat storage.
+ *
+ * All points live in a single array and each contour is a span over it, so
+ * extracting and filtering contours does not allocate once the buffers have
+ * grown to the working size. Spans remain valid until the next find().
+ */
+class ContourSet
+{
+public:
+	ContourSet();
+	~ContourSet();
+
+	// Same contours, in the same order, as cv::findContours with CV_RETR_LIST;
+	// like it, the image data is modified
+	void find(const cv::Mat &image, const int &method);
+
+	// Drops contours starting at a point that belongs to a contour after them
+	// (e.g., both sides of closed loops)
+	void removeDuplicates(const cv::Size &imageSize);
+
+	template<typename Predicate>
+	void removeIf(Predicate remove) {
+		size_t kept = 0;
+		for (size_t i=0; i<spans.size(); i++)
+			if ( !remove( (*this)[i] ) )
+				spans[kept++] = spans[i];
+		spans.resize(kept);
+	}
+
+	size_t size() const { return spans.size(); }
+	PointSpan operator[](const size_t &i) const { return PointSpan(&points[spans[i].begin], spans[i].size); }
+
+private:
+	struct Span {
+		size_t begin;
+		size_t size;
+	};
+	std::vector<cv::Point> points;
+	std::vector<Span> spans;
+	std::vector<uchar> visited;
+	CvMemStorage *storage;
+
+	ContourSet(const ContourSet&);
+	ContourSet& operator=(const ContourSet&);
+};
+
+#endif // CONTOURSET_H
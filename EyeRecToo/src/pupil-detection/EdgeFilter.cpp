@@ -0,0 +1,260 @@
+#include "EdgeFilter.h"
+
+#include <cstdint>
+#include <cstring>
+
+using namespace cv;
+
+/*
+ *  Neighborhood encoding
+ *
+ *  7x7 neighborhoods are packed into 64 bits: one byte per row (dy = -3 in
+ *  the lowest byte) and one bit per column (dx = -3 in the lowest bit).
+ *  3x3 neighborhoods are packed into 9 bits, row major, used as LUT index.
+ */
+static constexpr uint64_t bit(const int dy, const int dx)
+{
+	return 1ULL << ( 8*(dy+3) + (dx+3) );
+}
+
+static inline bool at(const unsigned int &code, const int &dy, const int &dx)
+{
+	return (code >> ( 3*(dy+1) + (dx+1) )) & 1;
+}
+
+// Non-zero flags of p[0..7] as bits 0..7 (assumes a little endian host)
+static inline uint64_t rowBits(const uchar *p)
+{
+	uint64_t x;
+	memcpy(&x, p, sizeof(x));
+	x = ( ( (x & 0x7f7f7f7f7f7f7f7fULL) + 0x7f7f7f7f7f7f7f7fULL ) | x ) & 0x8080808080808080ULL;
+	return ( (x >> 7) * 0x0102040810204080ULL ) >> 56;
+}
+
+static inline uint64_t neighborhood7x7(const uchar *p, const int &step)
+{
+	uint64_t n = 0;
+	p -= 3*step + 3;
+	for (int r = 0; r < 7; r++, p += step)
+		n |= rowBits(p) << (8*r);
+	return n;
+}
+
+static inline unsigned int neighborhood3x3(const uchar *p, const int &step)
+{
+	return (unsigned int) (
+		( (rowBits(p - step - 3) >> 2) & 7 ) |
+		( (rowBits(p - 3) >> 2) & 7 ) << 3 |
+		( (rowBits(p + step - 3) >> 2) & 7 ) << 6 );
+}
+
+struct RemovalLut
+{
+	template<typename Predicate>
+	explicit RemovalLut(Predicate remove) {
+		for (unsigned int code = 0; code < 512; code++)
+			lut[code] = at(code, 0, 0) && remove(code);
+	}
+	bool operator()(const unsigned int &code) const { return lut[code]; }
+	bool lut[512];
+};
+
+/*
+ *  Visits the non-zero pixels of area in raster order; zero pixels are left
+ *  untouched by all passes, so runs of them are skipped 8 at a time.
+ */
+template<typename Process>
+static inline void sweep(Mat &edges, const Rect &area, Process process)
+{
+	CV_Assert(edges.type() == CV_8UC1);
+	const int step = (int) edges.step;
+	const int end = area.x + area.width;
+	for (int j = area.y; j < area.y + area.height; j++) {
+		uchar *row = edges.ptr<uchar>(j);
+		for (int i = area.x; i < end; i++) {
+			if (i + 8 <= end) {
+				uint64_t run;
+				memcpy(&run, row + i, sizeof(run));
+				if (run == 0) {
+					i += 7;
+					continue;
+				}
+			}
+			if (row[i])
+				process(row + i, step);
+		}
+	}
+}
+
+/*
+ *  3x3 passes
+ */
+void EdgeFilter::removeLowAngles(Mat &edges, const Rect &area)
+{
+	// Ring around the center, clockwise from the top left
+	static const int ring[8][2] = { {-1,-1}, {-1,0}, {-1,1}, {0,1}, {1,1}, {1,0}, {1,-1}, {0,-1} };
+	static const RemovalLut lowAngle( [](const unsigned int &code) {
+		for (int k = 0; k < 8; k++) {
+			if (!at(code, ring[k][0], ring[k][1]))
+				continue;
+			for (int o = 2; o <= 6; o++)
+				if ( at(code, ring[(k+o)%8][0], ring[(k+o)%8][1]) )
+					return false;
+		}
+		return true;
+	});
+	sweep(edges, area, [](uchar *p, const int &step) {
+		if ( lowAngle(neighborhood3x3(p, step)) )
+			*p = 0;
+	});
+}
+
+void EdgeFilter::thin(Mat &edges, const Rect &area)
+{
+	static const RemovalLut corner( [](const unsigned int &code) {
+		bool u = at(code, -1, 0);
+		bool d = at(code, 1, 0);
+		bool l = at(code, 0, -1);
+		bool r = at(code, 0, 1);
+		return (r && d) || (r && u) || (l && d) || (l && u);
+	});
+	sweep(edges, area, [](uchar *p, const int &step) {
+		if ( corner(neighborhood3x3(p, step)) )
+			*p = 0;
+	});
+}
+
+void EdgeFilter::removeCrowded(Mat &edges, const Rect &area)
+{
+	// More than three set pixels in the 3x3 box (center included)
+	static const RemovalLut crowded( [](const unsigned int &code) {
+		int count = 0;
+		for (int b = 0; b < 9; b++)
+			count += (code >> b) & 1;
+		return count > 3;
+	});
+	sweep(edges, area, [](uchar *p, const int &step) {
+		if ( crowded(neighborhood3x3(p, step)) )
+			*p = 0;
+	});
+}
+
+/*
+ *  Larger patterns
+ */
+void EdgeFilter::straighten(Mat &edges, const Rect &area)
+{
+	sweep(edges, area, [](uchar *p, const int &step) {
+		// All conditions are evaluated on the neighborhood before any change
+		const uint64_t n = neighborhood7x7(p, step);
+		auto all = [&n](const uint64_t &m) { return (n & m) == m; };
+		auto any = [&n](const uint64_t &m) { return (n & m) != 0; };
+
+		// Vertical: gap below, edge continues diagonally
+		if ( all(bit(2,0)) && !any(bit(1,0)) && any(bit(1,1) | bit(1,-1)) ) {
+			p[step-1] = 0;
+			p[step+1] = 0;
+			p[step] = 255;
+		}
+		if ( all(bit(3,0)) && !any(bit(1,0) | bit(2,0)) && any(bit(1,1) | bit(1,-1)) && any(bit(2,1) | bit(2,-1)) ) {
+			p[step+1] = 0;
+			p[step-1] = 0;
+			p[2*step+1] = 0;
+			p[2*step-1] = 0;
+			p[step] = 255;
+			p[2*step] = 255;
+		}
+
+		// Horizontal: gap to the right, edge continues diagonally
+		if ( all(bit(0,2)) && !any(bit(0,1)) && any(bit(1,1) | bit(-1,1)) ) {
+			p[step+1] = 0;
+			p[-step+1] = 0;
+			p[1] = 255;
+		}
+		if ( all(bit(0,3)) && !any(bit(0,1) | bit(0,2)) && any(bit(1,1) | bit(-1,1)) && any(bit(1,2) | bit(-1,2)) ) {
+			p[step+1] = 0;
+			p[-step+1] = 0;
+			p[step+2] = 0;
+			p[-step+2] = 0;
+			p[1] = 255;
+			p[2] = 255;
+		}
+	});
+}
+
+// The center is removed if all pixels of any pattern are set
+static const uint64_t commonJunctions[] = {
+	bit(1,0) | bit(-1,1) | bit(-1,2),
+	bit(1,0) | bit(-1,-1) | bit(-1,-2),
+	bit(-1,0) | bit(1,1) | bit(1,2),
+	bit(-1,0) | bit(1,-1) | bit(1,-2),
+
+	bit(-1,-1) | bit(-2,-1) | bit(-3,-1) | bit(1,1) | bit(1,2) | bit(1,3),
+	bit(-1,1) | bit(-2,1) | bit(-3,1) | bit(1,-1) | bit(1,-2) | bit(1,-3),
+	bit(1,-1) | bit(2,-1) | bit(3,-1) | bit(-1,1) | bit(-1,2) | bit(-1,3),
+	bit(1,1) | bit(2,1) | bit(3,1) | bit(-1,-1) | bit(-1,-2) | bit(-1,-3),
+};
+
+static const uint64_t pureJunctions[] = {
+	bit(-1,-1) | bit(-2,-2) | bit(-1,1) | bit(-2,2),
+	bit(-1,-1) | bit(-2,-2) | bit(1,-1) | bit(2,-2),
+	bit(1,1) | bit(2,2) | bit(-1,1) | bit(-2,2),
+	bit(1,1) | bit(2,2) | bit(1,-1) | bit(2,-2),
+
+	bit(0,-1) | bit(-1,-2) | bit(-2,-3) | bit(-1,1) | bit(-2,2),
+	bit(0,-1) | bit(1,-2) | bit(2,-3) | bit(1,1) | bit(2,2),
+	bit(1,0) | bit(2,1) | bit(3,2) | bit(-1,1) | bit(-2,2),
+	bit(1,0) | bit(2,-1) | bit(3,-2) | bit(-1,-1) | bit(-2,-2),
+};
+
+static const uint64_t excuseJunctions[] = {
+	bit(-1,-1) | bit(-2,-2) | bit(-3,-3) | bit(-1,1) | bit(-2,2) | bit(-3,3),
+	bit(-1,-1) | bit(-2,-2) | bit(-3,-3) | bit(1,-1) | bit(2,-2) | bit(3,-3),
+	bit(1,1) | bit(2,2) | bit(3,3) | bit(-1,1) | bit(-2,2) | bit(-3,3),
+	bit(1,1) | bit(2,2) | bit(3,3) | bit(1,-1) | bit(2,-2) | bit(3,-3),
+};
+
+template<size_t N>
+static inline bool matchesAny(const uint64_t &n, const uint64_t (&patterns)[N])
+{
+	for (size_t k = 0; k < N; k++)
+		if ( (n & patterns[k]) == patterns[k] )
+			return true;
+	return false;
+}
+
+void EdgeFilter::removeJunctions(Mat &edges, const Rect &area, const JunctionPatterns &patterns)
+{
+	if (patterns == EXCUSE_JUNCTIONS) {
+		sweep(edges, area, [](uchar *p, const int &step) {
+			const uint64_t n = neighborhood7x7(p, step);
+			if ( matchesAny(n, commonJunctions) || matchesAny(n, excuseJunctions) )
+				*p = 0;
+		});
+	} else {
+		sweep(edges, area, [](uchar *p, const int &step) {
+			const uint64_t n = neighborhood7x7(p, step);
+			if ( matchesAny(n, commonJunctions) || matchesAny(n, pureJunctions) )
+				*p = 0;
+		});
+	}
+}
+
+/*
+ *  Chains
+ */
+void EdgeFilter::pure(Mat &edges, const Rect &area)
+{
+	thin(edges, area);
+	removeCrowded(edges, area);
+	straighten(edges, area);
+	removeJunctions(edges, area, PURE_JUNCTIONS);
+}
+
+void EdgeFilter::excuse(Mat &edges, const Rect &area)
+{
+	removeLowAngles(edges, area);
+	thin(edges, area);
+	straighten(edges, area);
+	removeJunctions(edges, area, EXCUSE_JUNCTIONS);
+}
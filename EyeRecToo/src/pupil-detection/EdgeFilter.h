@@ -0,0 +1,37 @@
+#ifndef EDGEFILTER_H
+#define EDGEFILTER_H
+
+#include <opencv2/core.hpp>
+
+/* Morphological edge filtering shared by PuRe, ElSe, and ExCuSe.
+ *
+ * Each pass works in place and in raster order over area, exactly like the
+ * original hand-written loops (later pixels see the changes made by earlier
+ * ones), so the output is identical to them. Decisions come from lookup
+ * tables (3x3 passes) or from bit masks over a packed 7x7 neighborhood
+ * (larger patterns), and runs of empty pixels are skipped 8 at a time.
+ *
+ * The edge image must be continuous and binary (zero / non-zero), and area
+ * must keep a margin of at least 5 pixels to the image borders.
+ */
+class EdgeFilter
+{
+public:
+	enum JunctionPatterns {
+		PURE_JUNCTIONS = 0, // PuRe and ElSe
+		EXCUSE_JUNCTIONS = 1,
+	};
+
+	// Complete filter chains
+	static void pure(cv::Mat &edges, const cv::Rect &area); // PuRe and ElSe
+	static void excuse(cv::Mat &edges, const cv::Rect &area); // ExCuSe
+
+	// Individual passes
+	static void removeLowAngles(cv::Mat &edges, const cv::Rect &area);
+	static void thin(cv::Mat &edges, const cv::Rect &area);
+	static void removeCrowded(cv::Mat &edges, const cv::Rect &area);
+	static void straighten(cv::Mat &edges, const cv::Rect &area);
+	static void removeJunctions(cv::Mat &edges, const cv::Rect &area, const JunctionPatterns &patterns);
+};
+
+#endif // EDGEFILTER_H
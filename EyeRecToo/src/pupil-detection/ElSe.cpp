@@ -1,14 +1,15 @@
 #include "ElSe.h"
+#include "EdgeFilter.h"
 
 #include <opencv2/highgui.hpp>
 #include <QDebug>
 #include <QThread>
 
+#include <array>
+
 using namespace cv;
 
 std::string ElSe::desc = "ElSe (Fuhl et al. 2016)";
-float ElSe::minArea = 0;
-float ElSe::maxArea = 0;
 
 #define IMG_SIZE 680 //400
 
@@ -136,7 +137,7 @@ static int calc_inner_gray(Mat *pic, std::vector<Point> curve, RotatedRect ellip
 
 
 
-static std::vector<std::vector<Point>> get_curves(Mat *pic, Mat *edge, Mat *magni, int start_x, int end_x, int start_y, int end_y, double mean_dist, int inner_color_range){
+static std::vector<std::vector<Point>> get_curves(Mat *pic, Mat *edge, Mat *magni, int start_x, int end_x, int start_y, int end_y, double mean_dist, int inner_color_range, float min_area, float max_area){
 
     (void) magni;
     std::vector<std::vector<Point>> all_lines;
@@ -166,11 +167,8 @@ static std::vector<std::vector<Point>> get_curves(Mat *pic, Mat *edge, Mat *magn
 
 
 
-    bool check[IMG_SIZE][IMG_SIZE];
-
-    for(int i=0; i<IMG_SIZE; i++)
-        for(int j=0; j<IMG_SIZE; j++)
-            check[i][j]=0;
+    // Too large for the stack of worker threads
+    std::vector< std::array<bool, IMG_SIZE> > check(IMG_SIZE); // zeroed
 
 
 
@@ -285,8 +283,8 @@ static std::vector<std::vector<Point>> get_curves(Mat *pic, Mat *edge, Mat *magn
 
 
                     if(add_curve){ // pupil area
-						if(ellipse.size.width*ellipse.size.height < ElSe::minArea ||
-							ellipse.size.width*ellipse.size.height > ElSe::maxArea)
+						if(ellipse.size.width*ellipse.size.height < min_area ||
+							ellipse.size.width*ellipse.size.height > max_area)
                             add_curve=false;
                     }
 
@@ -354,7 +352,7 @@ static std::vector<std::vector<Point>> get_curves(Mat *pic, Mat *edge, Mat *magn
 
 
 
-static RotatedRect find_best_edge(Mat *pic,Mat *edge, Mat *magni, int start_x, int end_x, int start_y, int end_y, double mean_dist, int inner_color_range){
+static RotatedRect find_best_edge(Mat *pic,Mat *edge, Mat *magni, int start_x, int end_x, int start_y, int end_y, double mean_dist, int inner_color_range, float min_area, float max_area){
 
     RotatedRect ellipse;
     ellipse.center.x=0;
@@ -363,7 +361,7 @@ static RotatedRect find_best_edge(Mat *pic,Mat *edge, Mat *magni, int start_x, i
     ellipse.size.height=0.0;
     ellipse.size.width=0.0;
 
-    std::vector<std::vector<Point>> all_curves=get_curves(pic, edge, magni, start_x, end_x, start_y, end_y, mean_dist, inner_color_range);
+    std::vector<std::vector<Point>> all_curves=get_curves(pic, edge, magni, start_x, end_x, start_y, end_y, mean_dist, inner_color_range, min_area, max_area);
 
 
 
@@ -405,228 +403,7 @@ static void filter_edges(Mat *edge, int start_xx, int end_xx, int start_yy, int
         if(start_y<5) start_y=5;
         if(end_y>edge->rows-5) end_y=edge->rows-5;
 
-        for(int j=start_y; j<end_y; j++)
-        for(int i=start_x; i<end_x; i++){
-            int box[9];
-
-            box[4]=(int)edge->data[(edge->cols*(j))+(i)];
-
-            if(box[4]){
-                box[1]=(int)edge->data[(edge->cols*(j-1))+(i)];
-                box[3]=(int)edge->data[(edge->cols*(j))+(i-1)];
-                box[5]=(int)edge->data[(edge->cols*(j))+(i+1)];
-                box[7]=(int)edge->data[(edge->cols*(j+1))+(i)];
-
-
-                if((box[5] && box[7])) edge->data[(edge->cols*(j))+(i)]=0;
-                if((box[5] && box[1])) edge->data[(edge->cols*(j))+(i)]=0;
-                if((box[3] && box[7])) edge->data[(edge->cols*(j))+(i)]=0;
-                if((box[3] && box[1])) edge->data[(edge->cols*(j))+(i)]=0;
-
-            }
-        }
-
-        //too many neigbours
-        for(int j=start_y; j<end_y; j++)
-        for(int i=start_x; i<end_x; i++){
-            int neig=0;
-
-            for(int k1=-1;k1<2;k1++)
-                for(int k2=-1;k2<2;k2++){
-
-                    if(edge->data[(edge->cols*(j+k1))+(i+k2)]>0)
-                        neig++;
-                }
-
-            if(neig>3)
-                edge->data[(edge->cols*(j))+(i)]=0;
-
-        }
-
-        for(int j=start_y; j<end_y; j++)
-        for(int i=start_x; i<end_x; i++){
-            int box[17];
-
-            box[4]=(int)edge->data[(edge->cols*(j))+(i)];
-
-            if(box[4]){
-                box[0]=(int)edge->data[(edge->cols*(j-1))+(i-1)];
-                box[1]=(int)edge->data[(edge->cols*(j-1))+(i)];
-                box[2]=(int)edge->data[(edge->cols*(j-1))+(i+1)];
-
-                box[3]=(int)edge->data[(edge->cols*(j))+(i-1)];
-                box[5]=(int)edge->data[(edge->cols*(j))+(i+1)];
-
-                box[6]=(int)edge->data[(edge->cols*(j+1))+(i-1)];
-                box[7]=(int)edge->data[(edge->cols*(j+1))+(i)];
-                box[8]=(int)edge->data[(edge->cols*(j+1))+(i+1)];
-
-                //external
-                box[9]=(int)edge->data[(edge->cols*(j))+(i+2)];
-                box[10]=(int)edge->data[(edge->cols*(j+2))+(i)];
-
-
-                box[11]=(int)edge->data[(edge->cols*(j))+(i+3)];
-                box[12]=(int)edge->data[(edge->cols*(j-1))+(i+2)];
-                box[13]=(int)edge->data[(edge->cols*(j+1))+(i+2)];
-
-
-                box[14]=(int)edge->data[(edge->cols*(j+3))+(i)];
-                box[15]=(int)edge->data[(edge->cols*(j+2))+(i-1)];
-                box[16]=(int)edge->data[(edge->cols*(j+2))+(i+1)];
-
-
-
-                if( (box[10] && !box[7]) && (box[8] || box[6]) ){
-                        edge->data[(edge->cols*(j+1))+(i-1)]=0;
-                        edge->data[(edge->cols*(j+1))+(i+1)]=0;
-                        edge->data[(edge->cols*(j+1))+(i)]=255;
-                }
-
-
-                if( (box[14] && !box[7] && !box[10]) && ( (box[8] || box[6]) && (box[16] || box[15]) ) ){
-                        edge->data[(edge->cols*(j+1))+(i+1)]=0;
-                        edge->data[(edge->cols*(j+1))+(i-1)]=0;
-                        edge->data[(edge->cols*(j+2))+(i+1)]=0;
-                        edge->data[(edge->cols*(j+2))+(i-1)]=0;
-                        edge->data[(edge->cols*(j+1))+(i)]=255;
-                        edge->data[(edge->cols*(j+2))+(i)]=255;
-                }
-
-
-
-                if( (box[9] && !box[5]) && (box[8] || box[2]) ){
-                        edge->data[(edge->cols*(j+1))+(i+1)]=0;
-                        edge->data[(edge->cols*(j-1))+(i+1)]=0;
-                        edge->data[(edge->cols*(j))+(i+1)]=255;
-                }
-
-
-                if( (box[11] && !box[5] && !box[9]) && ( (box[8] || box[2]) && (box[13] || box[12]) ) ){
-                        edge->data[(edge->cols*(j+1))+(i+1)]=0;
-                        edge->data[(edge->cols*(j-1))+(i+1)]=0;
-                        edge->data[(edge->cols*(j+1))+(i+2)]=0;
-                        edge->data[(edge->cols*(j-1))+(i+2)]=0;
-                        edge->data[(edge->cols*(j))+(i+1)]=255;
-                        edge->data[(edge->cols*(j))+(i+2)]=255;
-                }
-
-            }
-        }
-
-        for(int j=start_y; j<end_y; j++)
-        for(int i=start_x; i<end_x; i++){
-
-            int box[33];
-
-            box[4]=(int)edge->data[(edge->cols*(j))+(i)];
-
-            if(box[4]){
-                box[0]=(int)edge->data[(edge->cols*(j-1))+(i-1)];
-                box[1]=(int)edge->data[(edge->cols*(j-1))+(i)];
-                box[2]=(int)edge->data[(edge->cols*(j-1))+(i+1)];
-
-                box[3]=(int)edge->data[(edge->cols*(j))+(i-1)];
-                box[5]=(int)edge->data[(edge->cols*(j))+(i+1)];
-
-                box[6]=(int)edge->data[(edge->cols*(j+1))+(i-1)];
-                box[7]=(int)edge->data[(edge->cols*(j+1))+(i)];
-                box[8]=(int)edge->data[(edge->cols*(j+1))+(i+1)];
-
-                box[9]=(int)edge->data[(edge->cols*(j-1))+(i+2)];
-                box[10]=(int)edge->data[(edge->cols*(j-1))+(i-2)];
-                box[11]=(int)edge->data[(edge->cols*(j+1))+(i+2)];
-                box[12]=(int)edge->data[(edge->cols*(j+1))+(i-2)];
-
-                box[13]=(int)edge->data[(edge->cols*(j-2))+(i-1)];
-                box[14]=(int)edge->data[(edge->cols*(j-2))+(i+1)];
-                box[15]=(int)edge->data[(edge->cols*(j+2))+(i-1)];
-                box[16]=(int)edge->data[(edge->cols*(j+2))+(i+1)];
-
-                box[17]=(int)edge->data[(edge->cols*(j-3))+(i-1)];
-                box[18]=(int)edge->data[(edge->cols*(j-3))+(i+1)];
-                box[19]=(int)edge->data[(edge->cols*(j+3))+(i-1)];
-                box[20]=(int)edge->data[(edge->cols*(j+3))+(i+1)];
-
-                box[21]=(int)edge->data[(edge->cols*(j+1))+(i+3)];
-                box[22]=(int)edge->data[(edge->cols*(j+1))+(i-3)];
-                box[23]=(int)edge->data[(edge->cols*(j-1))+(i+3)];
-                box[24]=(int)edge->data[(edge->cols*(j-1))+(i-3)];
-
-                box[25]=(int)edge->data[(edge->cols*(j-2))+(i-2)];
-                box[26]=(int)edge->data[(edge->cols*(j+2))+(i+2)];
-                box[27]=(int)edge->data[(edge->cols*(j-2))+(i+2)];
-                box[28]=(int)edge->data[(edge->cols*(j+2))+(i-2)];
-
-                box[29]=(int)edge->data[(edge->cols*(j-3))+(i-3)];
-                box[30]=(int)edge->data[(edge->cols*(j+3))+(i+3)];
-                box[31]=(int)edge->data[(edge->cols*(j-3))+(i+3)];
-                box[32]=(int)edge->data[(edge->cols*(j+3))+(i-3)];
-
-                if( box[7] && box[2] && box[9] )
-                        edge->data[(edge->cols*(j))+(i)]=0;
-                if( box[7] && box[0] && box[10] )
-                        edge->data[(edge->cols*(j))+(i)]=0;
-                if( box[1] && box[8] && box[11] )
-                        edge->data[(edge->cols*(j))+(i)]=0;
-                if( box[1] && box[6] && box[12] )
-                        edge->data[(edge->cols*(j))+(i)]=0;
-
-                if( box[0] && box[13] && box[17] && box[8] && box[11] && box[21] )
-                        edge->data[(edge->cols*(j))+(i)]=0;
-                if( box[2] && box[14] && box[18] && box[6] && box[12] && box[22] )
-                        edge->data[(edge->cols*(j))+(i)]=0;
-                if( box[6] && box[15] && box[19] && box[2] && box[9] && box[23] )
-                        edge->data[(edge->cols*(j))+(i)]=0;
-                if( box[8] && box[16] && box[20] && box[0] && box[10] && box[24] )
-                        edge->data[(edge->cols*(j))+(i)]=0;
-
-                if( box[0] && box[25] && box[2] && box[27] )
-                        edge->data[(edge->cols*(j))+(i)]=0;
-                if( box[0] && box[25] && box[6] && box[28] )
-                        edge->data[(edge->cols*(j))+(i)]=0;
-                if( box[8] && box[26] && box[2] && box[27] )
-                        edge->data[(edge->cols*(j))+(i)]=0;
-                if( box[8] && box[26] && box[6] && box[28] )
-                        edge->data[(edge->cols*(j))+(i)]=0;
-
-                int box2[18];
-                box2[1]=(int)edge->data[(edge->cols*(j))+(i-1)];
-
-                box2[2]=(int)edge->data[(edge->cols*(j-1))+(i-2)];
-                box2[3]=(int)edge->data[(edge->cols*(j-2))+(i-3)];
-
-                box2[4]=(int)edge->data[(edge->cols*(j-1))+(i+1)];
-                box2[5]=(int)edge->data[(edge->cols*(j-2))+(i+2)];
-
-                box2[6]=(int)edge->data[(edge->cols*(j+1))+(i-2)];
-                box2[7]=(int)edge->data[(edge->cols*(j+2))+(i-3)];
-
-                box2[8]=(int)edge->data[(edge->cols*(j+1))+(i+1)];
-                box2[9]=(int)edge->data[(edge->cols*(j+2))+(i+2)];
-
-                box2[10]=(int)edge->data[(edge->cols*(j+1))+(i)];
-
-                box2[15]=(int)edge->data[(edge->cols*(j-1))+(i-1)];
-                box2[16]=(int)edge->data[(edge->cols*(j-2))+(i-2)];
-
-                box2[11]=(int)edge->data[(edge->cols*(j+2))+(i+1)];
-                box2[12]=(int)edge->data[(edge->cols*(j+3))+(i+2)];
-
-                box2[13]=(int)edge->data[(edge->cols*(j+2))+(i-1)];
-                box2[14]=(int)edge->data[(edge->cols*(j+3))+(i-2)];
-
-                if( box2[1] && box2[2] && box2[3] && box2[4] && box2[5] )
-                        edge->data[(edge->cols*(j))+(i)]=0;
-                if( box2[1] && box2[6] && box2[7] && box2[8] && box2[9] )
-                        edge->data[(edge->cols*(j))+(i)]=0;
-                if( box2[10] && box2[11] && box2[12] && box2[4] && box2[5] )
-                        edge->data[(edge->cols*(j))+(i)]=0;
-                if( box2[10] && box2[13] && box2[14] && box2[15] && box2[16] )
-                        edge->data[(edge->cols*(j))+(i)]=0;
-            }
-
-        }
+        EdgeFilter::pure(*edge, Rect(start_x, start_y, end_x-start_x, end_y-start_y));
 }
 
 //static float hypot(float a,float b)
@@ -1328,7 +1105,8 @@ if(pos.y>0 && pos.y<pic->rows && pos.x>0 && pos.x<pic->cols){
 
 }
 
-RotatedRect ElSe::run(const Mat &frame)
+// Everything per call lives on the stack, so runs may overlap freely
+static RotatedRect runelse(const Mat &frame, float min_area, float max_area)
 {
 	RotatedRect ellipse;
 	Point pos(0,0);
@@ -1368,7 +1146,7 @@ RotatedRect ElSe::run(const Mat &frame)
 
     filter_edges(&detected_edges, start_x, end_x, start_y, end_y);
 
-    ellipse=find_best_edge(&pic, &detected_edges, &magni, start_x, end_x, start_y, end_y,mean_dist, inner_color_range);
+    ellipse=find_best_edge(&pic, &detected_edges, &magni, start_x, end_x, start_y, end_y,mean_dist, inner_color_range, min_area, max_area);
 
     if(ellipse.center.x<=0 && ellipse.center.y<=0 || ellipse.center.x>=pic.cols || ellipse.center.y>=pic.rows){
 
@@ -1381,22 +1159,27 @@ RotatedRect ElSe::run(const Mat &frame)
     return ellipse;
 }
 
-void ElSe::run(const cv::Mat &frame, const cv::Rect &roi, Pupil &pupil, const float &minPupilDiameterPx, const float &maxPupilDiameterPx)
+RotatedRect ElSe::run(const Mat &frame)
+{
+	return runelse(frame, defaultMinArea(frame), defaultMaxArea(frame));
+}
+
+void ElSe::run(const cv::Mat &frame, const cv::Rect &roi, Pupil &pupil, const float &minPupilDiameterPx, const float &maxPupilDiameterPx, const Deadline &deadline)
 {
+	(void) deadline; // runs to completion
 	if (roi.area() < 10) {
 		qWarning() << "Bad ROI: falling back to regular detection.";
 		PupilDetectionMethod::run(frame, pupil);
 		return;
 	}
+	float minArea = defaultMinArea(frame);
+	float maxArea = defaultMaxArea(frame);
 	if (minPupilDiameterPx > 0 && maxPupilDiameterPx > 0 ) {
 		minArea = pow(minPupilDiameterPx,2);
 		maxArea = pow(maxPupilDiameterPx,2);
-	} else {
-		minArea = frame.cols * frame.rows * 0.005;
-		maxArea = frame.cols * frame.rows * 0.2;
 	}
 
-	pupil = run( frame(roi) );
+	pupil = runelse( frame(roi), minArea, maxArea );
 	if (pupil.center.x > 0 && pupil.center.y > 0)
 		pupil.shift( roi.tl() );
 }
@@ -20,13 +20,15 @@ class ElSe : public PupilDetectionMethod
 public:
     ElSe() { mDesc = desc; }
     cv::RotatedRect run(const cv::Mat &frame);
-	void run(const cv::Mat &frame, const cv::Rect &roi, Pupil &pupil, const float &minPupilDiameterPx=-1, const float &maxPupilDiameterPx=-1);
+	void run(const cv::Mat &frame, const cv::Rect &roi, Pupil &pupil, const float &minPupilDiameterPx=-1, const float &maxPupilDiameterPx=-1, const Deadline &deadline=Deadline());
 	bool hasConfidence() { return false; }
 	bool hasCoarseLocation() { return false; }
 	static std::string desc;
 
-	static float minArea;
-	static float maxArea;
+private:
+	// Pupil area limits when no diameters are given, based on the full frame
+	static float defaultMinArea(const cv::Mat &frame) { return frame.cols * frame.rows * 0.005; }
+	static float defaultMaxArea(const cv::Mat &frame) { return frame.cols * frame.rows * 0.2; }
 };
 
 #endif // ELSE_H
@@ -0,0 +1,304 @@
+#include "EllipseSampler.h"
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+
+#include <opencv2/imgproc.hpp>
+
+using namespace std;
+using namespace cv;
+
+static const float sinTable[] = {
+	0.0000000f  , 0.0174524f  , 0.0348995f  , 0.0523360f  , 0.0697565f  , 0.0871557f  ,
+	0.1045285f  , 0.1218693f  , 0.1391731f  , 0.1564345f  , 0.1736482f  , 0.1908090f  ,
+	0.2079117f  , 0.2249511f  , 0.2419219f  , 0.2588190f  , 0.2756374f  , 0.2923717f  ,
+	0.3090170f  , 0.3255682f  , 0.3420201f  , 0.3583679f  , 0.3746066f  , 0.3907311f  ,
+	0.4067366f  , 0.4226183f  , 0.4383711f  , 0.4539905f  , 0.4694716f  , 0.4848096f  ,
+	0.5000000f  , 0.5150381f  , 0.5299193f  , 0.5446390f  , 0.5591929f  , 0.5735764f  ,
+	0.5877853f  , 0.6018150f  , 0.6156615f  , 0.6293204f  , 0.6427876f  , 0.6560590f  ,
+	0.6691306f  , 0.6819984f  , 0.6946584f  , 0.7071068f  , 0.7193398f  , 0.7313537f  ,
+	0.7431448f  , 0.7547096f  , 0.7660444f  , 0.7771460f  , 0.7880108f  , 0.7986355f  ,
+	0.8090170f  , 0.8191520f  , 0.8290376f  , 0.8386706f  , 0.8480481f  , 0.8571673f  ,
+	0.8660254f  , 0.8746197f  , 0.8829476f  , 0.8910065f  , 0.8987940f  , 0.9063078f  ,
+	0.9135455f  , 0.9205049f  , 0.9271839f  , 0.9335804f  , 0.9396926f  , 0.9455186f  ,
+	0.9510565f  , 0.9563048f  , 0.9612617f  , 0.9659258f  , 0.9702957f  , 0.9743701f  ,
+	0.9781476f  , 0.9816272f  , 0.9848078f  , 0.9876883f  , 0.9902681f  , 0.9925462f  ,
+	0.9945219f  , 0.9961947f  , 0.9975641f  , 0.9986295f  , 0.9993908f  , 0.9998477f  ,
+	1.0000000f  , 0.9998477f  , 0.9993908f  , 0.9986295f  , 0.9975641f  , 0.9961947f  ,
+	0.9945219f  , 0.9925462f  , 0.9902681f  , 0.9876883f  , 0.9848078f  , 0.9816272f  ,
+	0.9781476f  , 0.9743701f  , 0.9702957f  , 0.9659258f  , 0.9612617f  , 0.9563048f  ,
+	0.9510565f  , 0.9455186f  , 0.9396926f  , 0.9335804f  , 0.9271839f  , 0.9205049f  ,
+	0.9135455f  , 0.9063078f  , 0.8987940f  , 0.8910065f  , 0.8829476f  , 0.8746197f  ,
+	0.8660254f  , 0.8571673f  , 0.8480481f  , 0.8386706f  , 0.8290376f  , 0.8191520f  ,
+	0.8090170f  , 0.7986355f  , 0.7880108f  , 0.7771460f  , 0.7660444f  , 0.7547096f  ,
+	0.7431448f  , 0.7313537f  , 0.7193398f  , 0.7071068f  , 0.6946584f  , 0.6819984f  ,
+	0.6691306f  , 0.6560590f  , 0.6427876f  , 0.6293204f  , 0.6156615f  , 0.6018150f  ,
+	0.5877853f  , 0.5735764f  , 0.5591929f  , 0.5446390f  , 0.5299193f  , 0.5150381f  ,
+	0.5000000f  , 0.4848096f  , 0.4694716f  , 0.4539905f  , 0.4383711f  , 0.4226183f  ,
+	0.4067366f  , 0.3907311f  , 0.3746066f  , 0.3583679f  , 0.3420201f  , 0.3255682f  ,
+	0.3090170f  , 0.2923717f  , 0.2756374f  , 0.2588190f  , 0.2419219f  , 0.2249511f  ,
+	0.2079117f  , 0.1908090f  , 0.1736482f  , 0.1564345f  , 0.1391731f  , 0.1218693f  ,
+	0.1045285f  , 0.0871557f  , 0.0697565f  , 0.0523360f  , 0.0348995f  , 0.0174524f  ,
+	0.0000000f  , -0.0174524f , -0.0348995f , -0.0523360f , -0.0697565f , -0.0871557f ,
+	-0.1045285f , -0.1218693f , -0.1391731f , -0.1564345f , -0.1736482f , -0.1908090f ,
+	-0.2079117f , -0.2249511f , -0.2419219f , -0.2588190f , -0.2756374f , -0.2923717f ,
+	-0.3090170f , -0.3255682f , -0.3420201f , -0.3583679f , -0.3746066f , -0.3907311f ,
+	-0.4067366f , -0.4226183f , -0.4383711f , -0.4539905f , -0.4694716f , -0.4848096f ,
+	-0.5000000f , -0.5150381f , -0.5299193f , -0.5446390f , -0.5591929f , -0.5735764f ,
+	-0.5877853f , -0.6018150f , -0.6156615f , -0.6293204f , -0.6427876f , -0.6560590f ,
+	-0.6691306f , -0.6819984f , -0.6946584f , -0.7071068f , -0.7193398f , -0.7313537f ,
+	-0.7431448f , -0.7547096f , -0.7660444f , -0.7771460f , -0.7880108f , -0.7986355f ,
+	-0.8090170f , -0.8191520f , -0.8290376f , -0.8386706f , -0.8480481f , -0.8571673f ,
+	-0.8660254f , -0.8746197f , -0.8829476f , -0.8910065f , -0.8987940f , -0.9063078f ,
+	-0.9135455f , -0.9205049f , -0.9271839f , -0.9335804f , -0.9396926f , -0.9455186f ,
+	-0.9510565f , -0.9563048f , -0.9612617f , -0.9659258f , -0.9702957f , -0.9743701f ,
+	-0.9781476f , -0.9816272f , -0.9848078f , -0.9876883f , -0.9902681f , -0.9925462f ,
+	-0.9945219f , -0.9961947f , -0.9975641f , -0.9986295f , -0.9993908f , -0.9998477f ,
+	-1.0000000f , -0.9998477f , -0.9993908f , -0.9986295f , -0.9975641f , -0.9961947f ,
+	-0.9945219f , -0.9925462f , -0.9902681f , -0.9876883f , -0.9848078f , -0.9816272f ,
+	-0.9781476f , -0.9743701f , -0.9702957f , -0.9659258f , -0.9612617f , -0.9563048f ,
+	-0.9510565f , -0.9455186f , -0.9396926f , -0.9335804f , -0.9271839f , -0.9205049f ,
+	-0.9135455f , -0.9063078f , -0.8987940f , -0.8910065f , -0.8829476f , -0.8746197f ,
+	-0.8660254f , -0.8571673f , -0.8480481f , -0.8386706f , -0.8290376f , -0.8191520f ,
+	-0.8090170f , -0.7986355f , -0.7880108f , -0.7771460f , -0.7660444f , -0.7547096f ,
+	-0.7431448f , -0.7313537f , -0.7193398f , -0.7071068f , -0.6946584f , -0.6819984f ,
+	-0.6691306f , -0.6560590f , -0.6427876f , -0.6293204f , -0.6156615f , -0.6018150f ,
+	-0.5877853f , -0.5735764f , -0.5591929f , -0.5446390f , -0.5299193f , -0.5150381f ,
+	-0.5000000f , -0.4848096f , -0.4694716f , -0.4539905f , -0.4383711f , -0.4226183f ,
+	-0.4067366f , -0.3907311f , -0.3746066f , -0.3583679f , -0.3420201f , -0.3255682f ,
+	-0.3090170f , -0.2923717f , -0.2756374f , -0.2588190f , -0.2419219f , -0.2249511f ,
+	-0.2079117f , -0.1908090f , -0.1736482f , -0.1564345f , -0.1391731f , -0.1218693f ,
+	-0.1045285f , -0.0871557f , -0.0697565f , -0.0523360f , -0.0348995f , -0.0174524f ,
+	-0.0000000f , 0.0174524f  , 0.0348995f  , 0.0523360f  , 0.0697565f  , 0.0871557f  ,
+	0.1045285f  , 0.1218693f  , 0.1391731f  , 0.1564345f  , 0.1736482f  , 0.1908090f  ,
+	0.2079117f  , 0.2249511f  , 0.2419219f  , 0.2588190f  , 0.2756374f  , 0.2923717f  ,
+	0.3090170f  , 0.3255682f  , 0.3420201f  , 0.3583679f  , 0.3746066f  , 0.3907311f  ,
+	0.4067366f  , 0.4226183f  , 0.4383711f  , 0.4539905f  , 0.4694716f  , 0.4848096f  ,
+	0.5000000f  , 0.5150381f  , 0.5299193f  , 0.5446390f  , 0.5591929f  , 0.5735764f  ,
+	0.5877853f  , 0.6018150f  , 0.6156615f  , 0.6293204f  , 0.6427876f  , 0.6560590f  ,
+	0.6691306f  , 0.6819984f  , 0.6946584f  , 0.7071068f  , 0.7193398f  , 0.7313537f  ,
+	0.7431448f  , 0.7547096f  , 0.7660444f  , 0.7771460f  , 0.7880108f  , 0.7986355f  ,
+	0.8090170f  , 0.8191520f  , 0.8290376f  , 0.8386706f  , 0.8480481f  , 0.8571673f  ,
+	0.8660254f  , 0.8746197f  , 0.8829476f  , 0.8910065f  , 0.8987940f  , 0.9063078f  ,
+	0.9135455f  , 0.9205049f  , 0.9271839f  , 0.9335804f  , 0.9396926f  , 0.9455186f  ,
+	0.9510565f  , 0.9563048f  , 0.9612617f  , 0.9659258f  , 0.9702957f  , 0.9743701f  ,
+	0.9781476f  , 0.9816272f  , 0.9848078f  , 0.9876883f  , 0.9902681f  , 0.9925462f  ,
+	0.9945219f  , 0.9961947f  , 0.9975641f  , 0.9986295f  , 0.9993908f  , 0.9998477f  ,
+	1.0000000f
+};
+
+EllipseSampler::EllipseSampler()
+{
+	// Direct mapped; an invalid delta marks empty entries. Storage for the
+	// largest entries is reserved up front, so misses don't allocate.
+	Ray emptyRay = { 0, 0, -1, 0, true, false, Point(), Point(), vector<int>() };
+	rays.resize(1024, emptyRay);
+	for (auto r=rays.begin(); r!=rays.end(); r++)
+		r->offsets.reserve(ReservedRayOffsets);
+	polygon.reserve(360 / 5 + 1);
+}
+
+EllipseSampler& EllipseSampler::local()
+{
+	static thread_local EllipseSampler sampler;
+	return sampler;
+}
+
+void EllipseSampler::outlinePoints(const RotatedRect &ellipse, const int &delta, vector<Point> &points)
+{
+	// Not cached: the axes are arbitrary floats, so an exact key would almost
+	// never hit, and bucketing them moves the points. The few products per
+	// point are cheap next to the rays sampled from them.
+	int angle = ellipse.angle;
+
+	// make sure angle is within range
+	while( angle < 0 )
+		angle += 360;
+	while( angle > 360 )
+		angle -= 360;
+
+	float alpha = sinTable[450 - angle]; // cos
+	float beta = sinTable[angle]; // sin
+	double x, y;
+	points.clear();
+	for( int i = 0; i < 360; i += delta )
+	{
+		x = 0.5*ellipse.size.width * sinTable[450-i];
+		y = 0.5*ellipse.size.height * sinTable[i];
+		points.push_back(
+			Point( roundf(ellipse.center.x + x * alpha - y * beta),
+				roundf(ellipse.center.y + x * beta + y * alpha) )
+			);
+	}
+}
+
+// num / den, rounded half up
+static inline int roundHalfUp(int num, int den)
+{
+	num = 2*num + den;
+	den = 2*den;
+	if (den < 0) {
+		num = -num;
+		den = -den;
+	}
+	return num >= 0 ? num / den : -( (-num + den - 1) / den );
+}
+
+const EllipseSampler::Ray& EllipseSampler::ray(const int &dx, const int &dy, const int &delta, const size_t &step)
+{
+	size_t slot = ( (size_t) dx * 73856093 ^ (size_t) dy * 19349663 ^ (size_t) delta * 83492791 ^ step ) % rays.size();
+	Ray &r = rays[slot];
+	if (r.dx == dx && r.dy == dy && r.delta == delta && r.step == step)
+		return r;
+
+	r.dx = dx;
+	r.dy = dy;
+	r.delta = delta;
+	r.step = step;
+	r.offsets.clear();
+
+	r.skip = (dx == 0 || dy == 0);
+	if (r.skip)
+		return r;
+
+	// Rounded half up with integer arithmetic: within the image this is what
+	// roundf() did on absolute coordinates, minus its float noise on exact
+	// half-pixel positions
+	if ( abs(dx) > abs(dy) ) {
+		r.firstIsOuter = dx < 0;
+		r.start = { dx - delta, roundHalfUp(dy*(dx - delta), dx) };
+		r.end = { dx + delta, roundHalfUp(dy*(dx + delta), dx) };
+		for (int x=dx-delta; x<=dx+delta; x++)
+			if (x != dx)
+				r.offsets.push_back( roundHalfUp(dy*x, dx) * (int) step + x );
+	} else {
+		r.firstIsOuter = dy < 0;
+		r.start = { roundHalfUp(dx*(dy - delta), dy), dy - delta };
+		r.end = { roundHalfUp(dx*(dy + delta), dy), dy + delta };
+		for (int y=dy-delta; y<=dy+delta; y++)
+			if (y != dy)
+				r.offsets.push_back( y * (int) step + roundHalfUp(dx*y, dy) );
+	}
+	return r;
+}
+
+bool EllipseSampler::outlineContrast(const Mat &intensityImage, const RotatedRect &ellipse, const int &delta, const int &bias, float &contrast)
+{
+	const Rect boundaries = { 0, 0, intensityImage.cols, intensityImage.rows };
+	const Point c = ellipse.center;
+	const ptrdiff_t center = c.y * (ptrdiff_t) intensityImage.step + c.x;
+	const uchar *data = intensityImage.data;
+
+	int evaluated = 0;
+	int validCount = 0;
+
+	outlinePoints(ellipse, 10, points);
+	for (auto p=points.begin(); p!=points.end(); p++) {
+		const Ray &r = ray(p->x - c.x, p->y - c.y, delta, intensityImage.step);
+		if (r.skip)
+			continue;
+
+		evaluated++;
+		if (!boundaries.contains(c + r.start) || !boundaries.contains(c + r.end) )
+			continue;
+
+		const int *offset = r.offsets.data();
+		int s1 = 0, s2 = 0;
+		for (int i=0; i<delta; i++)
+			s1 += data[ center + offset[i] ];
+		offset += delta;
+		for (int i=0; i<delta; i++)
+			s2 += data[ center + offset[i] ];
+		float m1 = std::roundf( s1 / (float) delta );
+		float m2 = std::roundf( s2 / (float) delta );
+
+		if (r.firstIsOuter) {
+			if (m1 > m2+bias)
+				validCount++;
+		} else {
+			if (m2 > m1+bias)
+				validCount++;
+		}
+	}
+	if (evaluated == 0)
+		return false;
+	contrast = validCount / (float) evaluated;
+	return true;
+}
+
+bool EllipseSampler::bandPolygon(const RotatedRect &ellipse)
+{
+	// cv::ellipse's outline, into our own storage: fixed point center and
+	// axes, an angular step depending on the size, and duplicates dropped
+	const float one = 1 << PolygonShift;
+	const double limit = INT_MAX / 4;
+	if ( !( std::abs(ellipse.center.x * one) + ellipse.size.width * one < limit
+		&& std::abs(ellipse.center.y * one) + ellipse.size.height * one < limit ) )
+		return false; // the fixed point polygon wouldn't fit into cv::Point
+
+	const Point center( cvRound(ellipse.center.x * one), cvRound(ellipse.center.y * one) );
+	const int width = std::abs( cvRound(ellipse.size.width * (one / 2)) );
+	const int height = std::abs( cvRound(ellipse.size.height * (one / 2)) );
+	int delta = ( std::max(width, height) + (1 << (PolygonShift-1)) ) >> PolygonShift;
+	delta = delta < 3 ? 90 : delta < 10 ? 30 : delta < 15 ? 18 : 5;
+
+	int angle = cvRound(ellipse.angle);
+	while( angle < 0 )
+		angle += 360;
+	while( angle > 360 )
+		angle -= 360;
+	float alpha = sinTable[450 - angle]; // cos
+	float beta = sinTable[angle]; // sin
+
+	polygon.clear();
+	for( int i = 0; i < 360 + delta; i += delta )
+	{
+		int a = std::min(i, 360);
+		double x = (double) width * sinTable[450-a];
+		double y = (double) height * sinTable[a];
+		Point p( cvRound(center.x + x * alpha - y * beta), cvRound(center.y + x * beta + y * alpha) );
+		if (polygon.empty() || p != polygon.back())
+			polygon.push_back(p);
+	}
+	if (polygon.size() == 1)
+		polygon.assign(2, center);
+	return true;
+}
+
+void EllipseSampler::bandEdges(const Mat &edgeImage, const RotatedRect &ellipse, const int &band, vector<Point> &edgePoints)
+{
+	edgePoints.clear();
+
+	// Only the band's surroundings are rasterized
+	const int margin = band + 2;
+	Rect roi = ellipse.boundingRect();
+	roi.x -= margin;
+	roi.y -= margin;
+	roi.width += 2*margin;
+	roi.height += 2*margin;
+	roi &= Rect(0, 0, edgeImage.cols, edgeImage.rows);
+	if (roi.area() <= 0)
+		return;
+
+	Mat mask = workspace.mat(0, roi.size(), CV_8U);
+	mask.setTo(0);
+	RotatedRect shifted = ellipse;
+	shifted.center.x -= roi.x;
+	shifted.center.y -= roi.y;
+	if (bandPolygon(shifted)) {
+		// Same pixels as the polyline cv::ellipse draws: consecutive
+		// segments share their round caps
+		for (size_t i=1; i<polygon.size(); i++)
+			line(mask, polygon[i-1], polygon[i], Scalar(255), band, LINE_8, PolygonShift);
+	} else
+		cv::ellipse(mask, shifted, Scalar(255), band);
+
+	for (int y=0; y<roi.height; y++) {
+		const uchar *m = mask.ptr<uchar>(y);
+		const uchar *e = edgeImage.ptr<uchar>(roi.y + y) + roi.x;
+		for (int x=0; x<roi.width; x++)
+			if (m[x] && e[x])
+				edgePoints.push_back( Point(roi.x + x, roi.y + y) );
+	}
+}
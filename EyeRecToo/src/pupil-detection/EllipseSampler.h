@@ -0,0 +1,64 @@
+#ifndef ELLIPSESAMPLER_H
+#define ELLIPSESAMPLER_H
+
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+#include "Workspace.h"
+
+/* Samples images around ellipse outlines for the confidence metrics.
+ *
+ * For the outline contrast, the pixel pattern of each ray is kept between
+ * calls per (direction, length, image step), as gather indices relative to
+ * the ellipse center. Candidates of similar size hit the same rays, so only
+ * the intensity sums are computed per call.
+ *
+ * Instances are not thread-safe; use local() to get the calling thread's.
+ */
+class EllipseSampler
+{
+public:
+	static EllipseSampler& local();
+
+	// Outline points every delta degrees, starting at the end of the first axis
+	void outlinePoints(const cv::RotatedRect &ellipse, const int &delta, std::vector<cv::Point> &points);
+
+	/* Outline contrast following PuRe: the fraction of rays (every 10 degrees)
+	 * for which the delta pixels outside the outline are brighter than the
+	 * delta pixels inside by more than bias. Rays leaving the image count as
+	 * invalid; false if no ray could be evaluated at all.
+	 */
+	bool outlineContrast(const cv::Mat &intensityImage, const cv::RotatedRect &ellipse, const int &delta, const int &bias, float &contrast);
+
+	// Edge pixels within a band of the given thickness along the outline, in raster order
+	void bandEdges(const cv::Mat &edgeImage, const cv::RotatedRect &ellipse, const int &band, std::vector<cv::Point> &edgePoints);
+
+private:
+	EllipseSampler();
+
+	// Reserved per cache entry: rays of up to 16 pixels per side (i.e.,
+	// pupils up to ~100 pixels); longer ones still work
+	enum { ReservedRayOffsets = 32 };
+
+	struct Ray {
+		int dx, dy, delta;
+		size_t step;
+		bool skip; // parallel to an axis
+		bool firstIsOuter;
+		cv::Point start, end; // relative to the center
+		std::vector<int> offsets; // delta before the outline point, then delta after
+	};
+	std::vector<Ray> rays;
+	const Ray& ray(const int &dx, const int &dy, const int &delta, const size_t &step);
+
+	// Outline as drawn by cv::ellipse, in fixed point; false if out of range
+	enum { PolygonShift = 16 };
+	std::vector<cv::Point> polygon;
+	bool bandPolygon(const cv::RotatedRect &ellipse);
+
+	std::vector<cv::Point> points;
+	Workspace workspace;
+};
+
+#endif // ELLIPSESAMPLER_H
@@ -20,7 +20,7 @@ class ExCuSe : public PupilDetectionMethod
 public:
     ExCuSe() { mDesc = desc;}
     cv::RotatedRect run(const cv::Mat &frame);
-	void run(const cv::Mat &frame, const cv::Rect &roi, Pupil &pupil, const float &minPupilDiameterPx=-1, const float &maxPupilDiameterPx=-1);
+	void run(const cv::Mat &frame, const cv::Rect &roi, Pupil &pupil, const float &minPupilDiameterPx=-1, const float &maxPupilDiameterPx=-1, const Deadline &deadline=Deadline());
 	bool hasConfidence() { return false; }
 	bool hasCoarseLocation() { return false; }
 	static std::string desc;
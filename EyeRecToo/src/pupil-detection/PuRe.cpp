@@ -37,12 +37,16 @@
  */
 
 #include "PuRe.h"
+#include "EdgeFilter.h"
+#include "EllipseSampler.h"
+#include "WorkerPool.h"
 
 #include <climits>
 #include <iostream>
 #include <QDebug>
 #include <QElapsedTimer>
 #include <opencv2/highgui.hpp>
+#include <opencv2/core/hal/intrin.hpp>
 
 //#define SAVE_ILLUSTRATION
 
@@ -113,6 +117,127 @@ void PuRe::init(const Mat &frame)
 }
 
 
+/*
+ *  Row kernels for the canny; they use OpenCV's universal intrinsics when
+ *  available and fall back to scalar code for the remaining columns.
+ */
+static inline float magnitudeRow(const float *p_x, const float *p_y, float *p_res, const int &cols)
+{
+	int j = 0;
+	float maxMag = 0;
+#if CV_SIMD128
+	v_float32x4 v_maxMag = v_setzero_f32();
+	for (; j <= cols - 4; j += 4) {
+		v_float32x4 ix = v_load(p_x + j);
+		v_float32x4 iy = v_load(p_y + j);
+		v_float32x4 m = v_sqrt(ix*ix + iy*iy);
+		v_store(p_res + j, m);
+		v_maxMag = v_max(v_maxMag, m);
+	}
+	maxMag = v_reduce_max(v_maxMag);
+#endif
+	for (; j < cols; j++) {
+		p_res[j] = std::sqrt(p_x[j]*p_x[j] + p_y[j]*p_y[j]);
+		maxMag = max<float>(maxMag, p_res[j]);
+	}
+	return maxMag;
+}
+
+static inline void histogramRow(const float *p_res, const int &cols, const float &scale, int *histogram)
+{
+	int j = 0;
+#if CV_SIMD128
+	int idx[4];
+	v_float32x4 v_scale = v_setall_f32(scale);
+	for (; j <= cols - 4; j += 4) {
+		v_store(idx, v_round(v_load(p_res + j) * v_scale));
+		histogram[idx[0]]++;
+		histogram[idx[1]]++;
+		histogram[idx[2]]++;
+		histogram[idx[3]]++;
+	}
+#endif
+	for (; j < cols; j++)
+		histogram[ cvRound(p_res[j] * scale) ]++;
+}
+
+static inline void nonMaximumSuppressionRow(const float *p_res_t, const float *p_res, const float *p_res_b, const float *p_x, const float *p_y, uchar *_edgeType, const int &cols, const float &low_th, const float &high_th)
+{
+	const float tg22_5 = 0.4142135623730950488016887242097f;
+	const float tg67_5 = 2.4142135623730950488016887242097f;
+
+	int j = 1;
+#if CV_SIMD128
+	// Evaluates all four directions and selects the relevant one; 8 pixels per iteration
+	const v_float32x4 v_tg22_5 = v_setall_f32(tg22_5);
+	const v_float32x4 v_tg67_5 = v_setall_f32(tg67_5);
+	const v_float32x4 v_low = v_setall_f32(low_th);
+	const v_float32x4 v_high = v_setall_f32(high_th);
+	const v_float32x4 v_zero = v_setzero_f32();
+	const v_uint32x4 v_strong = v_setall_u32(255);
+	const v_uint32x4 v_weak = v_setall_u32(128);
+	for (; j <= cols - 9; j += 8) {
+		v_uint32x4 val[2];
+		for (int k = 0; k < 2; k++) {
+			const int c = j + 4*k;
+			v_float32x4 m = v_load(p_res + c);
+			v_float32x4 ix = v_load(p_x + c);
+			v_float32x4 iy = v_load(p_y + c);
+			v_float32x4 x = v_abs(ix);
+			v_float32x4 y = v_abs(iy);
+
+			v_float32x4 horizontal = y < v_tg22_5 * x;
+			v_float32x4 vertical = y > v_tg67_5 * x;
+			v_float32x4 opposite = (iy <= v_zero) ^ (ix <= v_zero);
+
+			v_float32x4 keepH = (m > v_load(p_res + c - 1)) & (m >= v_load(p_res + c + 1));
+			v_float32x4 keepV = (m > v_load(p_res_b + c)) & (m >= v_load(p_res_t + c));
+			v_float32x4 keepD = v_select(opposite,
+				(m > v_load(p_res_b + c - 1)) & (m >= v_load(p_res_t + c + 1)),
+				(m > v_load(p_res_t + c - 1)) & (m >= v_load(p_res_b + c + 1)) );
+			v_float32x4 keep = v_select(horizontal, keepH, v_select(vertical, keepV, keepD) );
+			keep = keep & (m >= v_low);
+
+			val[k] = v_reinterpret_as_u32(keep) & v_select(v_reinterpret_as_u32(m > v_high), v_strong, v_weak);
+		}
+		v_pack_store(_edgeType + j, v_pack(val[0], val[1]));
+	}
+#endif
+	for (; j < cols - 1; j++) {
+
+		float m = p_res[j];
+		if (m < low_th)
+			continue;
+
+		float iy = p_y[j];
+		float ix = p_x[j];
+		float y  = abs( (double) iy );
+		float x  = abs( (double) ix );
+
+		uchar val = p_res[j] > high_th ? 255 : 128;
+
+		float tg22_5x = tg22_5 * x;
+		if (y < tg22_5x) {
+			if (m > p_res[j-1] && m >= p_res[j+1])
+				_edgeType[j] = val;
+		} else {
+			float tg67_5x = tg67_5 * x;
+			if (y > tg67_5x) {
+				if (m > p_res_b[j] && m >= p_res_t[j])
+					_edgeType[j] = val;
+			} else {
+				if ( (iy<=0) == (ix<=0) ) {
+					if ( m > p_res_t[j-1] && m >= p_res_b[j+1])
+						_edgeType[j] = val;
+				} else {
+					if ( m > p_res_b[j-1] && m >= p_res_t[j+1])
+						_edgeType[j] = val;
+				}
+			}
+		}
+	}
+}
+
 Mat PuRe::canny(const Mat &in, bool blurImage, bool useL2, int bins, float nonEdgePixelsRatio, float lowHighThresholdRatio)
 {
 	(void) useL2;
@@ -120,46 +245,53 @@ Mat PuRe::canny(const Mat &in, bool blurImage, bool useL2, int bins, float nonEd
 	 * Smoothing and directional derivatives
 	 * TODO: adapt sizes to image size
 	 */
-	Mat blurred;
 	if (blurImage) {
+		blurred = workspace.mat(WS_BLURRED, in.size(), in.type());
 		Size blurSize(5,5);
 		GaussianBlur(in, blurred, blurSize, 1.5, 1.5, BORDER_REPLICATE);
 	} else
 		blurred = in;
 
-	Sobel(blurred, dx, dx.type(), 1, 0, 7, 1, BORDER_REPLICATE);
-	Sobel(blurred, dy, dy.type(), 0, 1, 7, 1, BORDER_REPLICATE);
+	// Sized by prepareEdgeDetection(); anything else would silently reallocate (or overrun edgeType)
+	CV_Assert( dx.size() == in.size() && dy.size() == in.size() && magnitude.size() == in.size() );
+	CV_Assert( edgeType.size() == in.size() && edge.size() == in.size() );
 
 	/*
-	 *  Magnitude
+	 *  Derivatives and magnitude
+	 *  Done in bands of rows so that dx and dy are still cached when the
+	 *  magnitude is computed. Sobel reads the rows surrounding a band from the
+	 *  parent matrix, so the result is the same as for the whole image.
 	 */
-	double minMag = 0;
-	double maxMag = 0;
-	float *p_res;
-	float *p_x, *p_y; // result, x, y
+	const int bandRows = 32;
+	float maxMag = 0;
+	for (int r = 0; r < blurred.rows; r += bandRows) {
+		Range band(r, min<int>(r + bandRows, blurred.rows));
+		Mat dxBand = dx.rowRange(band);
+		Mat dyBand = dy.rowRange(band);
+		Sobel(blurred.rowRange(band), dxBand, CV_32F, 1, 0, 7, 1, BORDER_REPLICATE);
+		Sobel(blurred.rowRange(band), dyBand, CV_32F, 0, 1, 7, 1, BORDER_REPLICATE);
+		for (int i = band.start; i < band.end; i++)
+			maxMag = max<float>(maxMag, magnitudeRow(dx.ptr<float>(i), dy.ptr<float>(i), magnitude.ptr<float>(i), magnitude.cols) );
+	}
 
-	cv::magnitude(dx, dy, magnitude);
-	cv::minMaxLoc(magnitude, &minMag, &maxMag);
+	edgeType.setTo(0);
+	edge.setTo(0);
+	if (maxMag <= 0)
+		return edge;
 
 	/*
 	 *  Threshold selection based on the magnitude histogram
+	 *  The magnitude is not normalized; instead, the histogram bins and the
+	 *  thresholds are scaled by the maximum magnitude.
 	 */
 	float low_th = 0;
 	float high_th = 0;
 
-	// Normalization
-	magnitude = magnitude / maxMag;
-
 	// Histogram
-	int *histogram = new int[bins]();
-	Mat res_idx = (bins-1) * magnitude;
-	res_idx.convertTo(res_idx, CV_16U);
-	short *p_res_idx=0;
-	for(int i=0; i<res_idx.rows; i++){
-		p_res_idx = res_idx.ptr<short>(i);
-		for(int j=0; j<res_idx.cols; j++)
-			histogram[ p_res_idx[j] ]++;
-	}
+	cannyHistogram.assign(bins, 0);
+	int *histogram = cannyHistogram.data();
+	for (int i = 0; i < magnitude.rows; i++)
+		histogramRow(magnitude.ptr<float>(i), magnitude.cols, (bins-1) / maxMag, histogram);
 
 	// Ratio
 	int sum=0;
@@ -173,60 +305,15 @@ Mat PuRe::canny(const Mat &in, bool blurImage, bool useL2, int bins, float nonEd
 	}
 	low_th = lowHighThresholdRatio*high_th;
 
-	delete[] histogram;
-
 	/*
 	 *  Non maximum supression
 	 */
-	const float tg22_5 = 0.4142135623730950488016887242097f;
-	const float tg67_5 = 2.4142135623730950488016887242097f;
-	uchar *_edgeType;
-	float *p_res_b, *p_res_t;
-	edgeType.setTo(0);
-	for(int i=1; i<magnitude.rows-1; i++) {
-		_edgeType = edgeType.ptr<uchar>(i);
-
-		p_res=magnitude.ptr<float>(i);
-		p_res_t=magnitude.ptr<float>(i-1);
-		p_res_b=magnitude.ptr<float>(i+1);
-
-		p_x=dx.ptr<float>(i);
-		p_y=dy.ptr<float>(i);
-
-		for(int j=1; j<magnitude.cols-1; j++){
-
-			float m = p_res[j];
-			if (m < low_th)
-				continue;
-
-			float iy = p_y[j];
-			float ix = p_x[j];
-			float y  = abs( (double) iy );
-			float x  = abs( (double) ix );
-
-			uchar val = p_res[j] > high_th ? 255 : 128;
-
-			float tg22_5x = tg22_5 * x;
-			if (y < tg22_5x) {
-				if (m > p_res[j-1] && m >= p_res[j+1])
-					_edgeType[j] = val;
-			} else {
-				float tg67_5x = tg67_5 * x;
-				if (y > tg67_5x) {
-					if (m > p_res_b[j] && m >= p_res_t[j])
-						_edgeType[j] = val;
-				} else {
-					if ( (iy<=0) == (ix<=0) ) {
-						if ( m > p_res_t[j-1] && m >= p_res_b[j+1])
-							_edgeType[j] = val;
-					} else {
-						if ( m > p_res_b[j-1] && m >= p_res_t[j+1])
-							_edgeType[j] = val;
-					}
-				}
-			}
-		}
-	}
+	for(int i=1; i<magnitude.rows-1; i++)
+		nonMaximumSuppressionRow(
+			magnitude.ptr<float>(i-1), magnitude.ptr<float>(i), magnitude.ptr<float>(i+1),
+			dx.ptr<float>(i), dy.ptr<float>(i),
+			edgeType.ptr<uchar>(i), magnitude.cols,
+			low_th * maxMag, high_th * maxMag);
 
 	/*
 	 *  Hystheresis
@@ -237,8 +324,7 @@ Mat PuRe::canny(const Mat &in, bool blurImage, bool useL2, int bins, float nonEd
 	int lines_idx=0;
 	int idx=0;
 
-	vector<int> lines;
-	edge.setTo(0);
+	vector<int> &lines = hysteresisQueue;
 	for(int i=1;i<pic_y-1;i++){
 		for(int j=1;j<pic_x-1;j++){
 
@@ -277,265 +363,97 @@ Mat PuRe::canny(const Mat &in, bool blurImage, bool useL2, int bins, float nonEd
 
 void PuRe::filterEdges(cv::Mat &edges)
 {
-	// TODO: there is room for improvement here; however, it is prone to small
-	// mistakes; will be done when we have time
-	int start_x = 5;
-	int start_y = 5;
-	int end_x = edges.cols - 5;
-	int end_y = edges.rows - 5;
-
-	for(int j=start_y; j<end_y; j++)
-		for(int i=start_x; i<end_x; i++){
-			uchar box[9];
-
-			box[4]=(uchar)edges.data[(edges.cols*(j))+(i)];
-
-			if(box[4]){
-				box[1]=(uchar)edges.data[(edges.cols*(j-1))+(i)];
-				box[3]=(uchar)edges.data[(edges.cols*(j))+(i-1)];
-				box[5]=(uchar)edges.data[(edges.cols*(j))+(i+1)];
-				box[7]=(uchar)edges.data[(edges.cols*(j+1))+(i)];
-
-
-				if((box[5] && box[7])) edges.data[(edges.cols*(j))+(i)]=0;
-				if((box[5] && box[1])) edges.data[(edges.cols*(j))+(i)]=0;
-				if((box[3] && box[7])) edges.data[(edges.cols*(j))+(i)]=0;
-				if((box[3] && box[1])) edges.data[(edges.cols*(j))+(i)]=0;
-
-			}
-		}
-
-	//too many neigbours
-	for(int j=start_y; j<end_y; j++)
-		for(int i=start_x; i<end_x; i++){
-			uchar neig=0;
-
-			for(int k1=-1;k1<2;k1++)
-				for(int k2=-1;k2<2;k2++){
-
-					if(edges.data[(edges.cols*(j+k1))+(i+k2)]>0)
-						neig++;
-				}
-
-			if(neig>3)
-				edges.data[(edges.cols*(j))+(i)]=0;
-
-		}
-
-	for(int j=start_y; j<end_y; j++)
-		for(int i=start_x; i<end_x; i++){
-			uchar box[17];
-
-			box[4]=(uchar)edges.data[(edges.cols*(j))+(i)];
-
-			if(box[4]){
-				box[0]=(uchar)edges.data[(edges.cols*(j-1))+(i-1)];
-				box[1]=(uchar)edges.data[(edges.cols*(j-1))+(i)];
-				box[2]=(uchar)edges.data[(edges.cols*(j-1))+(i+1)];
-
-				box[3]=(uchar)edges.data[(edges.cols*(j))+(i-1)];
-				box[5]=(uchar)edges.data[(edges.cols*(j))+(i+1)];
-
-				box[6]=(uchar)edges.data[(edges.cols*(j+1))+(i-1)];
-				box[7]=(uchar)edges.data[(edges.cols*(j+1))+(i)];
-				box[8]=(uchar)edges.data[(edges.cols*(j+1))+(i+1)];
-
-				//external
-				box[9]=(uchar)edges.data[(edges.cols*(j))+(i+2)];
-				box[10]=(uchar)edges.data[(edges.cols*(j+2))+(i)];
-
-
-				box[11]=(uchar)edges.data[(edges.cols*(j))+(i+3)];
-				box[12]=(uchar)edges.data[(edges.cols*(j-1))+(i+2)];
-				box[13]=(uchar)edges.data[(edges.cols*(j+1))+(i+2)];
-
-
-				box[14]=(uchar)edges.data[(edges.cols*(j+3))+(i)];
-				box[15]=(uchar)edges.data[(edges.cols*(j+2))+(i-1)];
-				box[16]=(uchar)edges.data[(edges.cols*(j+2))+(i+1)];
-
-
-
-				if( (box[10] && !box[7]) && (box[8] || box[6]) ){
-					edges.data[(edges.cols*(j+1))+(i-1)]=0;
-					edges.data[(edges.cols*(j+1))+(i+1)]=0;
-					edges.data[(edges.cols*(j+1))+(i)]=255;
-				}
-
-
-				if( (box[14] && !box[7] && !box[10]) && ( (box[8] || box[6]) && (box[16] || box[15]) ) ){
-					edges.data[(edges.cols*(j+1))+(i+1)]=0;
-					edges.data[(edges.cols*(j+1))+(i-1)]=0;
-					edges.data[(edges.cols*(j+2))+(i+1)]=0;
-					edges.data[(edges.cols*(j+2))+(i-1)]=0;
-					edges.data[(edges.cols*(j+1))+(i)]=255;
-					edges.data[(edges.cols*(j+2))+(i)]=255;
-				}
-
-
-
-				if( (box[9] && !box[5]) && (box[8] || box[2]) ){
-					edges.data[(edges.cols*(j+1))+(i+1)]=0;
-					edges.data[(edges.cols*(j-1))+(i+1)]=0;
-					edges.data[(edges.cols*(j))+(i+1)]=255;
-				}
-
-
-				if( (box[11] && !box[5] && !box[9]) && ( (box[8] || box[2]) && (box[13] || box[12]) ) ){
-					edges.data[(edges.cols*(j+1))+(i+1)]=0;
-					edges.data[(edges.cols*(j-1))+(i+1)]=0;
-					edges.data[(edges.cols*(j+1))+(i+2)]=0;
-					edges.data[(edges.cols*(j-1))+(i+2)]=0;
-					edges.data[(edges.cols*(j))+(i+1)]=255;
-					edges.data[(edges.cols*(j))+(i+2)]=255;
-				}
-
-			}
-		}
-
-	for(int j=start_y; j<end_y; j++)
-		for(int i=start_x; i<end_x; i++){
-
-			uchar box[33];
-
-			box[4]=(uchar)edges.data[(edges.cols*(j))+(i)];
-
-			if(box[4]){
-				box[0]=(uchar)edges.data[(edges.cols*(j-1))+(i-1)];
-				box[1]=(uchar)edges.data[(edges.cols*(j-1))+(i)];
-				box[2]=(uchar)edges.data[(edges.cols*(j-1))+(i+1)];
-
-				box[3]=(uchar)edges.data[(edges.cols*(j))+(i-1)];
-				box[5]=(uchar)edges.data[(edges.cols*(j))+(i+1)];
-
-				box[6]=(uchar)edges.data[(edges.cols*(j+1))+(i-1)];
-				box[7]=(uchar)edges.data[(edges.cols*(j+1))+(i)];
-				box[8]=(uchar)edges.data[(edges.cols*(j+1))+(i+1)];
-
-				box[9]=(uchar)edges.data[(edges.cols*(j-1))+(i+2)];
-				box[10]=(uchar)edges.data[(edges.cols*(j-1))+(i-2)];
-				box[11]=(uchar)edges.data[(edges.cols*(j+1))+(i+2)];
-				box[12]=(uchar)edges.data[(edges.cols*(j+1))+(i-2)];
-
-				box[13]=(uchar)edges.data[(edges.cols*(j-2))+(i-1)];
-				box[14]=(uchar)edges.data[(edges.cols*(j-2))+(i+1)];
-				box[15]=(uchar)edges.data[(edges.cols*(j+2))+(i-1)];
-				box[16]=(uchar)edges.data[(edges.cols*(j+2))+(i+1)];
-
-				box[17]=(uchar)edges.data[(edges.cols*(j-3))+(i-1)];
-				box[18]=(uchar)edges.data[(edges.cols*(j-3))+(i+1)];
-				box[19]=(uchar)edges.data[(edges.cols*(j+3))+(i-1)];
-				box[20]=(uchar)edges.data[(edges.cols*(j+3))+(i+1)];
-
-				box[21]=(uchar)edges.data[(edges.cols*(j+1))+(i+3)];
-				box[22]=(uchar)edges.data[(edges.cols*(j+1))+(i-3)];
-				box[23]=(uchar)edges.data[(edges.cols*(j-1))+(i+3)];
-				box[24]=(uchar)edges.data[(edges.cols*(j-1))+(i-3)];
-
-				box[25]=(uchar)edges.data[(edges.cols*(j-2))+(i-2)];
-				box[26]=(uchar)edges.data[(edges.cols*(j+2))+(i+2)];
-				box[27]=(uchar)edges.data[(edges.cols*(j-2))+(i+2)];
-				box[28]=(uchar)edges.data[(edges.cols*(j+2))+(i-2)];
-
-				box[29]=(uchar)edges.data[(edges.cols*(j-3))+(i-3)];
-				box[30]=(uchar)edges.data[(edges.cols*(j+3))+(i+3)];
-				box[31]=(uchar)edges.data[(edges.cols*(j-3))+(i+3)];
-				box[32]=(uchar)edges.data[(edges.cols*(j+3))+(i-3)];
-
-				if( box[7] && box[2] && box[9] )
-					edges.data[(edges.cols*(j))+(i)]=0;
-				if( box[7] && box[0] && box[10] )
-					edges.data[(edges.cols*(j))+(i)]=0;
-				if( box[1] && box[8] && box[11] )
-					edges.data[(edges.cols*(j))+(i)]=0;
-				if( box[1] && box[6] && box[12] )
-					edges.data[(edges.cols*(j))+(i)]=0;
-
-				if( box[0] && box[13] && box[17] && box[8] && box[11] && box[21] )
-					edges.data[(edges.cols*(j))+(i)]=0;
-				if( box[2] && box[14] && box[18] && box[6] && box[12] && box[22] )
-					edges.data[(edges.cols*(j))+(i)]=0;
-				if( box[6] && box[15] && box[19] && box[2] && box[9] && box[23] )
-					edges.data[(edges.cols*(j))+(i)]=0;
-				if( box[8] && box[16] && box[20] && box[0] && box[10] && box[24] )
-					edges.data[(edges.cols*(j))+(i)]=0;
-
-				if( box[0] && box[25] && box[2] && box[27] )
-					edges.data[(edges.cols*(j))+(i)]=0;
-				if( box[0] && box[25] && box[6] && box[28] )
-					edges.data[(edges.cols*(j))+(i)]=0;
-				if( box[8] && box[26] && box[2] && box[27] )
-					edges.data[(edges.cols*(j))+(i)]=0;
-				if( box[8] && box[26] && box[6] && box[28] )
-					edges.data[(edges.cols*(j))+(i)]=0;
-
-				uchar box2[18];
-				box2[1]=(uchar)edges.data[(edges.cols*(j))+(i-1)];
-
-				box2[2]=(uchar)edges.data[(edges.cols*(j-1))+(i-2)];
-				box2[3]=(uchar)edges.data[(edges.cols*(j-2))+(i-3)];
-
-				box2[4]=(uchar)edges.data[(edges.cols*(j-1))+(i+1)];
-				box2[5]=(uchar)edges.data[(edges.cols*(j-2))+(i+2)];
-
-				box2[6]=(uchar)edges.data[(edges.cols*(j+1))+(i-2)];
-				box2[7]=(uchar)edges.data[(edges.cols*(j+2))+(i-3)];
-
-				box2[8]=(uchar)edges.data[(edges.cols*(j+1))+(i+1)];
-				box2[9]=(uchar)edges.data[(edges.cols*(j+2))+(i+2)];
-
-				box2[10]=(uchar)edges.data[(edges.cols*(j+1))+(i)];
-
-				box2[15]=(uchar)edges.data[(edges.cols*(j-1))+(i-1)];
-				box2[16]=(uchar)edges.data[(edges.cols*(j-2))+(i-2)];
-
-				box2[11]=(uchar)edges.data[(edges.cols*(j+2))+(i+1)];
-				box2[12]=(uchar)edges.data[(edges.cols*(j+3))+(i+2)];
-
-				box2[13]=(uchar)edges.data[(edges.cols*(j+2))+(i-1)];
-				box2[14]=(uchar)edges.data[(edges.cols*(j+3))+(i-2)];
-
-				if( box2[1] && box2[2] && box2[3] && box2[4] && box2[5] )
-					edges.data[(edges.cols*(j))+(i)]=0;
-				if( box2[1] && box2[6] && box2[7] && box2[8] && box2[9] )
-					edges.data[(edges.cols*(j))+(i)]=0;
-				if( box2[10] && box2[11] && box2[12] && box2[4] && box2[5] )
-					edges.data[(edges.cols*(j))+(i)]=0;
-				if( box2[10] && box2[13] && box2[14] && box2[15] && box2[16] )
-					edges.data[(edges.cols*(j))+(i)]=0;
-			}
-
-		}
+	EdgeFilter::pure(edges, Rect(5, 5, edges.cols - 10, edges.rows - 10));
 }
 
-void PuRe::findPupilEdgeCandidates(const Mat &intensityImage, Mat &edge, vector<PupilCandidate> &candidates)
+void PuRe::findPupilEdgeCandidates(const Mat &intensityImage, Mat &edge, vector<PupilCandidate> &candidates, const Deadline &deadline)
 {
 	/* Find all lines
 	 * Small note here: using anchor points tends to result in better ellipse fitting later!
 	 * It's also faster than doing connected components and collecting the labels
 	 */
-	vector<Vec4i> hierarchy;
-	vector<vector<Point> > curves;
-	findContours( edge, curves, hierarchy, CV_RETR_LIST, CV_CHAIN_APPROX_TC89_KCOS );
+	contours.find( edge, CV_CHAIN_APPROX_TC89_KCOS );
 
-	removeDuplicates(curves, edge.cols);
+	contours.removeDuplicates(edge.size());
+
+	candidateOrder.clear();
+	for (size_t i=contours.size(); i-->0;)
+		candidateOrder.push_back(i);
+
+	// With a budget, the longest segments (the likeliest pupil outlines) go
+	// first so that whatever is left out when time runs out matters least
+	if (deadline.isSet())
+		stable_sort(candidateOrder.begin(), candidateOrder.end(), [&](const size_t &a, const size_t &b) { return contours[a].size() > contours[b].size(); } );
 
 	// Create valid candidates
-	for (size_t i=curves.size(); i-->0;) {
-		PupilCandidate candidate(curves[i]);
+	for (auto i=candidateOrder.begin(); i!=candidateOrder.end(); i++) {
+		if (deadline.expired())
+			break;
+		PupilCandidate candidate( contours[*i] );
 		if (candidate.isValid(intensityImage, minPupilDiameterPx, maxPupilDiameterPx, outlineBias))
 			candidates.push_back( candidate );
 	}
+
+	// Back to the regular order so the selection matches the unbudgeted run;
+	// contours are stored consecutively, so their addresses give that order
+	if (deadline.isSet())
+		sort(candidates.begin(), candidates.end(), [](const PupilCandidate &a, const PupilCandidate &b) { return a.points.begin() > b.points.begin(); } );
 }
 
-void PuRe::combineEdgeCandidates(const cv::Mat &intensityImage, cv::Mat &edge, std::vector<PupilCandidate> &candidates)
+void PuRe::findCombinationPairs(const std::vector<PupilCandidate> &candidates, const cv::Size &size)
 {
-	(void) edge;
-	if (candidates.size() <= 1)
-		return;
-	vector<PupilCandidate> mergedCandidates;
-	for (auto pc=candidates.begin(); pc!=candidates.end(); pc++) {
-		for (auto pc2=pc+1; pc2!=candidates.end(); pc2++) {
+	// Bucket the combination regions into a uniform grid (CSR layout)
+	const int cell = 32;
+	const int gridCols = max<int>(1, (size.width + cell - 1) / cell);
+	const int gridRows = max<int>(1, (size.height + cell - 1) / cell);
+	auto cells = [&](const Rect &r, int &x0, int &x1, int &y0, int &y1) {
+		// Clamping keeps regions that share a pixel in a shared cell, even
+		// if they extend beyond the image
+		x0 = min<int>( max<int>(r.x / cell, 0), gridCols-1 );
+		x1 = min<int>( max<int>((r.x + r.width - 1) / cell, 0), gridCols-1 );
+		y0 = min<int>( max<int>(r.y / cell, 0), gridRows-1 );
+		y1 = min<int>( max<int>((r.y + r.height - 1) / cell, 0), gridRows-1 );
+	};
+
+	int x0, x1, y0, y1;
+	gridCellStart.assign(gridCols*gridRows + 1, 0);
+	for (size_t i=0; i<candidates.size(); i++) {
+		cells(candidates[i].combinationRegion, x0, x1, y0, y1);
+		for (int y=y0; y<=y1; y++)
+			for (int x=x0; x<=x1; x++)
+				gridCellStart[y*gridCols + x + 1]++;
+	}
+	for (size_t c=1; c<gridCellStart.size(); c++)
+		gridCellStart[c] += gridCellStart[c-1];
+	gridItems.resize(gridCellStart.back());
+	gridCellFill.assign(gridCellStart.begin(), gridCellStart.end()-1);
+	for (size_t i=0; i<candidates.size(); i++) {
+		cells(candidates[i].combinationRegion, x0, x1, y0, y1);
+		for (int y=y0; y<=y1; y++)
+			for (int x=x0; x<=x1; x++)
+				gridItems[ gridCellFill[y*gridCols + x]++ ] = (int) i;
+	}
+
+	// Same pairs, in the same order, as testing all of them
+	combinationPairs.clear();
+	pairStamp.assign(candidates.size(), -1);
+	for (int i=0; i<(int) candidates.size(); i++) {
+		const PupilCandidate *pc = &candidates[i];
+		neighbors.clear();
+		cells(pc->combinationRegion, x0, x1, y0, y1);
+		for (int y=y0; y<=y1; y++)
+			for (int x=x0; x<=x1; x++)
+				for (int k=gridCellStart[y*gridCols + x]; k<gridCellStart[y*gridCols + x + 1]; k++) {
+					int j = gridItems[k];
+					if (j > i && pairStamp[j] != i) {
+						pairStamp[j] = i;
+						neighbors.push_back(j);
+					}
+				}
+		sort(neighbors.begin(), neighbors.end());
+
+		for (auto j=neighbors.begin(); j!=neighbors.end(); j++) {
+			const PupilCandidate *pc2 = &candidates[*j];
 
 			Rect intersection = pc->combinationRegion & pc2->combinationRegion;
 			if (intersection.area() < 1)
@@ -543,7 +461,7 @@ void PuRe::combineEdgeCandidates(const cv::Mat &intensityImage, cv::Mat &edge, s
 //#define DBG_EDGE_COMBINATION
 #ifdef DBG_EDGE_COMBINATION
 			Mat tmp;
-			cvtColor(intensityImage, tmp, CV_GRAY2BGR);
+			cvtColor(input, tmp, CV_GRAY2BGR);
 			rectangle(tmp, pc->combinationRegion, pc->color);
 			for (unsigned int i=0; i<pc->points.size(); i++)
 				cv::circle(tmp, pc->points[i], 1, pc->color, -1);
@@ -558,26 +476,83 @@ void PuRe::combineEdgeCandidates(const cv::Mat &intensityImage, cv::Mat &edge, s
 			if (intersection.area() >= min<int>(pc->combinationRegion.area(),pc2->combinationRegion.area()))
 				continue;
 
-			vector<Point> mergedPoints = pc->points;
-			mergedPoints.insert(mergedPoints.end(), pc2->points.begin(), pc2->points.end());
-			PupilCandidate candidate( mergedPoints );
-			if (!candidate.isValid(intensityImage, minPupilDiameterPx, maxPupilDiameterPx, outlineBias))
-				continue;
-			if (candidate.outlineContrast < pc->outlineContrast || candidate.outlineContrast < pc2->outlineContrast)
-				continue;
-			mergedCandidates.push_back( candidate );
+			combinationPairs.push_back( {i, *j} );
 		}
 	}
-	candidates.insert( candidates.end(), mergedCandidates.begin(), mergedCandidates.end() );
 }
 
-void PuRe::searchInnerCandidates(vector<PupilCandidate> &candidates, PupilCandidate &candidate)
+void PuRe::combineEdgeCandidates(const cv::Mat &intensityImage, cv::Mat &edge, std::vector<PupilCandidate> &candidates, const Deadline &deadline)
 {
 	if (candidates.size() <= 1)
 		return;
+	if (deadline.expired())
+		return;
 
+	findCombinationPairs(candidates, edge.size());
+
+	WorkerPool &pool = WorkerPool::shared();
+	if (combinationWorkers.size() < (size_t) pool.maxWorkers())
+		combinationWorkers.resize(pool.maxWorkers());
+	for (auto w=combinationWorkers.begin(); w!=combinationWorkers.end(); w++) {
+		w->points.clear();
+		w->merges.clear();
+	}
+
+	pool.run( (int) combinationPairs.size(), [&](const int &worker, const int &pair) {
+		if (deadline.expired())
+			return;
+		CombinationWorker &w = combinationWorkers[worker];
+		const PupilCandidate *pc = &candidates[ combinationPairs[pair].first ];
+		const PupilCandidate *pc2 = &candidates[ combinationPairs[pair].second ];
+
+		// isValid() recomputes everything it checks, so the scratch candidate
+		// (and its point storage) can be reused; only accepted ones are copied
+		PupilCandidate &candidate = w.scratch;
+		w.scratchPoints.assign(pc->points.begin(), pc->points.end());
+		w.scratchPoints.insert(w.scratchPoints.end(), pc2->points.begin(), pc2->points.end());
+		candidate.points = PointSpan(w.scratchPoints);
+		if (!candidate.isValid(intensityImage, minPupilDiameterPx, maxPupilDiameterPx, outlineBias))
+			return;
+		if (candidate.outlineContrast < pc->outlineContrast || candidate.outlineContrast < pc2->outlineContrast)
+			return;
+		w.merges.push_back( { pair, worker, w.points.size(), candidate } );
+		w.points.insert( w.points.end(), w.scratchPoints.begin(), w.scratchPoints.end() );
+	});
+
+	// Reduce in pair order, so the result doesn't depend on scheduling
+	mergeOrder.clear();
+	for (auto w=combinationWorkers.begin(); w!=combinationWorkers.end(); w++)
+		for (auto m=w->merges.begin(); m!=w->merges.end(); m++)
+			mergeOrder.push_back( &(*m) );
+	sort(mergeOrder.begin(), mergeOrder.end(), [](const Merge *a, const Merge *b) { return a->pair < b->pair; } );
+
+	size_t total = 0;
+	for (auto m=mergeOrder.begin(); m!=mergeOrder.end(); m++)
+		total += (*m)->candidate.points.size();
+	mergedPoints.resize(total); // no longer grows; spans may point into it
+
+	mergedCandidates.clear();
+	size_t offset = 0;
+	for (auto m=mergeOrder.begin(); m!=mergeOrder.end(); m++) {
+		const Merge &merge = **m;
+		const size_t count = merge.candidate.points.size();
+		const cv::Point *source = &combinationWorkers[merge.worker].points[merge.offset];
+		std::copy(source, source + count, &mergedPoints[offset]);
+		mergedCandidates.push_back( merge.candidate );
+		mergedCandidates.back().points = PointSpan(&mergedPoints[offset], count);
+		offset += count;
+	}
+	candidates.insert( candidates.end(), mergedCandidates.begin(), mergedCandidates.end() );
+}
+
+const PupilCandidate* PuRe::searchInnerCandidates(const vector<PupilCandidate> &candidates, const PupilCandidate &candidate)
+{
+	if (candidates.size() <= 1)
+		return &candidate;
+
+	// Highest scoring insider; on ties, the last one wins
 	float searchRadius = 0.5*candidate.majorAxis;
-	vector<PupilCandidate> insiders;
+	const PupilCandidate *best = NULL;
 	for (auto pc=candidates.begin(); pc!=candidates.end(); pc++) {
 		if (searchRadius < pc->majorAxis)
 			continue;
@@ -585,22 +560,22 @@ void PuRe::searchInnerCandidates(vector<PupilCandidate> &candidates, PupilCandid
 			continue;
 		if (pc->outlineContrast < 0.75)
 			continue;
-		insiders.push_back(*pc);
+		if (!best || !(*pc < *best))
+			best = &(*pc);
 	}
-	if (insiders.size() <= 0) {
+	if (!best) {
 		//ellipse(dbg, candidate.outline, Scalar(0,255,0));
-		return;
+		return &candidate;
 	}
 
-	sort( insiders.begin(), insiders.end() );
-	candidate = insiders.back();
+	return best;
 
 	//circle(dbg, searchCenter, searchRadius, Scalar(0,0,255),3);
 	//candidate.draw(dbg);
 	//imshow("dbg", dbg);
 }
 
-void PuRe::detect(Pupil &pupil)
+void PuRe::detect(Pupil &pupil, const Deadline &deadline)
 {
 	// 3.2 Edge Detection and Morphological Transformation
 	Mat detectedEdges = canny(input, true, true, 64, 0.7f, 0.4f);
@@ -612,8 +587,8 @@ void PuRe::detect(Pupil &pupil)
 	filterEdges(detectedEdges);
 
 	// 3.3 Segment Selection
-	vector<PupilCandidate> candidates;
-	findPupilEdgeCandidates(input, detectedEdges, candidates);
+	candidates.clear();
+	findPupilEdgeCandidates(input, detectedEdges, candidates, deadline);
 	if (candidates.size() <= 0)
 		return;
 
@@ -638,7 +613,7 @@ void PuRe::detect(Pupil &pupil)
 #endif
 
 	// Combination
-	combineEdgeCandidates(input, detectedEdges, candidates);
+	combineEdgeCandidates(input, detectedEdges, candidates, deadline);
 	for (auto c=candidates.begin(); c!=candidates.end(); c++) {
 		if (c->outlineContrast < 0.5)
 			c->score = 0;
@@ -662,16 +637,15 @@ void PuRe::detect(Pupil &pupil)
 
 	// Scoring
 	sort( candidates.begin(), candidates.end() );
-	PupilCandidate selected = candidates.back();
 
 	//for ( auto c = candidates.begin(); c != candidates.end(); c++)
 	//    c->draw(dbg);
 
 	// Post processing
-	searchInnerCandidates(candidates, selected);
+	const PupilCandidate *selected = searchInnerCandidates(candidates, candidates.back());
 
-	pupil = selected.outline;
-	pupil.confidence = selected.outlineContrast;
+	pupil = selected->outline;
+	pupil.confidence = selected->outlineContrast;
 
 #ifdef SAVE_ILLUSTRATION
 	Mat out;
@@ -683,6 +657,16 @@ void PuRe::detect(Pupil &pupil)
 #endif
 }
 
+void PuRe::prepareEdgeDetection(const cv::Size &size)
+{
+	// canny() overwrites these completely, so there is no need to zero them
+	dx = workspace.mat(WS_DX, size, CV_32F);
+	dy = workspace.mat(WS_DY, size, CV_32F);
+	magnitude = workspace.mat(WS_MAGNITUDE, size, CV_32F);
+	edgeType = workspace.mat(WS_EDGE_TYPE, size, CV_8U);
+	edge = workspace.mat(WS_EDGE, size, CV_8U);
+}
+
 void PuRe::run(const Mat &frame, Pupil &pupil)
 {
 	pupil.clear();
@@ -690,22 +674,21 @@ void PuRe::run(const Mat &frame, Pupil &pupil)
 	init(frame);
 
 	// Downscaling
-	Mat downscaled = frame;
+	Size scaledSize( saturate_cast<int>(frame.cols*(double)scalingRatio), saturate_cast<int>(frame.rows*(double)scalingRatio) );
+	Mat downscaled = workspace.mat(WS_DOWNSCALED, scaledSize, frame.type());
+	input = workspace.mat(WS_INPUT, scaledSize, CV_8U);
 	resize(frame, downscaled, Size(), scalingRatio, scalingRatio, CV_INTER_LINEAR);
 	normalize(downscaled, input, 0, 255, NORM_MINMAX, CV_8U);
 
-	workingSize.width = floor(scalingRatio*frame.cols);
-	workingSize.height = floor(scalingRatio*frame.rows);
-
 	// Estimate parameters based on the working size
-	estimateParameters(workingSize.height, workingSize.width);
+	estimateParameters(floor(scalingRatio*frame.rows), floor(scalingRatio*frame.cols));
+
+	// The input is rounded rather than truncated, so the edge buffers follow it
+	workingSize.width = input.cols;
+	workingSize.height = input.rows;
 
 	// Preallocate stuff for edge detection
-	dx = Mat::zeros(workingSize, CV_32F);
-	dy = Mat::zeros(workingSize, CV_32F);
-	magnitude = Mat::zeros(workingSize, CV_32F);
-	edgeType = Mat::zeros(workingSize, CV_8U);
-	edge = Mat::zeros(workingSize, CV_8U);
+	prepareEdgeDetection(workingSize);
 
 	//cvtColor(input, dbg, CV_GRAY2BGR);
 	//circle(dbg, Point(0.5*dbg.cols,0.5*dbg.rows), 0.5*minPupilDiameterPx, Scalar(0,0,0), 2);
@@ -719,7 +702,7 @@ void PuRe::run(const Mat &frame, Pupil &pupil)
 	//imshow("dbg", dbg);
 }
 
-void PuRe::run(const cv::Mat &frame, const cv::Rect &roi, Pupil &pupil, const float &userMinPupilDiameterPx, const float &userMaxPupilDiameterPx)
+void PuRe::run(const cv::Mat &frame, const cv::Rect &roi, Pupil &pupil, const float &userMinPupilDiameterPx, const float &userMaxPupilDiameterPx, const Deadline &deadline)
 {
 	if (roi.area() < 10) {
 		qWarning() << "Bad ROI: falling back to regular detection.";
@@ -738,7 +721,9 @@ void PuRe::run(const cv::Mat &frame, const cv::Rect &roi, Pupil &pupil, const fl
 		maxPupilDiameterPx = scalingRatio*userMaxPupilDiameterPx;
 
 	// Downscaling
-	Mat downscaled;
+	Size scaledSize( saturate_cast<int>(roi.width*(double)scalingRatio), saturate_cast<int>(roi.height*(double)scalingRatio) );
+	Mat downscaled = workspace.mat(WS_DOWNSCALED, scaledSize, frame.type());
+	input = workspace.mat(WS_INPUT, scaledSize, CV_8U);
 	resize(frame(roi), downscaled, Size(), scalingRatio, scalingRatio, CV_INTER_LINEAR);
 	normalize(downscaled, input, 0, 255, NORM_MINMAX, CV_8U);
 
@@ -748,18 +733,14 @@ void PuRe::run(const cv::Mat &frame, const cv::Rect &roi, Pupil &pupil, const fl
 	workingSize.height = input.rows;
 
 	// Preallocate stuff for edge detection
-	dx = Mat::zeros(workingSize, CV_32F);
-	dy = Mat::zeros(workingSize, CV_32F);
-	magnitude = Mat::zeros(workingSize, CV_32F);
-	edgeType = Mat::zeros(workingSize, CV_8U);
-	edge = Mat::zeros(workingSize, CV_8U);
+	prepareEdgeDetection(workingSize);
 
 	//cvtColor(input, dbg, CV_GRAY2BGR);
 	//circle(dbg, Point(0.5*dbg.cols,0.5*dbg.rows), 0.5*minPupilDiameterPx, Scalar(0,0,0), 2);
 	//circle(dbg, Point(0.5*dbg.cols,0.5*dbg.rows), 0.5*maxPupilDiameterPx, Scalar(0,0,0), 3);
 
 	// Detection
-	detect(pupil);
+	detect(pupil, deadline);
 
 	pupil.resize( 1.0 / scalingRatio, 1.0 / scalingRatio );
 
@@ -773,124 +754,27 @@ void PuRe::run(const cv::Mat &frame, const cv::Rect &roi, Pupil &pupil, const fl
  *
  ******************************************************************************/
 
-static const float sinTable[] = {
-	0.0000000f  , 0.0174524f  , 0.0348995f  , 0.0523360f  , 0.0697565f  , 0.0871557f  ,
-	0.1045285f  , 0.1218693f  , 0.1391731f  , 0.1564345f  , 0.1736482f  , 0.1908090f  ,
-	0.2079117f  , 0.2249511f  , 0.2419219f  , 0.2588190f  , 0.2756374f  , 0.2923717f  ,
-	0.3090170f  , 0.3255682f  , 0.3420201f  , 0.3583679f  , 0.3746066f  , 0.3907311f  ,
-	0.4067366f  , 0.4226183f  , 0.4383711f  , 0.4539905f  , 0.4694716f  , 0.4848096f  ,
-	0.5000000f  , 0.5150381f  , 0.5299193f  , 0.5446390f  , 0.5591929f  , 0.5735764f  ,
-	0.5877853f  , 0.6018150f  , 0.6156615f  , 0.6293204f  , 0.6427876f  , 0.6560590f  ,
-	0.6691306f  , 0.6819984f  , 0.6946584f  , 0.7071068f  , 0.7193398f  , 0.7313537f  ,
-	0.7431448f  , 0.7547096f  , 0.7660444f  , 0.7771460f  , 0.7880108f  , 0.7986355f  ,
-	0.8090170f  , 0.8191520f  , 0.8290376f  , 0.8386706f  , 0.8480481f  , 0.8571673f  ,
-	0.8660254f  , 0.8746197f  , 0.8829476f  , 0.8910065f  , 0.8987940f  , 0.9063078f  ,
-	0.9135455f  , 0.9205049f  , 0.9271839f  , 0.9335804f  , 0.9396926f  , 0.9455186f  ,
-	0.9510565f  , 0.9563048f  , 0.9612617f  , 0.9659258f  , 0.9702957f  , 0.9743701f  ,
-	0.9781476f  , 0.9816272f  , 0.9848078f  , 0.9876883f  , 0.9902681f  , 0.9925462f  ,
-	0.9945219f  , 0.9961947f  , 0.9975641f  , 0.9986295f  , 0.9993908f  , 0.9998477f  ,
-	1.0000000f  , 0.9998477f  , 0.9993908f  , 0.9986295f  , 0.9975641f  , 0.9961947f  ,
-	0.9945219f  , 0.9925462f  , 0.9902681f  , 0.9876883f  , 0.9848078f  , 0.9816272f  ,
-	0.9781476f  , 0.9743701f  , 0.9702957f  , 0.9659258f  , 0.9612617f  , 0.9563048f  ,
-	0.9510565f  , 0.9455186f  , 0.9396926f  , 0.9335804f  , 0.9271839f  , 0.9205049f  ,
-	0.9135455f  , 0.9063078f  , 0.8987940f  , 0.8910065f  , 0.8829476f  , 0.8746197f  ,
-	0.8660254f  , 0.8571673f  , 0.8480481f  , 0.8386706f  , 0.8290376f  , 0.8191520f  ,
-	0.8090170f  , 0.7986355f  , 0.7880108f  , 0.7771460f  , 0.7660444f  , 0.7547096f  ,
-	0.7431448f  , 0.7313537f  , 0.7193398f  , 0.7071068f  , 0.6946584f  , 0.6819984f  ,
-	0.6691306f  , 0.6560590f  , 0.6427876f  , 0.6293204f  , 0.6156615f  , 0.6018150f  ,
-	0.5877853f  , 0.5735764f  , 0.5591929f  , 0.5446390f  , 0.5299193f  , 0.5150381f  ,
-	0.5000000f  , 0.4848096f  , 0.4694716f  , 0.4539905f  , 0.4383711f  , 0.4226183f  ,
-	0.4067366f  , 0.3907311f  , 0.3746066f  , 0.3583679f  , 0.3420201f  , 0.3255682f  ,
-	0.3090170f  , 0.2923717f  , 0.2756374f  , 0.2588190f  , 0.2419219f  , 0.2249511f  ,
-	0.2079117f  , 0.1908090f  , 0.1736482f  , 0.1564345f  , 0.1391731f  , 0.1218693f  ,
-	0.1045285f  , 0.0871557f  , 0.0697565f  , 0.0523360f  , 0.0348995f  , 0.0174524f  ,
-	0.0000000f  , -0.0174524f , -0.0348995f , -0.0523360f , -0.0697565f , -0.0871557f ,
-	-0.1045285f , -0.1218693f , -0.1391731f , -0.1564345f , -0.1736482f , -0.1908090f ,
-	-0.2079117f , -0.2249511f , -0.2419219f , -0.2588190f , -0.2756374f , -0.2923717f ,
-	-0.3090170f , -0.3255682f , -0.3420201f , -0.3583679f , -0.3746066f , -0.3907311f ,
-	-0.4067366f , -0.4226183f , -0.4383711f , -0.4539905f , -0.4694716f , -0.4848096f ,
-	-0.5000000f , -0.5150381f , -0.5299193f , -0.5446390f , -0.5591929f , -0.5735764f ,
-	-0.5877853f , -0.6018150f , -0.6156615f , -0.6293204f , -0.6427876f , -0.6560590f ,
-	-0.6691306f , -0.6819984f , -0.6946584f , -0.7071068f , -0.7193398f , -0.7313537f ,
-	-0.7431448f , -0.7547096f , -0.7660444f , -0.7771460f , -0.7880108f , -0.7986355f ,
-	-0.8090170f , -0.8191520f , -0.8290376f , -0.8386706f , -0.8480481f , -0.8571673f ,
-	-0.8660254f , -0.8746197f , -0.8829476f , -0.8910065f , -0.8987940f , -0.9063078f ,
-	-0.9135455f , -0.9205049f , -0.9271839f , -0.9335804f , -0.9396926f , -0.9455186f ,
-	-0.9510565f , -0.9563048f , -0.9612617f , -0.9659258f , -0.9702957f , -0.9743701f ,
-	-0.9781476f , -0.9816272f , -0.9848078f , -0.9876883f , -0.9902681f , -0.9925462f ,
-	-0.9945219f , -0.9961947f , -0.9975641f , -0.9986295f , -0.9993908f , -0.9998477f ,
-	-1.0000000f , -0.9998477f , -0.9993908f , -0.9986295f , -0.9975641f , -0.9961947f ,
-	-0.9945219f , -0.9925462f , -0.9902681f , -0.9876883f , -0.9848078f , -0.9816272f ,
-	-0.9781476f , -0.9743701f , -0.9702957f , -0.9659258f , -0.9612617f , -0.9563048f ,
-	-0.9510565f , -0.9455186f , -0.9396926f , -0.9335804f , -0.9271839f , -0.9205049f ,
-	-0.9135455f , -0.9063078f , -0.8987940f , -0.8910065f , -0.8829476f , -0.8746197f ,
-	-0.8660254f , -0.8571673f , -0.8480481f , -0.8386706f , -0.8290376f , -0.8191520f ,
-	-0.8090170f , -0.7986355f , -0.7880108f , -0.7771460f , -0.7660444f , -0.7547096f ,
-	-0.7431448f , -0.7313537f , -0.7193398f , -0.7071068f , -0.6946584f , -0.6819984f ,
-	-0.6691306f , -0.6560590f , -0.6427876f , -0.6293204f , -0.6156615f , -0.6018150f ,
-	-0.5877853f , -0.5735764f , -0.5591929f , -0.5446390f , -0.5299193f , -0.5150381f ,
-	-0.5000000f , -0.4848096f , -0.4694716f , -0.4539905f , -0.4383711f , -0.4226183f ,
-	-0.4067366f , -0.3907311f , -0.3746066f , -0.3583679f , -0.3420201f , -0.3255682f ,
-	-0.3090170f , -0.2923717f , -0.2756374f , -0.2588190f , -0.2419219f , -0.2249511f ,
-	-0.2079117f , -0.1908090f , -0.1736482f , -0.1564345f , -0.1391731f , -0.1218693f ,
-	-0.1045285f , -0.0871557f , -0.0697565f , -0.0523360f , -0.0348995f , -0.0174524f ,
-	-0.0000000f , 0.0174524f  , 0.0348995f  , 0.0523360f  , 0.0697565f  , 0.0871557f  ,
-	0.1045285f  , 0.1218693f  , 0.1391731f  , 0.1564345f  , 0.1736482f  , 0.1908090f  ,
-	0.2079117f  , 0.2249511f  , 0.2419219f  , 0.2588190f  , 0.2756374f  , 0.2923717f  ,
-	0.3090170f  , 0.3255682f  , 0.3420201f  , 0.3583679f  , 0.3746066f  , 0.3907311f  ,
-	0.4067366f  , 0.4226183f  , 0.4383711f  , 0.4539905f  , 0.4694716f  , 0.4848096f  ,
-	0.5000000f  , 0.5150381f  , 0.5299193f  , 0.5446390f  , 0.5591929f  , 0.5735764f  ,
-	0.5877853f  , 0.6018150f  , 0.6156615f  , 0.6293204f  , 0.6427876f  , 0.6560590f  ,
-	0.6691306f  , 0.6819984f  , 0.6946584f  , 0.7071068f  , 0.7193398f  , 0.7313537f  ,
-	0.7431448f  , 0.7547096f  , 0.7660444f  , 0.7771460f  , 0.7880108f  , 0.7986355f  ,
-	0.8090170f  , 0.8191520f  , 0.8290376f  , 0.8386706f  , 0.8480481f  , 0.8571673f  ,
-	0.8660254f  , 0.8746197f  , 0.8829476f  , 0.8910065f  , 0.8987940f  , 0.9063078f  ,
-	0.9135455f  , 0.9205049f  , 0.9271839f  , 0.9335804f  , 0.9396926f  , 0.9455186f  ,
-	0.9510565f  , 0.9563048f  , 0.9612617f  , 0.9659258f  , 0.9702957f  , 0.9743701f  ,
-	0.9781476f  , 0.9816272f  , 0.9848078f  , 0.9876883f  , 0.9902681f  , 0.9925462f  ,
-	0.9945219f  , 0.9961947f  , 0.9975641f  , 0.9986295f  , 0.9993908f  , 0.9998477f  ,
-	1.0000000f
-};
-
-static void inline sincos( int angle, float& cosval, float& sinval )
-{
-	angle += (angle < 0 ? 360 : 0);
-	sinval = sinTable[angle];
-	cosval = sinTable[450 - angle];
-}
-
-static inline vector<Point> ellipse2Points( const RotatedRect &ellipse, const int &delta )
-{
-	int angle = ellipse.angle;
-
-	// make sure angle is within range
-	while( angle < 0 )
-		angle += 360;
-	while( angle > 360 )
-		angle -= 360;
-
-	float alpha, beta;
-	sincos( angle, alpha, beta );
-
-	double x, y;
-	vector<Point> points;
-	for( int i = 0; i < 360; i += delta )
-	{
-		x = 0.5*ellipse.size.width * sinTable[450-i];
-		y = 0.5*ellipse.size.height * sinTable[i];
-		points.push_back(
-			Point( roundf(ellipse.center.x + x * alpha - y * beta),
-				roundf(ellipse.center.y + x * beta + y * alpha) )
-			);
-	}
-	return points;
-}
-
 inline bool PupilCandidate::isValid(const cv::Mat &intensityImage, const int &minPupilDiameterPx, const int &maxPupilDiameterPx, const int bias)
 {
 	if (points.size() < 5)
 		return false;
 
+	// The largest gap lies between the longest bounding box side and its
+	// diagonal, which rejects most segments before the quadratic search
+	int minX = points[0].x, maxX = minX, minY = points[0].y, maxY = minY;
+	for (auto p=points.begin(); p!=points.end(); p++) {
+		minX = std::min(minX, p->x);
+		maxX = std::max(maxX, p->x);
+		minY = std::min(minY, p->y);
+		maxY = std::max(maxY, p->y);
+	}
+	const int extentX = maxX - minX;
+	const int extentY = maxY - minY;
+	if ( std::max(extentX, extentY) >= maxPupilDiameterPx )
+		return false;
+	if ( extentX*extentX + extentY*extentY <= minPupilDiameterPx*minPupilDiameterPx )
+		return false;
+
 	float maxGap = 0;
 	for (auto p1=points.begin(); p1!=points.end(); p1++) {
 		for (auto p2=p1+1; p2!=points.end(); p2++) {
@@ -905,7 +789,7 @@ inline bool PupilCandidate::isValid(const cv::Mat &intensityImage, const int &mi
 	if ( maxGap <= minPupilDiameterPx )
 		return false;
 
-	outline = fitEllipse(points);
+	outline = fitEllipse(points.mat());
 	boundaries = {0, 0, intensityImage.cols, intensityImage.rows};
 
 	if (!boundaries.contains(outline.center))
@@ -914,7 +798,7 @@ inline bool PupilCandidate::isValid(const cv::Mat &intensityImage, const int &mi
 	if (!fastValidityCheck(maxPupilDiameterPx) )
 		return false;
 
-	pointsMinAreaRect = minAreaRect(points);
+	pointsMinAreaRect = minAreaRect(points.mat());
 	if (ratio(pointsMinAreaRect.size.width,pointsMinAreaRect.size.height) < minCurvatureRatio)
 		return false;
 
@@ -938,7 +822,7 @@ inline bool PupilCandidate::fastValidityCheck(const int &maxPupilDiameterPx)
 	if (majorAxis > maxPupilDiameterPx)
 		return false;
 
-	combinationRegion = boundingRect(points);
+	combinationRegion = boundingRect(points.mat());
 	combinationRegion.width = max<int>(combinationRegion.width, combinationRegion.height);
 	combinationRegion.height = combinationRegion.width;
 
@@ -948,134 +832,11 @@ inline bool PupilCandidate::fastValidityCheck(const int &maxPupilDiameterPx)
 inline bool PupilCandidate::validateOutlineContrast(const Mat &intensityImage, const int &bias)
 {
 	int delta = 0.15*minorAxis;
-	cv::Point c = outline.center;
 //#define DBG_OUTLINE_CONTRAST
 #ifdef DBG_OUTLINE_CONTRAST
-	cv::Mat tmp;
-	cv::cvtColor(intensityImage, tmp, CV_GRAY2BGR);
-	cv::ellipse(tmp, outline, cv::Scalar(0,255,255));
-	cv::Scalar lineColor;
-#endif
-	int evaluated = 0;
-	int validCount = 0;
-
-	vector<Point> outlinePoints = ellipse2Points(outline, 10);
-	for (auto p=outlinePoints.begin(); p!=outlinePoints.end(); p++) {
-		int dx = p->x - c.x;
-		int dy = p->y - c.y;
-
-		float a = 0;
-		if (dx != 0)
-			a = dy / (float) dx;
-		float b = c.y - a*c.x;
-
-		if (a == 0)
-			continue;
-
-		if ( abs(dx) > abs(dy) ) {
-			int sx = p->x - delta;
-			int ex = p->x + delta;
-			int sy = std::roundf(a*sx + b);
-			int ey = std::roundf(a*ex + b);
-			cv::Point start = { sx, sy };
-			cv::Point end = { ex, ey };
-			evaluated++;
-
-			if (!boundaries.contains(start) || !boundaries.contains(end) )
-				continue;
-
-			float m1, m2, count;
-
-			m1 = count = 0;
-			for (int x=sx; x<p->x; x++)
-				m1 += intensityImage.ptr<uchar>( (int) std::roundf(a*x+b) )[x];
-			m1 = std::roundf( m1 / delta );
-
-			m2 = count = 0;
-			for (int x=p->x+1; x<=ex; x++) {
-				m2 += intensityImage.ptr<uchar>( (int) std::roundf(a*x+b) )[x];
-			}
-			m2 = std::roundf( m2 / delta );
-
-#ifdef DBG_OUTLINE_CONTRAST
-			lineColor = cv::Scalar(0,0,255);
-#endif
-			if (p->x < c.x) {// leftwise point
-				if (m1 > m2+bias) {
-					validCount ++;
-#ifdef DBG_OUTLINE_CONTRAST
-					lineColor = cv::Scalar(0,255,0);
-#endif
-				}
-			} else {// rightwise point
-				if (m2 > m1+bias) {
-					validCount++;
-#ifdef DBG_OUTLINE_CONTRAST
-					lineColor = cv::Scalar(0,255,0);
+	drawOutlineContrast(intensityImage, bias, "outline-contrast.png");
 #endif
-				}
-			}
-
-#ifdef DBG_OUTLINE_CONTRAST
-			cv::line(tmp, start, end, lineColor);
-#endif
-		} else {
-			int sy = p->y - delta;
-			int ey = p->y + delta;
-			int sx = std::roundf((sy - b)/a);
-			int ex = std::roundf((ey - b)/a);
-			cv::Point start = { sx, sy };
-			cv::Point end = { ex, ey };
-
-			evaluated++;
-			if (!boundaries.contains(start) || !boundaries.contains(end) )
-				continue;
-
-			float m1, m2, count;
-
-			m1 = count = 0;
-			for (int y=sy; y<p->y; y++)
-				m1 += intensityImage.ptr<uchar>(y)[ (int) std::roundf((y-b)/a) ];
-			m1 = std::roundf( m1 / delta );
-
-			m2 = count = 0;
-			for (int y=p->y+1; y<=ey; y++)
-				m2 += intensityImage.ptr<uchar>(y)[ (int) std::roundf((y-b)/a) ];
-			m2 = std::roundf( m2 / delta );
-
-#ifdef DBG_OUTLINE_CONTRAST
-			lineColor = cv::Scalar(0,0,255);
-#endif
-			if (p->y < c.y) {// upperwise point
-				if (m1 > m2+bias) {
-					validCount++;
-#ifdef DBG_OUTLINE_CONTRAST
-					lineColor = cv::Scalar(0,255,0);
-#endif
-				}
-			} else {// bottomwise point
-				if (m2 > m1+bias) {
-					validCount++;
-#ifdef DBG_OUTLINE_CONTRAST
-					lineColor = cv::Scalar(0,255,0);
-#endif
-				}
-			}
-
-#ifdef DBG_OUTLINE_CONTRAST
-			cv::line(tmp, start, end, lineColor);
-#endif
-		}
-	}
-	if (evaluated == 0)
-		return false;
-	outlineContrast = validCount / (float) evaluated;
-#ifdef DBG_OUTLINE_CONTRAST
-	cv::imshow("Outline Contrast", tmp);
-	cv::waitKey(0);
-#endif
-
-	return true;
+	return EllipseSampler::local().outlineContrast(intensityImage, outline, delta, bias, outlineContrast);
 }
 
 inline bool PupilCandidate::validateAnchorDistribution()
@@ -1134,7 +895,8 @@ inline bool PupilCandidate::drawOutlineContrast(const Mat &intensityImage, const
 	int validCount = 0;
 
 
-	vector<Point> outlinePoints = ellipse2Points(outline, 10);
+	vector<Point> outlinePoints;
+	EllipseSampler::local().outlinePoints(outline, 10, outlinePoints);
 	for (auto p=outlinePoints.begin(); p!=outlinePoints.end(); p++) {
 		int dx = p->x - c.x;
 		int dy = p->y - c.y;
@@ -50,11 +50,13 @@
 #include <opencv2/opencv.hpp>
 
 #include "PupilDetectionMethod.h"
+#include "Workspace.h"
+#include "ContourSet.h"
 
 class PupilCandidate
 {
 public:
-    std::vector<cv::Point> points;
+    PointSpan points; // not owned, see PuRe::contours and PuRe::mergedPoints
     cv::RotatedRect pointsMinAreaRect;
     float minCurvatureRatio;
 
@@ -87,7 +89,8 @@ public:
         Q3 = 3,
     };
 
-	PupilCandidate(std::vector<cv::Point> points) :
+	PupilCandidate(const PointSpan &points = PointSpan()) :
+		points(points),
         minCurvatureRatio(0.198912f), // (1-cos(22.5))/sin(22.5)
         anchorDistribution(0.0f),
         aspectRatio(0.0f),
@@ -95,7 +98,6 @@ public:
 		score(0.0f),
 		color(0,255,0)
     {
-        this->points = points;
     }
     bool isValid(const cv::Mat &intensityImage, const int &minPupilDiameterPx, const int &maxPupilDiameterPx, const int bias=5);
     void estimateOutline();
@@ -178,7 +180,7 @@ public:
     }
 
     void run(const cv::Mat &frame, Pupil &pupil);
-	void run(const cv::Mat &frame, const cv::Rect &roi, Pupil &pupil, const float &userMinPupilDiameterPx=-1, const float &userMaxPupilDiameterPx=-1);
+	void run(const cv::Mat &frame, const cv::Rect &roi, Pupil &pupil, const float &userMinPupilDiameterPx=-1, const float &userMaxPupilDiameterPx=-1, const Deadline &deadline=Deadline());
 	bool hasPupilOutline() { return true; }
 	bool hasConfidence() { return true; }
 	bool hasCoarseLocation() { return false; }
@@ -213,33 +215,64 @@ protected:
     /*
      *  Detection
      */
-    void detect(Pupil &pupil);
+    void detect(Pupil &pupil, const Deadline &deadline=Deadline());
+
+    // Scratch memory, sized once per resolution and reused afterwards
+    enum WorkspaceSlot {
+        WS_DOWNSCALED = 0,
+        WS_INPUT,
+        WS_BLURRED,
+        WS_DX,
+        WS_DY,
+        WS_MAGNITUDE,
+        WS_EDGE_TYPE,
+        WS_EDGE,
+        WS_PURE_SLOTS // derived classes continue from here
+    };
+    Workspace workspace;
+    void prepareEdgeDetection(const cv::Size &size);
 
     // Canny
 	cv::Mat dx, dy, magnitude;
     cv::Mat edgeType, edge;
 	cv::Mat canny(const cv::Mat &in, bool blur=true, bool useL2=true, int bins=64, float nonEdgePixelsRatio=0.7f, float lowHighThresholdRatio=0.4f);
+	cv::Mat blurred;
+	std::vector<int> cannyHistogram;
+	std::vector<int> hysteresisQueue;
 
     // Edge filtering
 	void filterEdges(cv::Mat &edges);
 
-	// Remove duplicates (e.g., from closed loops)
-	int pointHash(cv::Point p, int cols) { return p.y*cols+p.x;}
-	void removeDuplicates(std::vector<std::vector<cv::Point> > &curves, const int& cols) {
-		std::map<int,uchar> contourMap;
-		for (size_t i=curves.size(); i-->0;) {
-			if (contourMap.count(pointHash(curves[i][0],cols)) > 0)
-				curves.erase(curves.begin()+i);
-			else {
-				for (int j=0; j<curves[i].size(); j++)
-					contourMap[pointHash(curves[i][j],cols)] = 1;
-			}
-		}
-	}
-
-    void findPupilEdgeCandidates(const cv::Mat &intensityImage, cv::Mat &edge, std::vector<PupilCandidate> &candidates);
-    void combineEdgeCandidates(const cv::Mat &intensityImage, cv::Mat &edge, std::vector<PupilCandidate> &candidates);
-	void searchInnerCandidates(std::vector<PupilCandidate> &candidates, PupilCandidate &candidate);
+    void findPupilEdgeCandidates(const cv::Mat &intensityImage, cv::Mat &edge, std::vector<PupilCandidate> &candidates, const Deadline &deadline);
+    void combineEdgeCandidates(const cv::Mat &intensityImage, cv::Mat &edge, std::vector<PupilCandidate> &candidates, const Deadline &deadline);
+	const PupilCandidate* searchInnerCandidates(const std::vector<PupilCandidate> &candidates, const PupilCandidate &candidate);
+
+	// Reused across frames so that their storage is kept
+	ContourSet contours;
+	std::vector<size_t> candidateOrder;
+	std::vector<PupilCandidate> candidates;
+	std::vector<PupilCandidate> mergedCandidates;
+	std::vector<cv::Point> mergedPoints; // owns the points of mergedCandidates
+
+	// Candidate combination: pairs with overlapping combination regions are
+	// found through a uniform grid, then validated in parallel
+	void findCombinationPairs(const std::vector<PupilCandidate> &candidates, const cv::Size &size);
+	std::vector<int> gridCellStart, gridCellFill, gridItems, pairStamp, neighbors;
+	std::vector<std::pair<int,int> > combinationPairs;
+	struct Merge {
+		int pair;
+		int worker;
+		size_t offset; // in the worker's points
+		PupilCandidate candidate;
+	};
+	struct CombinationWorker {
+		PupilCandidate scratch;
+		std::vector<cv::Point> scratchPoints;
+		std::vector<cv::Point> points;
+		std::vector<Merge> merges;
+	};
+	std::vector<CombinationWorker> combinationWorkers;
+	std::vector<const Merge*> mergeOrder;
 
     cv::Mat input;
     cv::Mat dbg;
@@ -1,4 +1,5 @@
 #include "PupilDetectionMethod.h"
+#include "EllipseSampler.h"
 #include <QDebug>
 
 // TODO: clean up this interface and the one from the tracking
@@ -8,7 +9,6 @@ using namespace std;
 using namespace cv;
 
 //#define DBG_COARSE_PUPIL_DETECTION
-//#define DBG_OUTLINE_CONTRAST
 #include <QElapsedTimer>
 Rect PupilDetectionMethod::coarsePupilDetection(const Mat &frame, const float &minCoverage, const int &workingWidth, const int &workingHeight)
 {
@@ -43,13 +43,18 @@ Rect PupilDetectionMethod::coarsePupilDetection(const Mat &frame, const float &m
 	integral(downscaled, itg, CV_32S);
     Mat res = Mat::zeros( downscaled.rows, downscaled.cols, CV_32F);
 	float best_response = std::numeric_limits<float>::min();
-    deque< pair<Rect, float> > candidates;
+	struct Candidate {
+		Rect rect;
+		float response;
+		int order;
+		// Strongest first; among equals, the earliest
+		bool operator<(const Candidate &c) const { return response > c.response || (response == c.response && order < c.order); }
+	};
+	vector<Candidate> candidates;
+	vector<float> responses(downscaled.cols);
 	for (int r = min_r; r<=max_r; r+=r_step) {
 		int step = 3*r;
 
-		Point ia, ib, ic, id;
-		Point oa, ob, oc, od;
-
 		int inner_count = (2*r) * (2*r);
 		int outer_count = (2*step)*(2*step) - inner_count;
 
@@ -57,55 +62,45 @@ Rect PupilDetectionMethod::coarsePupilDetection(const Mat &frame, const float &m
 		float outer_norm = 1.0f / (255*outer_count);
 
 		for (int y = step; y<downscaled.rows-step; y+=ystep) {
-			oa.y = y - step;
-			ob.y = y - step;
-			oc.y = y + step;
-			od.y = y + step;
-			ia.y = y - r;
-			ib.y = y - r;
-			ic.y = y + r;
-			id.y = y + r;
-            for (int x = step; x<downscaled.cols-step; x+=xstep) {
-				oa.x = x - step;
-				ob.x = x + step;
-				oc.x = x + step;
-				od.x = x - step;
-				ia.x = x - r;
-				ib.x = x + r;
-				ic.x = x + r;
-				id.x = x - r;
-				int inner = itg.ptr<int>(ic.y)[ic.x] + itg.ptr<int>(ia.y)[ia.x] -
-						itg.ptr<int>(ib.y)[ib.x] - itg.ptr<int>(id.y)[id.x];
-				int outer = itg.ptr<int>(oc.y)[oc.x] + itg.ptr<int>(oa.y)[oa.x] -
-						itg.ptr<int>(ob.y)[ob.x] - itg.ptr<int>(od.y)[od.x] - inner;
-
+			const int *outerTop = itg.ptr<int>(y - step);
+			const int *outerBottom = itg.ptr<int>(y + step);
+			const int *innerTop = itg.ptr<int>(y - r);
+			const int *innerBottom = itg.ptr<int>(y + r);
+
+			// The responses of a row are independent from each other, so they
+			// are computed in a separate (vectorizable) pass
+			for (int x = step; x<downscaled.cols-step; x++) {
+				int inner = innerBottom[x + r] + innerTop[x - r] - innerTop[x + r] - innerBottom[x - r];
+				int outer = outerBottom[x + step] + outerTop[x - step] - outerTop[x + step] - outerBottom[x - step] - inner;
 				float inner_mean = inner_norm*inner;
 				float outer_mean = outer_norm*outer;
-                float response = (outer_mean - inner_mean);
-
-                if ( response < 0.5*best_response)
-                    continue;
+				responses[x] = outer_mean - inner_mean;
+			}
 
+			float *maxResponse = res.ptr<float>(y);
+            for (int x = step; x<downscaled.cols-step; x+=xstep) {
+				float response = responses[x];
 				if (response < 0.5 * best_response)
 					continue;
 
 				if (response > best_response)
 					best_response = response;
 
-				if ( response > res.ptr<float>(y)[x] ) {
-					res.ptr<float>(y)[x] = response;
+				if ( response > maxResponse[x] ) {
+					maxResponse[x] = response;
 					// The pupil is too small, the padding too large; we combine them.
-					candidates.push_back( make_pair(Rect( 0.5*(ia+oa), 0.5*(ic+oc) ), response) );
+					Point ia(x - r, y - r), ic(x + r, y + r);
+					Point oa(x - step, y - step), oc(x + step, y + step);
+					candidates.push_back( { Rect( 0.5*(ia+oa), 0.5*(ic+oc) ), response, (int) candidates.size() } );
 				}
-
 			}
 		}
 	}
 
-	auto compare = [] (const pair<Rect, float> &a, const pair<Rect,float> &b) {
-		return (a.second > b.second);
-	};
-	sort( candidates.begin(), candidates.end(), compare);
+	// Usually only a handful of the strongest candidates are needed, so they
+	// are taken from a heap instead of sorting all of them
+	auto weaker = [] (const Candidate &a, const Candidate &b) { return b < a; };
+	make_heap( candidates.begin(), candidates.end(), weaker);
 
 #ifdef DBG_COARSE_PUPIL_DETECTION
 	Mat dbg;
@@ -116,14 +111,15 @@ Rect PupilDetectionMethod::coarsePupilDetection(const Mat &frame, const float &m
 	Rect coarse;
 	int minWidth = minCoverage * downscaled.cols;
 	int minHeight = minCoverage * downscaled.rows;
-	for ( int i=0; i<candidates.size(); i++ ) {
-		auto &c = candidates[i];
+	for (auto end = candidates.end(); end != candidates.begin(); end--) {
+		pop_heap( candidates.begin(), end, weaker);
+		const Rect &c = (end-1)->rect;
 		if (coarse.area() == 0)
-			coarse = c.first;
+			coarse = c;
 		else
-			coarse |= c.first;
+			coarse |= c;
 #ifdef DBG_COARSE_PUPIL_DETECTION
-		rectangle(dbg, candidates[i].first, Scalar(0,255,255));
+		rectangle(dbg, c, Scalar(0,255,255));
 #endif
 		if (coarse.width > minWidth && coarse.height > minHeight)
 			break;
@@ -150,119 +146,6 @@ Rect PupilDetectionMethod::coarsePupilDetection(const Mat &frame, const float &m
 	return coarse;
 }
 
-static const float sinTable[] = {
-	0.0000000f  , 0.0174524f  , 0.0348995f  , 0.0523360f  , 0.0697565f  , 0.0871557f  ,
-	0.1045285f  , 0.1218693f  , 0.1391731f  , 0.1564345f  , 0.1736482f  , 0.1908090f  ,
-	0.2079117f  , 0.2249511f  , 0.2419219f  , 0.2588190f  , 0.2756374f  , 0.2923717f  ,
-	0.3090170f  , 0.3255682f  , 0.3420201f  , 0.3583679f  , 0.3746066f  , 0.3907311f  ,
-	0.4067366f  , 0.4226183f  , 0.4383711f  , 0.4539905f  , 0.4694716f  , 0.4848096f  ,
-	0.5000000f  , 0.5150381f  , 0.5299193f  , 0.5446390f  , 0.5591929f  , 0.5735764f  ,
-	0.5877853f  , 0.6018150f  , 0.6156615f  , 0.6293204f  , 0.6427876f  , 0.6560590f  ,
-	0.6691306f  , 0.6819984f  , 0.6946584f  , 0.7071068f  , 0.7193398f  , 0.7313537f  ,
-	0.7431448f  , 0.7547096f  , 0.7660444f  , 0.7771460f  , 0.7880108f  , 0.7986355f  ,
-	0.8090170f  , 0.8191520f  , 0.8290376f  , 0.8386706f  , 0.8480481f  , 0.8571673f  ,
-	0.8660254f  , 0.8746197f  , 0.8829476f  , 0.8910065f  , 0.8987940f  , 0.9063078f  ,
-	0.9135455f  , 0.9205049f  , 0.9271839f  , 0.9335804f  , 0.9396926f  , 0.9455186f  ,
-	0.9510565f  , 0.9563048f  , 0.9612617f  , 0.9659258f  , 0.9702957f  , 0.9743701f  ,
-	0.9781476f  , 0.9816272f  , 0.9848078f  , 0.9876883f  , 0.9902681f  , 0.9925462f  ,
-	0.9945219f  , 0.9961947f  , 0.9975641f  , 0.9986295f  , 0.9993908f  , 0.9998477f  ,
-	1.0000000f  , 0.9998477f  , 0.9993908f  , 0.9986295f  , 0.9975641f  , 0.9961947f  ,
-	0.9945219f  , 0.9925462f  , 0.9902681f  , 0.9876883f  , 0.9848078f  , 0.9816272f  ,
-	0.9781476f  , 0.9743701f  , 0.9702957f  , 0.9659258f  , 0.9612617f  , 0.9563048f  ,
-	0.9510565f  , 0.9455186f  , 0.9396926f  , 0.9335804f  , 0.9271839f  , 0.9205049f  ,
-	0.9135455f  , 0.9063078f  , 0.8987940f  , 0.8910065f  , 0.8829476f  , 0.8746197f  ,
-	0.8660254f  , 0.8571673f  , 0.8480481f  , 0.8386706f  , 0.8290376f  , 0.8191520f  ,
-	0.8090170f  , 0.7986355f  , 0.7880108f  , 0.7771460f  , 0.7660444f  , 0.7547096f  ,
-	0.7431448f  , 0.7313537f  , 0.7193398f  , 0.7071068f  , 0.6946584f  , 0.6819984f  ,
-	0.6691306f  , 0.6560590f  , 0.6427876f  , 0.6293204f  , 0.6156615f  , 0.6018150f  ,
-	0.5877853f  , 0.5735764f  , 0.5591929f  , 0.5446390f  , 0.5299193f  , 0.5150381f  ,
-	0.5000000f  , 0.4848096f  , 0.4694716f  , 0.4539905f  , 0.4383711f  , 0.4226183f  ,
-	0.4067366f  , 0.3907311f  , 0.3746066f  , 0.3583679f  , 0.3420201f  , 0.3255682f  ,
-	0.3090170f  , 0.2923717f  , 0.2756374f  , 0.2588190f  , 0.2419219f  , 0.2249511f  ,
-	0.2079117f  , 0.1908090f  , 0.1736482f  , 0.1564345f  , 0.1391731f  , 0.1218693f  ,
-	0.1045285f  , 0.0871557f  , 0.0697565f  , 0.0523360f  , 0.0348995f  , 0.0174524f  ,
-	0.0000000f  , -0.0174524f , -0.0348995f , -0.0523360f , -0.0697565f , -0.0871557f ,
-	-0.1045285f , -0.1218693f , -0.1391731f , -0.1564345f , -0.1736482f , -0.1908090f ,
-	-0.2079117f , -0.2249511f , -0.2419219f , -0.2588190f , -0.2756374f , -0.2923717f ,
-	-0.3090170f , -0.3255682f , -0.3420201f , -0.3583679f , -0.3746066f , -0.3907311f ,
-	-0.4067366f , -0.4226183f , -0.4383711f , -0.4539905f , -0.4694716f , -0.4848096f ,
-	-0.5000000f , -0.5150381f , -0.5299193f , -0.5446390f , -0.5591929f , -0.5735764f ,
-	-0.5877853f , -0.6018150f , -0.6156615f , -0.6293204f , -0.6427876f , -0.6560590f ,
-	-0.6691306f , -0.6819984f , -0.6946584f , -0.7071068f , -0.7193398f , -0.7313537f ,
-	-0.7431448f , -0.7547096f , -0.7660444f , -0.7771460f , -0.7880108f , -0.7986355f ,
-	-0.8090170f , -0.8191520f , -0.8290376f , -0.8386706f , -0.8480481f , -0.8571673f ,
-	-0.8660254f , -0.8746197f , -0.8829476f , -0.8910065f , -0.8987940f , -0.9063078f ,
-	-0.9135455f , -0.9205049f , -0.9271839f , -0.9335804f , -0.9396926f , -0.9455186f ,
-	-0.9510565f , -0.9563048f , -0.9612617f , -0.9659258f , -0.9702957f , -0.9743701f ,
-	-0.9781476f , -0.9816272f , -0.9848078f , -0.9876883f , -0.9902681f , -0.9925462f ,
-	-0.9945219f , -0.9961947f , -0.9975641f , -0.9986295f , -0.9993908f , -0.9998477f ,
-	-1.0000000f , -0.9998477f , -0.9993908f , -0.9986295f , -0.9975641f , -0.9961947f ,
-	-0.9945219f , -0.9925462f , -0.9902681f , -0.9876883f , -0.9848078f , -0.9816272f ,
-	-0.9781476f , -0.9743701f , -0.9702957f , -0.9659258f , -0.9612617f , -0.9563048f ,
-	-0.9510565f , -0.9455186f , -0.9396926f , -0.9335804f , -0.9271839f , -0.9205049f ,
-	-0.9135455f , -0.9063078f , -0.8987940f , -0.8910065f , -0.8829476f , -0.8746197f ,
-	-0.8660254f , -0.8571673f , -0.8480481f , -0.8386706f , -0.8290376f , -0.8191520f ,
-	-0.8090170f , -0.7986355f , -0.7880108f , -0.7771460f , -0.7660444f , -0.7547096f ,
-	-0.7431448f , -0.7313537f , -0.7193398f , -0.7071068f , -0.6946584f , -0.6819984f ,
-	-0.6691306f , -0.6560590f , -0.6427876f , -0.6293204f , -0.6156615f , -0.6018150f ,
-	-0.5877853f , -0.5735764f , -0.5591929f , -0.5446390f , -0.5299193f , -0.5150381f ,
-	-0.5000000f , -0.4848096f , -0.4694716f , -0.4539905f , -0.4383711f , -0.4226183f ,
-	-0.4067366f , -0.3907311f , -0.3746066f , -0.3583679f , -0.3420201f , -0.3255682f ,
-	-0.3090170f , -0.2923717f , -0.2756374f , -0.2588190f , -0.2419219f , -0.2249511f ,
-	-0.2079117f , -0.1908090f , -0.1736482f , -0.1564345f , -0.1391731f , -0.1218693f ,
-	-0.1045285f , -0.0871557f , -0.0697565f , -0.0523360f , -0.0348995f , -0.0174524f ,
-	-0.0000000f , 0.0174524f  , 0.0348995f  , 0.0523360f  , 0.0697565f  , 0.0871557f  ,
-	0.1045285f  , 0.1218693f  , 0.1391731f  , 0.1564345f  , 0.1736482f  , 0.1908090f  ,
-	0.2079117f  , 0.2249511f  , 0.2419219f  , 0.2588190f  , 0.2756374f  , 0.2923717f  ,
-	0.3090170f  , 0.3255682f  , 0.3420201f  , 0.3583679f  , 0.3746066f  , 0.3907311f  ,
-	0.4067366f  , 0.4226183f  , 0.4383711f  , 0.4539905f  , 0.4694716f  , 0.4848096f  ,
-	0.5000000f  , 0.5150381f  , 0.5299193f  , 0.5446390f  , 0.5591929f  , 0.5735764f  ,
-	0.5877853f  , 0.6018150f  , 0.6156615f  , 0.6293204f  , 0.6427876f  , 0.6560590f  ,
-	0.6691306f  , 0.6819984f  , 0.6946584f  , 0.7071068f  , 0.7193398f  , 0.7313537f  ,
-	0.7431448f  , 0.7547096f  , 0.7660444f  , 0.7771460f  , 0.7880108f  , 0.7986355f  ,
-	0.8090170f  , 0.8191520f  , 0.8290376f  , 0.8386706f  , 0.8480481f  , 0.8571673f  ,
-	0.8660254f  , 0.8746197f  , 0.8829476f  , 0.8910065f  , 0.8987940f  , 0.9063078f  ,
-	0.9135455f  , 0.9205049f  , 0.9271839f  , 0.9335804f  , 0.9396926f  , 0.9455186f  ,
-	0.9510565f  , 0.9563048f  , 0.9612617f  , 0.9659258f  , 0.9702957f  , 0.9743701f  ,
-	0.9781476f  , 0.9816272f  , 0.9848078f  , 0.9876883f  , 0.9902681f  , 0.9925462f  ,
-	0.9945219f  , 0.9961947f  , 0.9975641f  , 0.9986295f  , 0.9993908f  , 0.9998477f  ,
-	1.0000000f
-};
-
-static void inline sincos(int angle, float& cosval, float& sinval)
-{
-	angle += (angle < 0 ? 360 : 0);
-	sinval = sinTable[angle];
-	cosval = sinTable[450 - angle];
-}
-
-static inline vector<Point> ellipse2Points(const RotatedRect &ellipse, const int &delta=1)
-{
-	int angle = ellipse.angle;
-
-	// make sure angle is within range
-	while( angle < 0 )
-		angle += 360;
-	while( angle > 360 )
-		angle -= 360;
-
-	float alpha, beta;
-	sincos( angle, alpha, beta );
-
-	double x, y;
-	vector<Point> points;
-	for( int i = 0; i < 360; i += delta )
-	{
-		x = 0.5*ellipse.size.width * sinTable[450-i];
-		y = 0.5*ellipse.size.height * sinTable[i];
-		points.push_back(
-			Point( roundf(ellipse.center.x + x * alpha - y * beta),
-				roundf(ellipse.center.y + x * beta + y * alpha) )
-			);
-	}
-	return points;
-}
-
 /* Measures the confidence for a pupil based on the inner-outer contrast
  * from the pupil following PuRe. For details, see
  * Thiago Santini, Wolfgang Fuhl, Enkelejda Kasneci
@@ -275,136 +158,13 @@ float PupilDetectionMethod::outlineContrastConfidence(const Mat &frame, const Pu
 	if ( ! pupil.hasOutline() )
 		return NO_CONFIDENCE;
 
-	Rect boundaries = { 0, 0, frame.cols, frame.rows };
 	int minorAxis = min<int>(pupil.size.width, pupil.size.height);
 	int delta = 0.15*minorAxis;
-	cv::Point c = pupil.center;
-
-#ifdef DBG_OUTLINE_CONTRAST
-	cv::Mat tmp;
-	cv::cvtColor(frame, tmp, CV_GRAY2BGR);
-	cv::ellipse(tmp, pupil, cv::Scalar(0,255,255));
-	cv::Scalar lineColor;
-#endif
-	int evaluated = 0;
-	int validCount = 0;
-
-	vector<Point> outlinePoints = ellipse2Points(pupil, 10);
-	for (auto p=outlinePoints.begin(); p!=outlinePoints.end(); p++) {
-		int dx = p->x - c.x;
-		int dy = p->y - c.y;
-
-		float a = 0;
-		if (dx != 0)
-			a = dy / (float) dx;
-		float b = c.y - a*c.x;
-
-		if (a == 0)
-			continue;
-
-		if ( abs(dx) > abs(dy) ) {
-			int sx = p->x - delta;
-			int ex = p->x + delta;
-			int sy = std::roundf(a*sx + b);
-			int ey = std::roundf(a*ex + b);
-			cv::Point start = { sx, sy };
-			cv::Point end = { ex, ey };
-			evaluated++;
-
-			if (!boundaries.contains(start) || !boundaries.contains(end) )
-				continue;
-
-			float m1, m2, count;
-
-			m1 = count = 0;
-			for (int x=sx; x<p->x; x++)
-				m1 += frame.ptr<uchar>( (int) std::roundf(a*x+b) )[x];
-			m1 = std::roundf( m1 / delta );
 
-			m2 = count = 0;
-			for (int x=p->x+1; x<=ex; x++) {
-				m2 += frame.ptr<uchar>( (int) std::roundf(a*x+b) )[x];
-			}
-			m2 = std::roundf( m2 / delta );
-
-#ifdef DBG_OUTLINE_CONTRAST
-			lineColor = cv::Scalar(0,0,255);
-#endif
-			if (p->x < c.x) {// leftwise point
-				if (m1 > m2+bias) {
-					validCount ++;
-#ifdef DBG_OUTLINE_CONTRAST
-					lineColor = cv::Scalar(0,255,0);
-#endif
-				}
-			} else {// rightwise point
-				if (m2 > m1+bias) {
-					validCount++;
-#ifdef DBG_OUTLINE_CONTRAST
-					lineColor = cv::Scalar(0,255,0);
-#endif
-				}
-			}
-
-#ifdef DBG_OUTLINE_CONTRAST
-			cv::line(tmp, start, end, lineColor);
-#endif
-		} else {
-			int sy = p->y - delta;
-			int ey = p->y + delta;
-			int sx = std::roundf((sy - b)/a);
-			int ex = std::roundf((ey - b)/a);
-			cv::Point start = { sx, sy };
-			cv::Point end = { ex, ey };
-
-			evaluated++;
-			if (!boundaries.contains(start) || !boundaries.contains(end) )
-				continue;
-
-			float m1, m2, count;
-
-			m1 = count = 0;
-			for (int y=sy; y<p->y; y++)
-				m1 += frame.ptr<uchar>(y)[ (int) std::roundf((y-b)/a) ];
-			m1 = std::roundf( m1 / delta );
-
-			m2 = count = 0;
-			for (int y=p->y+1; y<=ey; y++)
-				m2 += frame.ptr<uchar>(y)[ (int) std::roundf((y-b)/a) ];
-			m2 = std::roundf( m2 / delta );
-
-#ifdef DBG_OUTLINE_CONTRAST
-			lineColor = cv::Scalar(0,0,255);
-#endif
-			if (p->y < c.y) {// upperwise point
-				if (m1 > m2+bias) {
-					validCount++;
-#ifdef DBG_OUTLINE_CONTRAST
-					lineColor = cv::Scalar(0,255,0);
-#endif
-				}
-			} else {// bottomwise point
-				if (m2 > m1+bias) {
-					validCount++;
-#ifdef DBG_OUTLINE_CONTRAST
-					lineColor = cv::Scalar(0,255,0);
-#endif
-				}
-			}
-
-#ifdef DBG_OUTLINE_CONTRAST
-			cv::line(tmp, start, end, lineColor);
-#endif
-		}
-	}
-	if (evaluated == 0)
+	float contrast;
+	if ( ! EllipseSampler::local().outlineContrast(frame, pupil, delta, bias, contrast) )
 		return 0;
-
-#ifdef DBG_OUTLINE_CONTRAST
-	cv::imshow("Outline Contrast Debug", tmp);
-#endif
-
-	return validCount / (float) evaluated;
+	return contrast;
 }
 
 float PupilDetectionMethod::angularSpreadConfidence(const vector<Point> &points, const Point2f &center)
@@ -443,11 +203,7 @@ float PupilDetectionMethod::edgeRatioConfidence(const Mat &edgeImage, const Pupi
 {
 	if (!pupil.valid())
 		return NO_CONFIDENCE;
-	Mat outlineMask = Mat::zeros(edgeImage.rows, edgeImage.cols, CV_8U);
-	ellipse(outlineMask, pupil, Scalar(255), band);
-	Mat inBandEdges = edgeImage.clone();
-	inBandEdges.setTo(0, 255 - outlineMask);
-	findNonZero(inBandEdges, edgePoints);
+	EllipseSampler::local().bandEdges(edgeImage, pupil, band, edgePoints);
 	return min<float>( edgePoints.size() / pupil.circumference(), 1.0 );
 }
 
@@ -3,7 +3,9 @@
 
 #include <QMetaType>
 #include <QDebug>
+#include <QElapsedTimer>
 
+#include <atomic>
 #include <string>
 #include <deque>
 #include <bitset>
@@ -69,6 +71,43 @@ public:
 
 Q_DECLARE_METATYPE(Pupil);
 
+/* Time budget for a single detection.
+ *
+ * Methods that support it check expired() between units of work and return
+ * the best result found so far once the budget is spent; truncated() tells
+ * afterwards whether any work was skipped. A default constructed deadline
+ * never expires. expired() may be called from several threads.
+ */
+class Deadline
+{
+public:
+	Deadline() : budgetMs(-1), hit(false) {}
+
+	// Starts counting; a budget that is already spent expires right away
+	void set(const qint64 &budgetMs) {
+		this->budgetMs = qMax<qint64>(0, budgetMs);
+		hit = false;
+		timer.start();
+	}
+
+	bool isSet() const { return budgetMs >= 0; }
+	bool expired() const {
+		if ( !isSet() || !timer.hasExpired(budgetMs) )
+			return false;
+		hit = true;
+		return true;
+	}
+	bool truncated() const { return hit; }
+
+private:
+	QElapsedTimer timer;
+	qint64 budgetMs;
+	mutable std::atomic<bool> hit;
+
+	Deadline(const Deadline&);
+	Deadline& operator=(const Deadline&);
+};
+
 class PupilDetectionMethod
 {
 public:
@@ -85,17 +124,18 @@ public:
 		pupil = run(frame);
 		pupil.confidence = 1;
     }
-	virtual void run(const cv::Mat &frame, const cv::Rect &roi, Pupil &pupil, const float &minPupilDiameterPx=-1, const float &maxPupilDiameterPx=-1) {
+	virtual void run(const cv::Mat &frame, const cv::Rect &roi, Pupil &pupil, const float &minPupilDiameterPx=-1, const float &maxPupilDiameterPx=-1, const Deadline &deadline=Deadline()) {
 		(void) roi;
 		(void) minPupilDiameterPx;
 		(void) maxPupilDiameterPx;
+		(void) deadline;
 		run(frame, pupil);
 	}
 
 	// Pupil detection interface used in the tracking
-	Pupil runWithConfidence(const cv::Mat &frame, const cv::Rect &roi, const float &minPupilDiameterPx=-1, const float &maxPupilDiameterPx=-1) {
+	Pupil runWithConfidence(const cv::Mat &frame, const cv::Rect &roi, const float &minPupilDiameterPx=-1, const float &maxPupilDiameterPx=-1, const Deadline &deadline=Deadline()) {
 		Pupil pupil;
-		run(frame, roi, pupil, minPupilDiameterPx, maxPupilDiameterPx);
+		run(frame, roi, pupil, minPupilDiameterPx, maxPupilDiameterPx, deadline);
 		if ( ! hasConfidence() )
 			pupil.confidence = outlineContrastConfidence(frame, pupil);
 		return pupil;
@@ -0,0 +1,44 @@
+#ifndef WORKSPACE_H
+#define WORKSPACE_H
+
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+/* Per instance scratch memory for the pupil detectors.
+ *
+ * Each slot owns a buffer that only grows, so once the largest working size
+ * has been seen, requesting Mats performs no allocation at all. The returned
+ * Mats are continuous views of the slot's buffer and share its refcount, so
+ * they stay valid even after the slot grows for a later request (they just
+ * no longer alias it). Passing them as output with a different size or type
+ * still makes OpenCV silently allocate a new buffer instead.
+ */
+class Workspace
+{
+public:
+    Workspace() : growths(0) {}
+
+    cv::Mat mat(const unsigned int &slot, const cv::Size &size, const int &type) {
+        if (slot >= buffers.size())
+            buffers.resize(slot+1);
+        if (size.area() <= 0)
+            return cv::Mat(size, type);
+        cv::Mat &buffer = buffers[slot];
+        if (buffer.type() != type || buffer.total() < (size_t) size.area()) {
+            buffer.create(1, size.area(), type);
+            growths++;
+        }
+        // A single row range is continuous, so it can be reshaped into the requested size
+        return buffer.colRange(0, size.area()).reshape(0, size.height);
+    }
+
+    // How often a buffer had to be (re)allocated; stable in steady state
+    unsigned int growthCount() const { return growths; }
+
+private:
+    std::vector<cv::Mat> buffers;
+    unsigned int growths;
+};
+
+#endif // WORKSPACE_H
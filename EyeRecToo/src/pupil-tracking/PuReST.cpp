@@ -42,6 +42,8 @@
 
 #include "PuReST.h"
 
+#include <QtAlgorithms>
+
 using namespace std;
 using namespace cv;
 
@@ -73,7 +75,62 @@ static std::vector<cv::Vec3b> getColors(int size)
 	   return colors;
 }
 
-void PuReST::getThresholds(const Mat &input, const Mat &histogram, const Pupil &pupil, int &lowTh, int &highTh, Mat &bright, Mat &dark)
+void PuReST::kernelRows(const Mat &kernel, vector<Vec3i> &rows)
+{
+	// Kernel rows must be contiguous, as in rectangles, crosses, and ellipses
+	rows.clear();
+	Point anchor(kernel.cols / 2, kernel.rows / 2);
+	for (int y = 0; y < kernel.rows; y++) {
+		const uchar *k = kernel.ptr<uchar>(y);
+		int first = 0;
+		while (first < kernel.cols && !k[first])
+			first++;
+		if (first == kernel.cols)
+			continue;
+		int last = kernel.cols - 1;
+		while (!k[last])
+			last--;
+		rows.push_back( Vec3i(y - anchor.y, first - anchor.x, last - anchor.x) );
+	}
+}
+
+// Whether the kernel centered at (x,y) covers any set pixel (i.e., dilation);
+// outside the image nothing is set, as in OpenCV's default border
+static inline bool anyUnder(const int *counts, const Size &size, const vector<Vec3i> &rows, const int &x, const int &y)
+{
+	const int stride = size.width + 1;
+	for (auto r = rows.begin(); r != rows.end(); r++) {
+		int yy = y + (*r)[0];
+		if (yy < 0 || yy >= size.height)
+			continue;
+		int x0 = max(x + (*r)[1], 0);
+		int x1 = min(x + (*r)[2] + 1, size.width);
+		const int *c = counts + yy*stride;
+		if (x0 < x1 && c[x1] > c[x0])
+			return true;
+	}
+	return false;
+}
+
+// Whether the kernel centered at (x,y) covers set pixels only (i.e., erosion);
+// outside the image everything is set, as in OpenCV's default border
+static inline bool allUnder(const int *counts, const Size &size, const vector<Vec3i> &rows, const int &x, const int &y)
+{
+	const int stride = size.width + 1;
+	for (auto r = rows.begin(); r != rows.end(); r++) {
+		int yy = y + (*r)[0];
+		if (yy < 0 || yy >= size.height)
+			continue;
+		int x0 = max(x + (*r)[1], 0);
+		int x1 = min(x + (*r)[2] + 1, size.width);
+		const int *c = counts + yy*stride;
+		if (x0 < x1 && c[x1] - c[x0] < x1 - x0)
+			return false;
+	}
+	return true;
+}
+
+void PuReST::getThresholds(const Mat &input, const Mat &histogram, const Pupil &pupil, const Mat &edges, int &lowTh, int &highTh, Mat &bright, Mat &dark)
 {
 	int th;
 	float area, acc;
@@ -101,12 +158,68 @@ void PuReST::getThresholds(const Mat &input, const Mat &histogram, const Pupil &
     int bias = 5;
 	highTh -= bias;
 
-	inRange(input, highTh, 256, bright);
-	dilate(bright, bright, openKernel);
+	/* The masks are only looked up at edge pixels (outline tracker edges and
+	 * greedy search contours), so they are only computed there:
+	 *   bright = dilate(input >= highTh, openKernel)
+	 *   dark = erode(dilate(input <= lowTh, dilateKernel), openKernel)
+	 * and are zero elsewhere. The inner dilation is needed around every edge
+	 * pixel, so it is computed for the whole input, row by row.
+	 */
+	const Size size = input.size();
+	const int stride = size.width + 1;
+	brightCounts.resize(size.height*stride);
+	darkCounts.resize(size.height*stride);
+	dilatedDarkCounts.resize(size.height*stride);
+	dilatedDarkRow.resize(size.width);
+
+	for (int y = 0; y < size.height; y++) {
+		const uchar *in = input.ptr<uchar>(y);
+		int *b = &brightCounts[y*stride];
+		int *d = &darkCounts[y*stride];
+		b[0] = d[0] = 0;
+		for (int x = 0; x < size.width; x++) {
+			b[x+1] = b[x] + (in[x] >= highTh);
+			d[x+1] = d[x] + (in[x] <= lowTh);
+		}
+	}
 
-	inRange(input, 0, lowTh, dark);
-	dilate(dark, dark, dilateKernel);
-	erode(dark, dark, openKernel);
+	uchar *dilated = dilatedDarkRow.data();
+	for (int y = 0; y < size.height; y++) {
+		fill(dilatedDarkRow.begin(), dilatedDarkRow.end(), 0);
+		for (auto r = dilateRows.begin(); r != dilateRows.end(); r++) {
+			int yy = y + (*r)[0];
+			if (yy < 0 || yy >= size.height)
+				continue;
+			const int *c = &darkCounts[yy*stride];
+			const int left = (*r)[1], right = (*r)[2] + 1;
+			// Clamped at the borders; no clamping (i.e., vectorizable) in between
+			int x = 0;
+			for (; x < size.width && x + left < 0; x++)
+				dilated[x] |= c[min(x + right, size.width)] > c[0];
+			for (; x + right <= size.width; x++)
+				dilated[x] |= c[x + right] > c[x + left];
+			for (; x < size.width; x++)
+				dilated[x] |= c[size.width] > c[max(x + left, 0)];
+		}
+		int *dd = &dilatedDarkCounts[y*stride];
+		dd[0] = 0;
+		for (int x = 0; x < size.width; x++)
+			dd[x+1] = dd[x] + dilated[x];
+	}
+
+	bright.setTo(0);
+	dark.setTo(0);
+	for (int y = 0; y < size.height; y++) {
+		const uchar *e = edges.ptr<uchar>(y);
+		uchar *b = bright.ptr<uchar>(y);
+		uchar *d = dark.ptr<uchar>(y);
+		for (int x = 0; x < size.width; x++) {
+			if (!e[x])
+				continue;
+			b[x] = anyUnder(brightCounts.data(), size, openRows, x, y) ? 255 : 0;
+			d[x] = allUnder(dilatedDarkCounts.data(), size, openRows, x, y) ? 255 : 0;
+		}
+	}
 
 	//Mat glintCandidates;
 	//bitwise_and(bright, dark, glintCandidates);
@@ -136,28 +249,74 @@ void PuReST::getThresholds(const Mat &input, const Mat &histogram, const Pupil &
 
 }
 
-void PuReST::generateCombinations(const std::vector<GreedyCandidate> &seeds, std::vector<GreedyCandidate> &candidates, const int length)
+/* Fits the seeds and all their combinations, smallest first (in the order of
+ * the former next_permutation enumeration), keeping the most confident pupil.
+ *
+ * A combination is the seed mask without its lowest bit plus that seed, so its
+ * hull is merged from those two instead of being recomputed from all points.
+ * The result is the same as fitting every combination:
+ * - a merged hull identical to its parent's (the seed lies within it) would
+ *   give the parent's fit again, which can't strictly beat the best anymore,
+ *   so it is not fitted;
+ * - nothing beats a confidence of one, so the search stops there.
+ * The work is bounded by the seed limit (see greedySearch()).
+ */
+void PuReST::searchCombinations(const std::vector<GreedyCandidate> &seeds, const float &localMinPupilDiameterPx, Pupil &best)
 {
-	if (length > seeds.size())
-		return;
+	const int n = (int) seeds.size();
+	const int subsets = 1 << n;
+	if ( (int) subsetHulls.size() < subsets )
+		subsetHulls.resize(subsets);
 
-	vector<bool> v(seeds.size());
-	fill(v.end() - length, v.end(), true);
-	do {
-		vector<Point> points;
-		for (int i = 0; i < seeds.size(); i++) {
-			if (v[i]) {
-				const vector<Point> &hull = seeds[i].hull;
-				points.insert(points.end(), hull.begin(), hull.end());
-			}
+	float minCurvatureRatio = 0.198912f; // (1-cos(22.5))/sin(22.5)
+	auto evaluate = [&](const vector<Point> &hull) {
+		if (hull.size() < 5 )
+			return;
+		Pupil p = fitEllipse(hull);
+		if (p.majorAxis() < localMinPupilDiameterPx)
+			return;
+		float aspectRatio = p.minorAxis() / (float) p.majorAxis();
+		if ( aspectRatio < minCurvatureRatio)
+			return;
+		p.confidence = outlineContrastConfidence(input, p);
+		if (p.confidence > best.confidence)
+			best = p;
+	};
+
+	// Seed i is bit n-1-i, so that masks in increasing order follow the seeds
+	for (int i = 0; i < n; i++) {
+		int mask = 1 << (n-1-i);
+		subsetHulls[mask] = seeds[i].hull;
+		evaluate(seeds[i].hull);
+		if (best.confidence >= 1)
+			return;
+	}
+
+	for (int length = 2; length <= n; length++) {
+		for (int mask = 1; mask < subsets; mask++) {
+			if (qPopulationCount( (quint32) mask ) != length)
+				continue;
+
+			const int bit = mask & -mask;
+			const int parent = mask ^ bit;
+			const GreedyCandidate &seed = seeds[n-1 - qCountTrailingZeroBits( (quint32) bit )];
+			const vector<Point> &parentHull = subsetHulls[parent];
+
+			mergedHullPoints.assign(parentHull.begin(), parentHull.end());
+			mergedHullPoints.insert(mergedHullPoints.end(), seed.hull.begin(), seed.hull.end());
+			convexHull(mergedHullPoints, subsetHulls[mask]);
+			if (subsetHulls[mask] == parentHull)
+				continue;
+			evaluate(subsetHulls[mask]);
+			if (best.confidence >= 1)
+				return;
 		}
-		candidates.emplace_back( GreedyCandidate(points) );
-	} while ( next_permutation(v.begin(), v.end()) );
+	}
 }
 
 bool PuReST::trackOutline(const cv::Mat &outlineTrackerEdges, const Pupil &basePupil, Pupil &pupil, const float &localScalingRatio, const float &minOutlineConfidence)
 {
-    vector<Point> edges;
+    vector<Point> &edges = outlineEdges;
 
     if (!outlineSeedPupil.valid()) {
         outlineSeedPupil = basePupil;
@@ -218,34 +377,21 @@ bool PuReST::greedySearch(const cv::Mat &greedyDetectorEdges, const Pupil &baseP
 	cvtColor(input, dbgGreedy, CV_GRAY2BGR);
 #endif
 
-	vector<Vec4i> hierarchy;
-	vector<vector<Point> > curves;
-    findContours( greedyDetectorEdges, curves, hierarchy, CV_RETR_LIST, CV_CHAIN_APPROX_NONE);
-	for ( auto c = curves.begin(); c != curves.end();) {
-		if (c->size() < 5)
-			c = curves.erase(c);
-		else
-			c++;
-	}
+	contours.find( greedyDetectorEdges, CV_CHAIN_APPROX_NONE );
+	contours.removeIf( [](const PointSpan &c) { return c.size() < 5; } );
 
 	// Removes shapes that are too simple
-    vector< vector<Point> > approxCurves;
-    for ( auto c = curves.begin(); c != curves.end();) {
-        vector<Point> ac;
-        approxPolyDP( *c, ac, 1.5, false);
-        if ( ac.size() > 3 ) {
-            approxCurves.push_back(ac);
-            c++;
-        } else {
-            c = curves.erase(c);
-        }
-    }
+	contours.removeIf( [this](const PointSpan &c) {
+		approxPolyDP( c.mat(), approximation, 1.5, false);
+		return approximation.size() <= 3;
+	} );
 
-	removeDuplicates(curves, greedyDetectorEdges.cols);
+	contours.removeDuplicates(greedyDetectorEdges.size());
 
-	vector<GreedyCandidate> candidates;
-	for ( int i = 0; i < curves.size(); i++ ){
-		GreedyCandidate c(curves[i]);
+	vector<GreedyCandidate> &candidates = greedyCandidates;
+	candidates.clear();
+	for ( size_t i = 0; i < contours.size(); i++ ){
+		GreedyCandidate c(contours[i]);
 
         if (c.maxGap > 1.25*basePupil.majorAxis())
 			continue;
@@ -279,7 +425,11 @@ bool PuReST::greedySearch(const cv::Mat &greedyDetectorEdges, const Pupil &baseP
 			}
 		  );
 
-	while (candidates.size() > 5)
+	// Hard work cap: at most 2^maxGreedySeeds - 1 fits; the weakest seeds
+	// (by maxGap) are dropped
+	if (candidates.size() > maxGreedySeeds)
+		searchCapped = true;
+	while (candidates.size() > maxGreedySeeds)
 		candidates.pop_back();
 
 #ifdef DBG_GREEDY_TRACKER
@@ -294,26 +444,8 @@ bool PuReST::greedySearch(const cv::Mat &greedyDetectorEdges, const Pupil &baseP
 	//waitKey(0);
 #endif
 
-	vector<GreedyCandidate> combined;
-	for (int length = 1; length <= candidates.size(); length++)
-		generateCombinations(candidates, combined, length);
-	candidates.insert( candidates.end(), make_move_iterator(combined.begin()), make_move_iterator(combined.end()) );
-
 	Pupil greedyPupil;
-	float minCurvatureRatio = 0.198912f; // (1-cos(22.5))/sin(22.5)
-	for (auto c = candidates.begin(); c != candidates.end(); c++) {
-		if (c->hull.size() < 5 )
-			continue;
-		Pupil p = fitEllipse(c->hull);
-		if (p.majorAxis() < localMinPupilDiameterPx)
-			continue;
-		float aspectRatio = p.minorAxis() / (float) p.majorAxis();
-		if ( aspectRatio < minCurvatureRatio)
-			continue;
-		p.confidence = outlineContrastConfidence(input, p);
-		if (p.confidence > greedyPupil.confidence)
-			greedyPupil = p;
-	}
+	searchCombinations(candidates, localMinPupilDiameterPx, greedyPupil);
 
 	if ( greedyPupil.valid(0.66f) ) {
 #ifdef DBG_GREEDY_TRACKER
@@ -340,8 +472,8 @@ void PuReST::run(const cv::Mat &frame, const cv::Rect &roi, const Pupil &previou
 
 	// First we get the search region in the frame coordinate system
 	Rect frameRect = { 0, 0, frame.cols, frame.rows };
-	// TODO: make this dependent on the time difference from previous pupil
-	double trackingRectHalfSide = max<int>(previousPupil.size.width, previousPupil.size.height);
+	// From the motion model if available; otherwise the pupil may have moved up to its diameter
+	double trackingRectHalfSide = searchHalfSide > 0 ? searchHalfSide : max<int>(previousPupil.size.width, previousPupil.size.height);
 	Point2f delta(trackingRectHalfSide, trackingRectHalfSide);
 	Rect trackingRect = Rect( previousPupil.center - delta, previousPupil.center + delta);
 	trackingRect &= frameRect;
@@ -371,15 +503,15 @@ void PuReST::run(const cv::Mat &frame, const cv::Rect &roi, const Pupil &previou
 	/*
 	 * From here on, we are in the resulting roi scaled to our base size coordinates
 	 */
+	// The tracking rect changes every frame; the workspace keeps the buffers
+	// sized for the largest one seen so far
+	Size inputSize( saturate_cast<int>(trackingRect.width*(double)localScalingRatio), saturate_cast<int>(trackingRect.height*(double)localScalingRatio) );
+	input = workspace.mat(WS_INPUT, inputSize, frame.type());
 	resize(frame(trackingRect), input, Size(), localScalingRatio, localScalingRatio, CV_INTER_LINEAR);
 
 	// Setup for Canny
 	workingSize = {input.cols, input.rows};
-	dx = Mat::zeros(workingSize.height, workingSize.width, CV_32F);
-	dy = Mat::zeros(workingSize.height, workingSize.width, CV_32F);
-	magnitude = Mat::zeros(workingSize.height, workingSize.width, CV_32F);
-	edgeType = Mat::zeros(workingSize.height, workingSize.width, CV_8U);
-	edge = Mat::zeros(workingSize.height, workingSize.width, CV_8U);
+	prepareEdgeDetection(workingSize);
 
 	// Pupil in our coordinate system
 	Pupil basePupil = previousPupil;
@@ -396,26 +528,30 @@ void PuReST::run(const cv::Mat &frame, const cv::Rect &roi, const Pupil &previou
 #endif
 
 	// Find glints
-	Mat histogram;
 	calculateHistogram(input, histogram, 256);
 
-	int lowTh, highTh;
-	Mat bright, dark;
-	getThresholds(input, histogram, basePupil, lowTh, highTh, bright, dark);
-
 	Mat detectedEdges = canny(input, true, true, 64, 0.7f, 0.4f);
 	filterEdges(detectedEdges);
 
-	Mat outlineTrackerEdges = detectedEdges.clone();
+	int lowTh, highTh;
+	Mat bright = workspace.mat(WS_BRIGHT, workingSize, CV_8U);
+	Mat dark = workspace.mat(WS_DARK, workingSize, CV_8U);
+	getThresholds(input, histogram, basePupil, detectedEdges, lowTh, highTh, bright, dark);
+
+	// Edges inside the dark region, excluding glints; the masks are binary,
+	// so the and is the same as clearing edges outside the dark mask
+	Mat outlineTrackerEdges = workspace.mat(WS_OUTLINE_TRACKER_EDGES, workingSize, CV_8U);
+	bitwise_and(detectedEdges, dark, outlineTrackerEdges);
 	outlineTrackerEdges.setTo(0, bright);
-	outlineTrackerEdges.setTo(0, 255 - dark);
 	if ( trackOutline(outlineTrackerEdges, basePupil, pupil, localScalingRatio) ) {
 		pupil.resize( 1.0 / localScalingRatio );
 		pupil.shift( Point2f(trackingRect.tl()) );
 		return;
 	}
 
-	Mat greedyDetectorEdges = detectedEdges.clone();
+	// findContours modifies its input
+	Mat greedyDetectorEdges = workspace.mat(WS_GREEDY_DETECTOR_EDGES, workingSize, CV_8U);
+	detectedEdges.copyTo(greedyDetectorEdges);
     if ( greedySearch(greedyDetectorEdges, basePupil, dark, bright, pupil, localScalingRatio*minPupilDiameterPx) ) {
 		pupil.resize( 1.0 / localScalingRatio );
 		pupil.shift( Point2f(trackingRect.tl()) );
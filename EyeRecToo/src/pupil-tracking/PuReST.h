@@ -50,10 +50,10 @@ class GreedyCandidate
 {
 
 public:
-	GreedyCandidate(const std::vector<cv::Point> &points) :
-		points(points)
+	GreedyCandidate(const PointSpan &points) :
+		points(points.begin(), points.end())
 	{
-		cv::convexHull(points, hull);
+		cv::convexHull(this->points, hull);
 		maxGap = 0;
 		meanPoint = {0, 0};
 		for (auto p1=hull.begin(); p1!=hull.end(); p1++) {
@@ -83,20 +83,43 @@ public:
 		PupilTrackingMethod::mDesc = desc;
 		openKernel = cv::getStructuringElement( cv::MORPH_ELLIPSE, {7,7} );
 		dilateKernel = cv::getStructuringElement( cv::MORPH_ELLIPSE, {15,15} );
+		kernelRows(openKernel, openRows);
+		kernelRows(dilateKernel, dilateRows);
 	}
 	static std::string desc;
 	void run(const cv::Mat &frame, const cv::Rect &roi, const Pupil &previousPupil, Pupil &pupil, const float &userMinPupilDiameterPx=-1, const float &userMaxPupilDiameterPx=-1);
 
 private:
+	enum PuReSTWorkspaceSlot {
+		WS_BRIGHT = WS_PURE_SLOTS,
+		WS_DARK,
+		WS_OUTLINE_TRACKER_EDGES,
+		WS_GREEDY_DETECTOR_EDGES
+	};
+	cv::Mat histogram;
+	std::vector<cv::Point> outlineEdges;
+	std::vector<cv::Point> approximation;
+	std::vector<GreedyCandidate> greedyCandidates;
+	std::vector< std::vector<cv::Point> > subsetHulls; // by seed mask
+	std::vector<cv::Point> mergedHullPoints;
+	size_t maxGreedySeeds = 5;
+
 	void calculateHistogram(const cv::Mat &in, cv::Mat &histogram, const int &bins, const cv::Mat &mask = cv::Mat());
-	void getThresholds(const cv::Mat &input, const cv::Mat &histogram, const Pupil &pupil, int &lowTh, int &highTh, cv::Mat &bright, cv::Mat &dark);
+	void getThresholds(const cv::Mat &input, const cv::Mat &histogram, const Pupil &pupil, const cv::Mat &edges, int &lowTh, int &highTh, cv::Mat &bright, cv::Mat &dark);
 	cv::Mat dilateKernel;
     cv::Mat openKernel;
+
+	// Run-length morphology for the masks: kernels as rows of (dy, first dx,
+	// last dx), images as per-row prefix counts of set pixels
+	static void kernelRows(const cv::Mat &kernel, std::vector<cv::Vec3i> &rows);
+	std::vector<cv::Vec3i> openRows, dilateRows;
+	std::vector<int> brightCounts, darkCounts, dilatedDarkCounts;
+	std::vector<uchar> dilatedDarkRow;
     Pupil outlineSeedPupil;
 
     bool greedySearch(const cv::Mat &greedyDetectorEdges, const Pupil &basePupil, const cv::Mat &dark, const cv::Mat &bright, Pupil &pupil, const float &localMinPupilDiameterPx);
 	bool trackOutline(const cv::Mat &outlineTrackerEdges, const Pupil &basePupil, Pupil &pupil, const float &localScalingRatio, const float &minOutlineConfidence = 0.65f);
-	void generateCombinations(const std::vector<GreedyCandidate> &seeds, std::vector<GreedyCandidate> &candidates, const int length);
+	void searchCombinations(const std::vector<GreedyCandidate> &seeds, const float &localMinPupilDiameterPx, Pupil &best);
 	float confidence(const cv::Mat frame, const Pupil &pupil, const std::vector<cv::Point> points);
 };
 
@@ -10,11 +10,13 @@ void PupilTrackingMethod::reset()
 {
 	previousPupils.clear();
 	previousPupil = TrackedPupil();
+	lastCorrection = std::numeric_limits<Timestamp>::min();
 	pupilDiameterKf.statePost.ptr<float>(0)[0] = 0.5*expectedFrameSize.width;
 }
 
 void PupilTrackingMethod::registerPupil( const Timestamp &ts, Pupil &pupil ) {
-	Mat measurement = ( Mat_<float>(1,1) << pupil.majorAxis() );
+	float majorAxis = pupil.majorAxis();
+	Mat measurement(1, 1, CV_32F, &majorAxis);
 	//if (predictedMaxPupilDiameter > 0) {
 	//	float &majorAxis = measurement.ptr<float>(0)[0];
 	//	if ( majorAxis > predictedMaxPupilDiameter) {
@@ -24,9 +26,19 @@ void PupilTrackingMethod::registerPupil( const Timestamp &ts, Pupil &pupil ) {
 	//}
 
 	if (pupil.confidence > minDetectionConfidence) {
-		previousPupil = TrackedPupil(ts, pupil);
-		previousPupils.emplace_back( previousPupil );
-		pupilDiameterKf.correct(measurement);
+		// Parallel detections arrive after newer samples were registered
+		TrackedPupil tracked(ts, pupil);
+		if (ts >= previousPupil.ts)
+			previousPupil = tracked;
+		auto pos = previousPupils.end();
+		while (pos != previousPupils.begin() && (pos-1)->ts > ts)
+			pos--;
+		previousPupils.insert(pos, tracked);
+		// Each frame corrects the diameter estimate once, in time order
+		if (ts > lastCorrection) {
+			pupilDiameterKf.correct(measurement);
+			lastCorrection = ts;
+		}
 	} else
 		previousPupil = TrackedPupil();
 
@@ -43,15 +55,89 @@ void PupilTrackingMethod::predictMaxPupilDiameter() {
 		predictedMaxPupilDiameter = -1;
 }
 
-void PupilTrackingMethod::run(const Timestamp &ts, const cv::Mat &frame, const cv::Rect &roi, Pupil &pupil, PupilDetectionMethod &pupilDetectionMethod)
+bool PupilTrackingMethod::predictPupil(const Timestamp &ts, Pupil &predicted)
+{
+	predicted = previousPupil;
+	searchHalfSide = -1;
+
+	if (previousPupils.size() < 2)
+		return true;
+	const TrackedPupil &last = previousPupils.back();
+	const TrackedPupil &beforeLast = previousPupils[previousPupils.size()-2];
+	if (last.ts != previousPupil.ts || last.ts <= beforeLast.ts)
+		return true;
+
+	// After dropped frames, the velocity says little about where the pupil went
+	Timestamp interval = last.ts - beforeLast.ts;
+	Timestamp dt = ts - last.ts;
+	if (dt > 2*interval)
+		return true;
+
+	cv::Point2f displacement = (last.center - beforeLast.center) * ( dt / (float) interval );
+	float diameter = previousPupil.majorAxis();
+	float distance = norm(displacement);
+	if (distance > saccadeRatio*diameter)
+		return false;
+
+	predicted.center += displacement;
+	searchHalfSide = minSearchRatio*diameter + distance;
+	return true;
+}
+
+void PupilTrackingMethod::reconcile(TrackedPupil detected)
+{
+	if (detected.confidence <= minDetectionConfidence)
+		return;
+
+	// Compare against the track's sample for the same frame
+	auto sample = previousPupils.rbegin();
+	while (sample != previousPupils.rend() && sample->ts > detected.ts)
+		sample++;
+	bool trackAgrees = sample != previousPupils.rend() && sample->ts == detected.ts &&
+		norm(sample->center - detected.center) < 0.5*detected.minorAxis();
+	if (trackAgrees)
+		return;
+
+	// Newer than anything the track has: track from it
+	if (previousPupils.empty() || detected.ts > previousPupils.back().ts) {
+		registerPupil(detected.ts, detected);
+		return;
+	}
+
+	/* The track was already off at the detection's frame, which is several
+	 * frames old by now, so restarting from the detection would look where
+	 * the pupil used to be. Instead, the drifted samples are replaced by the
+	 * detection and the track is dropped, so the next frame is detected.
+	 */
+	while (!previousPupils.empty() && previousPupils.back().ts >= detected.ts)
+		previousPupils.pop_back();
+	registerPupil(detected.ts, detected);
+	previousPupil = TrackedPupil();
+}
+
+void PupilTrackingMethod::waitForDetection()
+{
+	if (!detectionPending)
+		return;
+	detection.waitForFinished();
+	detectionPending = false;
+}
+
+void PupilTrackingMethod::run(const Timestamp &ts, const cv::Mat &frame, const cv::Rect &roi, Pupil &pupil, PupilDetectionMethod &pupilDetectionMethod, const Deadline &deadline)
 {
 	cv::Size frameSize = { frame.cols, frame.rows };
 	if (expectedFrameSize != frameSize ) {
 		// Reference frame changed. Let's start over!
 		expectedFrameSize = frameSize;
+		waitForDetection(); // belongs to the old reference frame
 		reset();
 	}
 
+	if (detectionPending && detection.isFinished()) {
+		detectionPending = false;
+		reconcile(detection.result());
+	}
+
 	// Remove old samples
 	while (!previousPupils.empty()) {
 		if (ts - previousPupils.front().ts > maxAge)
@@ -61,12 +147,41 @@ void PupilTrackingMethod::run(const Timestamp &ts, const cv::Mat &frame, const c
 	}
 
 	pupil.clear();
+	searchCapped = false;
 	predictMaxPupilDiameter();
 
+	if ( previousPupil.confidence == NO_CONFIDENCE && detectionPending ) {
+		// The pending detection may still give us something to track from (if
+		// the track was lost before its frame)
+		detection.waitForFinished();
+		detectionPending = false;
+		reconcile(detection.result());
+	}
+
+	// Saccades are not worth tracking: the pupil won't be where the outline was
+	Pupil predicted;
+	if ( previousPupil.confidence != NO_CONFIDENCE && !predictPupil(ts, predicted) )
+		previousPupil = TrackedPupil();
+
 	if ( previousPupil.confidence == NO_CONFIDENCE ) {
-		pupil = pupilDetectionMethod.runWithConfidence(frame, roi, -1, -1);
+		waitForDetection();
+		pupil = pupilDetectionMethod.runWithConfidence(frame, roi, -1, -1, deadline);
+		framesSinceDetection = 0;
 	} else {
-		run(frame, roi, previousPupil, pupil);
+		run(frame, roi, predicted, pupil);
+		framesSinceDetection++;
+
+		bool due = framesSinceDetection >= parallelDetectionInterval || pupil.confidence < minTrackConfidence;
+		if (parallelDetection && !detectionPending && due) {
+			// The frame buffer is reused once we return
+			cv::Mat detectionFrame = frame.clone();
+			PupilDetectionMethod *method = &pupilDetectionMethod;
+			detection = QtConcurrent::run( [=]() {
+				return TrackedPupil(ts, method->runWithConfidence(detectionFrame, roi));
+			});
+			detectionPending = true;
+			framesSinceDetection = 0;
+		}
 	}
 
 	registerPupil(ts, pupil);
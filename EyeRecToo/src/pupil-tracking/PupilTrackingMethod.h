@@ -3,6 +3,7 @@
 
 #include <string>
 #include <deque>
+#include <limits>
 #include <QFuture>
 
 #include "opencv2/core.hpp"
@@ -39,16 +40,33 @@ public:
 		cv::setIdentity( pupilDiameterKf.measurementNoiseCov, cv::Scalar::all(1e-2) );
 		cv::setIdentity( pupilDiameterKf.errorCovPost, cv::Scalar::all(1e-1) );
 	}
-	~PupilTrackingMethod() {}
+	virtual ~PupilTrackingMethod() { waitForDetection(); }
 
 	// Tracking and detection logic
-	void run(const Timestamp &ts, const cv::Mat &frame, const cv::Rect &roi, Pupil &pupil, PupilDetectionMethod &pupilDetectionMethod);
+	void run(const Timestamp &ts, const cv::Mat &frame, const cv::Rect &roi, Pupil &pupil, PupilDetectionMethod &pupilDetectionMethod, const Deadline &deadline=Deadline());
+
+	/* Parallel detection: while tracking, the full detection also runs in the
+	 * background every interval frames (or as soon as the track confidence
+	 * drops), and its result is reconciled with the track once it's ready.
+	 * An interval of zero disables it.
+	 */
+	void setParallelDetection(const int &interval) {
+		parallelDetection = interval > 0;
+		parallelDetectionInterval = interval;
+	}
+	// Detection methods need not be reentrant (e.g., PuRe keeps scratch state):
+	// call before using the one given to run() from somewhere else
+	void waitForDetection();
 
 	// Tracking implementation
 	virtual void run(const cv::Mat &frame, const cv::Rect &roi, const Pupil &previousPupil, Pupil &pupil, const float &minPupilDiameterPx=-1, const float &maxPupilDiameterPx=-1) = 0;
 
 	std::string description() { return mDesc; }
 
+	// Whether the last run() left part of its search out due to a work cap
+	// (e.g., PuReST dropping greedy seeds beyond its limit)
+	bool capped() const { return searchCapped; }
+
 private:
 
 protected:
@@ -62,14 +80,30 @@ protected:
 	Timestamp maxTrackingWithoutDetectionTime = 5000;
 	Timestamp lastDetection;
 	bool parallelDetection = false;
+	int parallelDetectionInterval = 0;
+	int framesSinceDetection = 0;
+	bool detectionPending = false;
+	bool searchCapped = false;
+	QFuture<TrackedPupil> detection;
 	float minDetectionConfidence = 0.7f;
 	float minTrackConfidence = 0.9f;
 
 	cv::KalmanFilter pupilDiameterKf;
+	Timestamp lastCorrection = std::numeric_limits<Timestamp>::min();
 	float predictedMaxPupilDiameter = -1;
 
+	// Constant velocity model on the pupil center, from the last two samples.
+	// The search window half side is minSearchRatio times the pupil diameter
+	// plus the predicted displacement; displacements beyond saccadeRatio
+	// diameters go straight to detection. -1 means the implementation's default.
+	float searchHalfSide = -1;
+	float minSearchRatio = 0.75f;
+	float saccadeRatio = 1.0f;
+	bool predictPupil(const Timestamp &ts, Pupil &predicted);
+
 	void predictMaxPupilDiameter();
 	void registerPupil(const Timestamp &ts, Pupil &pupil);
+	void reconcile(TrackedPupil detected);
 
 	void reset();
 };
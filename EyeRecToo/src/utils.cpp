@@ -163,6 +163,14 @@ QString toQString(QVideoFrame::PixelFormat format) {
             return "RGB32";
         case QVideoFrame::Format_RGB24:
             return "RGB24";
+        case QVideoFrame::Format_UYVY:
+            return "UYVY";
+        case QVideoFrame::Format_NV12:
+            return "NV12";
+        case QVideoFrame::Format_Y8:
+            return "Y8";
+        case QVideoFrame::Format_Y16:
+            return "Y16";
         case QVideoFrame::Format_Invalid:
             return "Invalid";
         default:
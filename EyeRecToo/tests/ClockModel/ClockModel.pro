@@ -0,0 +1,23 @@
+# Checks the camera clock model (convergence, outlier gating, restarts) on
+# synthetic timestamps; e.g., qmake && make && make check
+
+QT       += core gui widgets multimedia testlib
+
+CONFIG += c++14 console testcase
+CONFIG -= app_bundle
+
+TOP = $$PWD/../..
+
+TARGET = tst_ClockModel
+TEMPLATE = app
+
+SOURCES += \
+	tst_ClockModel.cpp \
+	$${TOP}/src/ClockModel.cpp
+
+HEADERS += \
+	$${TOP}/src/ClockModel.h
+
+# utils.h pulls in the OpenCV headers, but nothing from it is linked
+INCLUDEPATH += "$${TOP}/src"
+INCLUDEPATH += "$${TOP}/deps/opencv-3.2.0/include/"
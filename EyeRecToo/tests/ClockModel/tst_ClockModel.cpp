@@ -0,0 +1,112 @@
+#include <QtTest>
+
+#include <cmath>
+#include <random>
+
+#include "ClockModel.h"
+
+using namespace std;
+
+/* Synthetic camera clock: the device counts ms from its own epoch, runs
+ * Skew fast relative to gTimer, and each frame reaches the host 0-2 ms
+ * after it was stamped (plus the host timer's ms truncation).
+ */
+class ClockModelTest : public QObject
+{
+	Q_OBJECT
+
+private slots:
+	void init();
+	void converges();
+	void gatesDelayedSamples();
+	void restartsAfterDeviceReset();
+
+private:
+	static const int Period = 33;
+	static const int SettleFrames = 900; // ~30 s
+	static constexpr double Offset = 5000;
+	static constexpr double Skew = 50e-6;
+	static constexpr double Tolerance = 2; // ms, the jitter span
+
+	ClockModel model;
+	mt19937 rng;
+	uniform_real_distribution<double> delay;
+	qint64 device;
+	double offset;
+
+	double ideal() const { return offset + device * (1 + Skew); }
+	// Advances one frame and returns the corrected timestamp minus the delay-free host time
+	double step(const double &extraDelay = 0)
+	{
+		device += Period;
+		Timestamp host = (Timestamp) floor( ideal() + delay(rng) + extraDelay );
+		return model.update(host, device) - ideal();
+	}
+	void settle() {
+		for (int i=0; i<SettleFrames; i++)
+			step();
+	}
+};
+
+void ClockModelTest::init()
+{
+	model = ClockModel();
+	rng.seed(0xC10C);
+	delay = uniform_real_distribution<double>(0, Tolerance);
+	device = 1000000;
+	offset = Offset;
+}
+
+void ClockModelTest::converges()
+{
+	settle();
+
+	double maxError = 0;
+	for (int i=0; i<3*SettleFrames; i++)
+		maxError = max<double>(maxError, fabs(step()));
+
+	QVERIFY2( maxError <= Tolerance, qPrintable( QString("Corrected timestamps off by up to %1 ms").arg(maxError) ) );
+	QVERIFY2( fabs(model.driftPpm() - 1e6 * Skew) < 5, qPrintable( QString("Drift estimated at %1 ppm").arg(model.driftPpm()) ) );
+	QVERIFY( model.jitterMs() < Tolerance );
+	QCOMPARE( model.outlierCount(), 0ul );
+}
+
+void ClockModelTest::gatesDelayedSamples()
+{
+	settle();
+
+	// A frame 6 ms late (e.g., a busy camera thread) is far outside the jitter
+	// and must not pull the model towards the late host time
+	double error = step(6);
+	QCOMPARE( model.outlierCount(), 1ul );
+	QVERIFY2( fabs(error) <= Tolerance, qPrintable( QString("Delayed frame corrected to %1 ms off").arg(error) ) );
+
+	for (int i=0; i<10; i++)
+		QVERIFY( fabs(step()) <= Tolerance );
+	QCOMPARE( model.outlierCount(), 1ul );
+}
+
+void ClockModelTest::restartsAfterDeviceReset()
+{
+	settle();
+
+	// The device clock restarts from zero; the host time keeps going
+	offset = ideal();
+	device = 0;
+
+	// Up to 30 consecutive outliers are rejected and the old model is kept...
+	for (int i=0; i<30; i++)
+		QVERIFY( fabs(step()) > 1000 );
+	QCOMPARE( model.outlierCount(), 30ul );
+
+	// ...the next one restarts it, and it tracks the new clock right away
+	QVERIFY( fabs(step()) <= Tolerance );
+	QCOMPARE( model.outlierCount(), 31ul );
+	for (int i=0; i<SettleFrames; i++)
+		QVERIFY( fabs(step()) <= Tolerance );
+	QCOMPARE( model.outlierCount(), 31ul );
+}
+
+QTEST_APPLESS_MAIN(ClockModelTest)
+
+#include "tst_ClockModel.moc"
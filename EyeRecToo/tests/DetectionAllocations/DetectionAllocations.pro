@@ -0,0 +1,65 @@
+# Counts the heap allocations of PuRe and PuReST in steady state, on synthetic
+# frames or a recorded eye video (EYERECTOO_ALLOCATION_VIDEO); e.g.,
+# qmake && make && make check
+
+QT       += core gui widgets multimedia concurrent testlib
+
+CONFIG += c++14 console testcase
+CONFIG -= app_bundle
+
+TOP = $$PWD/../..
+
+DEFINES += COUNT_ALLOCATIONS
+
+TARGET = tst_DetectionAllocations
+TEMPLATE = app
+
+SOURCES += \
+	tst_DetectionAllocations.cpp \
+	$${TOP}/src/AllocationCounter.cpp \
+	$${TOP}/src/WorkerPool.cpp \
+	$${TOP}/src/pupil-detection/PupilDetectionMethod.cpp \
+	$${TOP}/src/pupil-detection/PuRe.cpp \
+	$${TOP}/src/pupil-detection/EdgeFilter.cpp \
+	$${TOP}/src/pupil-detection/ContourSet.cpp \
+	$${TOP}/src/pupil-detection/EllipseSampler.cpp \
+	$${TOP}/src/pupil-tracking/PupilTrackingMethod.cpp \
+	$${TOP}/src/pupil-tracking/PuReST.cpp
+
+HEADERS += \
+	$${TOP}/src/AllocationCounter.h \
+	$${TOP}/src/WorkerPool.h \
+	$${TOP}/src/pupil-detection/PupilDetectionMethod.h \
+	$${TOP}/src/pupil-detection/PuRe.h \
+	$${TOP}/src/pupil-detection/Workspace.h \
+	$${TOP}/src/pupil-detection/EdgeFilter.h \
+	$${TOP}/src/pupil-detection/ContourSet.h \
+	$${TOP}/src/pupil-detection/EllipseSampler.h \
+	$${TOP}/src/pupil-tracking/PupilTrackingMethod.h \
+	$${TOP}/src/pupil-tracking/PuReST.h
+
+# utils.h is included by the tracking, but nothing from it is linked
+INCLUDEPATH += "$${TOP}/src"
+unix{
+    LIBS += "-L$${TOP}/deps/runtime/x86_64-linux-gnu/"
+    LIBS += -lpthread
+}
+
+Debug:DBG_SUFFIX = "d"
+
+OPENCVPATH="$${TOP}/deps/opencv-3.2.0"
+INCLUDEPATH += $${OPENCVPATH}/include/
+win32:CV_SUFFIX=320$${DBG_SUFFIX}
+unix:CV_SUFFIX=$${DBG_SUFFIX}
+win32:contains(QMAKE_HOST.arch, x86_64) {
+    LIBS += "-L$${OPENCVPATH}/x64/vc14/lib/"
+} else {
+    LIBS += "-L$${OPENCVPATH}/x86/vc14/lib/"
+}
+LIBS += \
+    -lopencv_core$${CV_SUFFIX} \
+    -lopencv_highgui$${CV_SUFFIX} \
+    -lopencv_imgcodecs$${CV_SUFFIX} \
+    -lopencv_imgproc$${CV_SUFFIX} \
+    -lopencv_video$${CV_SUFFIX} \
+    -lopencv_videoio$${CV_SUFFIX}
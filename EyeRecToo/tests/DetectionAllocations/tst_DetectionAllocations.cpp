@@ -0,0 +1,250 @@
+#include <QtTest>
+
+#include <algorithm>
+#include <vector>
+
+#include <opencv2/imgproc.hpp>
+#include <opencv2/imgproc/imgproc_c.h>
+#include <opencv2/videoio.hpp>
+
+#include "AllocationCounter.h"
+#include "pupil-detection/PuRe.h"
+#include "pupil-detection/ContourSet.h"
+#include "pupil-detection/EllipseSampler.h"
+#include "pupil-tracking/PuReST.h"
+
+using namespace cv;
+using namespace std;
+
+/* Heap allocations of the detectors once warmed up, counted by the
+ * AllocationCounter (built with COUNT_ALLOCATIONS). Every pass after the
+ * first repeats the same work, so whatever is counted there is allocated
+ * per call, not grown into.
+ *
+ * Our own code must not allocate: the ellipse sampler not at all, and the
+ * contour extraction nothing beyond what cvFindContours itself does. For
+ * PuRe and PuReST as a whole, the floor left inside OpenCV (e.g., the
+ * fitEllipse solver) is measured and reported per frame. Recorded eye
+ * videos can be measured by pointing EYERECTOO_ALLOCATION_VIDEO at one
+ * (e.g., a LeftEye.mp4 from the recorder).
+ */
+class DetectionAllocations : public QObject
+{
+	Q_OBJECT
+
+private slots:
+	void initTestCase();
+	void bandMatchesEllipse();
+	void samplerDoesNotAllocate();
+	void contoursAllocateLikeOpenCV();
+	void detectorsFloor();
+
+private:
+	vector<Mat> frames;
+	vector<RotatedRect> ellipses;
+	vector<int> bands;
+};
+
+// Gives access to the workspace growth
+class PuReProbe : public PuRe
+{
+public:
+	unsigned int growthCount() const { return workspace.growthCount(); }
+};
+
+struct Floor {
+	vector<unsigned long long> perFrame;
+	void add(const unsigned long long &allocations) { perFrame.push_back(allocations); }
+	QString summary() {
+		sort(perFrame.begin(), perFrame.end());
+		return QString("min %1, median %2, max %3 allocations per frame")
+			.arg(perFrame.front()).arg(perFrame[perFrame.size() / 2]).arg(perFrame.back());
+	}
+};
+
+void DetectionAllocations::initTestCase()
+{
+	QByteArray video = qgetenv("EYERECTOO_ALLOCATION_VIDEO");
+	if (!video.isEmpty()) {
+		VideoCapture capture(video.constData());
+		QVERIFY2( capture.isOpened(), qPrintable( QString("Could not open %1").arg(video.constData()) ) );
+		Mat bgr, gray;
+		while (capture.read(bgr)) {
+			cvtColor(bgr, gray, CV_BGR2GRAY);
+			frames.push_back(gray.clone());
+		}
+		QVERIFY2( !frames.empty(), "No frames in the video" );
+	} else {
+		// Synthetic eye images (see DetectorConcurrency), moving smoothly so
+		// that PuReST keeps tracking
+		RNG rng(0xA11);
+		for (int i=0; i<48; i++) {
+			Mat frame(240, 320, CV_8UC1);
+			for (int r=0; r<frame.rows; r++)
+				frame.row(r).setTo( Scalar(150 + 40 * r / frame.rows) );
+			Point2f center(110 + 2.0f * i, 95 + 1.5f * (i % 12));
+			float diameter = 30 + (i % 8) * 2;
+			ellipse(frame, RotatedRect(center, Size2f(2.6f * diameter, 2.5f * diameter), 0), Scalar(95), -1, LINE_AA);
+			ellipse(frame, RotatedRect(center, Size2f(diameter, 0.85f * diameter), 5.0f * i), Scalar(30), -1, LINE_AA);
+			circle(frame, center + Point2f(0.2f * diameter, -0.2f * diameter), 3, Scalar(250), -1, LINE_AA);
+			Mat noise(frame.size(), CV_8SC1);
+			rng.fill(noise, RNG::NORMAL, 0, 6);
+			add(frame, noise, frame, noArray(), CV_8U);
+			GaussianBlur(frame, frame, Size(3, 3), 0);
+			frames.push_back(frame);
+		}
+	}
+
+	// Outlines of all sizes and angles, fractional centers, some crossing the image border
+	RNG rng(0xE11);
+	for (int i=0; i<2000; i++) {
+		Point2f center( rng.uniform(-20.0f, 340.0f), rng.uniform(-20.0f, 260.0f) );
+		Size2f size( rng.uniform(0.0f, 1.0f) < 0.1f ? rng.uniform(0.0f, 4.0f) : rng.uniform(4.0f, 220.0f), rng.uniform(0.0f, 220.0f) );
+		ellipses.push_back( RotatedRect(center, size, rng.uniform(-400.0f, 400.0f)) );
+		bands.push_back( rng.uniform(1, 6) );
+	}
+}
+
+void DetectionAllocations::bandMatchesEllipse()
+{
+	// All edges, so the band itself is returned
+	Mat edges(240, 320, CV_8UC1, Scalar(255));
+	vector<Point> band, reference;
+	for (size_t i=0; i<ellipses.size(); i++) {
+		EllipseSampler::local().bandEdges(edges, ellipses[i], bands[i], band);
+
+		// What bandEdges drew before: cv::ellipse over the same region
+		reference.clear();
+		const int margin = bands[i] + 2;
+		Rect roi = ellipses[i].boundingRect();
+		roi = Rect(roi.x - margin, roi.y - margin, roi.width + 2*margin, roi.height + 2*margin) & Rect(0, 0, edges.cols, edges.rows);
+		if (roi.area() > 0) {
+			Mat mask = Mat::zeros(roi.size(), CV_8U);
+			RotatedRect shifted = ellipses[i];
+			shifted.center.x -= roi.x;
+			shifted.center.y -= roi.y;
+			cv::ellipse(mask, shifted, Scalar(255), bands[i]);
+			for (int y=0; y<mask.rows; y++)
+				for (int x=0; x<mask.cols; x++)
+					if (mask.at<uchar>(y, x))
+						reference.push_back( Point(roi.x + x, roi.y + y) );
+		}
+
+		QVERIFY2( band == reference,
+			qPrintable( QString("Ellipse %1 (%2,%3 %4x%5 @%6, band %7): %8 pixels instead of %9")
+				.arg(i).arg(ellipses[i].center.x).arg(ellipses[i].center.y)
+				.arg(ellipses[i].size.width).arg(ellipses[i].size.height).arg(ellipses[i].angle)
+				.arg(bands[i]).arg(band.size()).arg(reference.size()) ) );
+	}
+}
+
+void DetectionAllocations::samplerDoesNotAllocate()
+{
+	Mat edges(240, 320, CV_8UC1, Scalar(255));
+	Mat intensity = frames.front();
+	EllipseSampler &sampler = EllipseSampler::local();
+	vector<Point> band;
+	band.reserve(edges.total());
+	float contrast;
+
+	unsigned long long allocations = 0;
+	for (int pass=0; pass<2; pass++) {
+		unsigned long long before = AllocationCounter::count();
+		for (size_t i=0; i<ellipses.size(); i++) {
+			sampler.bandEdges(edges, ellipses[i], bands[i], band);
+			if (ellipses[i].boundingRect().area() > 0 && Rect(0, 0, intensity.cols, intensity.rows).contains(ellipses[i].center))
+				sampler.outlineContrast(intensity, ellipses[i], 5, 5, contrast);
+		}
+		allocations = AllocationCounter::count() - before;
+	}
+	QCOMPARE(allocations, 0ull);
+}
+
+void DetectionAllocations::contoursAllocateLikeOpenCV()
+{
+	vector<Mat> edges;
+	for (size_t f=0; f<frames.size(); f++) {
+		Mat e;
+		Canny(frames[f], e, 40, 100);
+		edges.push_back(e);
+	}
+
+	// As PuRe and PuReST use it
+	const int methods[] = { CV_CHAIN_APPROX_TC89_KCOS, CV_CHAIN_APPROX_NONE };
+	for (int m=0; m<2; m++) {
+		ContourSet contours;
+		CvMemStorage *storage = cvCreateMemStorage();
+		Mat image = edges.front().clone();
+
+		unsigned long long ours = 0, opencv = 0;
+		for (int pass=0; pass<2; pass++) {
+			ours = opencv = 0;
+			for (size_t f=0; f<edges.size(); f++) {
+				edges[f].copyTo(image);
+				unsigned long long before = AllocationCounter::count();
+				contours.find(image, methods[m]);
+				contours.removeDuplicates(image.size());
+				ours += AllocationCounter::count() - before;
+
+				edges[f].copyTo(image);
+				CvMat cImage = image;
+				CvSeq *first = NULL;
+				before = AllocationCounter::count();
+				cvClearMemStorage(storage);
+				cvFindContours(&cImage, storage, &first, sizeof(CvContour), CV_RETR_LIST, methods[m]);
+				opencv += AllocationCounter::count() - before;
+			}
+		}
+		cvReleaseMemStorage(&storage);
+
+		qInfo() << "Method" << methods[m] << ":" << opencv << "allocations in cvFindContours over" << edges.size() << "frames";
+		QCOMPARE(ours, opencv);
+	}
+}
+
+void DetectionAllocations::detectorsFloor()
+{
+	PuReProbe pure;
+	PuReST purest;
+	const Rect full(0, 0, frames.front().cols, frames.front().rows);
+	Floor pureFloor, purestFloor;
+	unsigned int growths = 0;
+	int tracked = 0;
+
+	for (int pass=0; pass<2; pass++) {
+		if (pass == 1)
+			growths = pure.growthCount();
+		Pupil previous;
+		for (size_t f=0; f<frames.size(); f++) {
+			Pupil detected, pupil;
+			unsigned long long before = AllocationCounter::count();
+			pure.run(frames[f], detected);
+			unsigned long long pureAllocations = AllocationCounter::count() - before;
+
+			unsigned long long purestAllocations = 0;
+			if (previous.valid()) {
+				before = AllocationCounter::count();
+				purest.run(frames[f], full, previous, pupil);
+				purestAllocations = AllocationCounter::count() - before;
+			}
+
+			if (pass == 1) {
+				pureFloor.add(pureAllocations);
+				if (previous.valid()) {
+					purestFloor.add(purestAllocations);
+					tracked++;
+				}
+			}
+			previous = pupil.valid() ? pupil : detected;
+		}
+	}
+
+	QVERIFY2( tracked > 0, "Nothing was tracked; the frames don't exercise PuReST" );
+	QCOMPARE(pure.growthCount(), growths);
+	qInfo() << "PuRe:" << qPrintable(pureFloor.summary());
+	qInfo() << "PuReST:" << qPrintable(purestFloor.summary()) << "over" << tracked << "tracked frames";
+}
+
+QTEST_APPLESS_MAIN(DetectionAllocations)
+
+#include "tst_DetectionAllocations.moc"
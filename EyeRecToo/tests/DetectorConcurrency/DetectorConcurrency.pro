@@ -0,0 +1,52 @@
+# Runs ElSe and ExCuSe from many threads at once and checks the results
+# against a serial run; e.g., qmake && make && make check
+
+QT       += core testlib
+QT       -= gui
+
+CONFIG += c++14 console testcase
+CONFIG -= app_bundle
+
+TOP = $$PWD/../..
+
+TARGET = tst_DetectorConcurrency
+TEMPLATE = app
+
+SOURCES += \
+	tst_DetectorConcurrency.cpp \
+	$${TOP}/src/pupil-detection/PupilDetectionMethod.cpp \
+	$${TOP}/src/pupil-detection/EllipseSampler.cpp \
+	$${TOP}/src/pupil-detection/EdgeFilter.cpp \
+	$${TOP}/src/pupil-detection/ElSe.cpp \
+	$${TOP}/src/pupil-detection/ExCuSe.cpp
+
+HEADERS += \
+	$${TOP}/src/pupil-detection/PupilDetectionMethod.h \
+	$${TOP}/src/pupil-detection/EllipseSampler.h \
+	$${TOP}/src/pupil-detection/Workspace.h \
+	$${TOP}/src/pupil-detection/EdgeFilter.h \
+	$${TOP}/src/pupil-detection/ElSe.h \
+	$${TOP}/src/pupil-detection/ExCuSe.h
+
+INCLUDEPATH += "$${TOP}/src"
+unix{
+    LIBS += "-L$${TOP}/deps/runtime/x86_64-linux-gnu/"
+    LIBS += -lpthread
+}
+
+Debug:DBG_SUFFIX = "d"
+
+OPENCVPATH="$${TOP}/deps/opencv-3.2.0"
+INCLUDEPATH += $${OPENCVPATH}/include/
+win32:CV_SUFFIX=320$${DBG_SUFFIX}
+unix:CV_SUFFIX=$${DBG_SUFFIX}
+win32:contains(QMAKE_HOST.arch, x86_64) {
+    LIBS += "-L$${OPENCVPATH}/x64/vc14/lib/"
+} else {
+    LIBS += "-L$${OPENCVPATH}/x86/vc14/lib/"
+}
+LIBS += \
+    -lopencv_core$${CV_SUFFIX} \
+    -lopencv_highgui$${CV_SUFFIX} \
+    -lopencv_imgcodecs$${CV_SUFFIX} \
+    -lopencv_imgproc$${CV_SUFFIX}
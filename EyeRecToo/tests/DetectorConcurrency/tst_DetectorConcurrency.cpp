@@ -0,0 +1,132 @@
+#include <QtTest>
+
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include <opencv2/imgproc.hpp>
+
+#include "pupil-detection/ElSe.h"
+#include "pupil-detection/ExCuSe.h"
+
+using namespace cv;
+using namespace std;
+
+/* Many detector instances, each in its own thread, must give exactly the
+ * same results as a single instance processing the same frames serially.
+ * Threads start at different frames, and the diameter limits change per
+ * frame, so any state shared between instances (e.g., the area limits ElSe
+ * used to keep in static members) shows up as a mismatch.
+ */
+class DetectorConcurrency : public QObject
+{
+	Q_OBJECT
+
+private slots:
+	void initTestCase();
+	void elseMatchesSerial() { check<ElSe>(); }
+	void excuseMatchesSerial() { check<ExCuSe>(); }
+
+private:
+	static const int FrameCount = 24;
+	static const int ThreadCount = 8;
+	static const int Rounds = 3;
+
+	vector<Mat> frames;
+
+	struct Result {
+		RotatedRect full;
+		Pupil roi;
+	};
+
+	Rect roi(const int &i) const { return Rect(20 + i % 5, 16 + i % 3, 280 - 2 * (i % 7), 200 - i % 4); }
+	float minDiameter(const int &i) const { return 10 + 2 * (i % 4); }
+	float maxDiameter(const int &i) const { return 60 + 10 * (i % 3); }
+
+	template<class Method>
+	Result detect(Method &method, const int &i) const
+	{
+		Result result;
+		result.full = method.run(frames[i]);
+		method.run(frames[i], roi(i), result.roi, minDiameter(i), maxDiameter(i));
+		return result;
+	}
+
+	template<class Method>
+	void check();
+};
+
+// Bitwise equal, so NaNs compare equal to themselves
+static bool same(const float &a, const float &b) { return memcmp(&a, &b, sizeof(float)) == 0; }
+static bool same(const RotatedRect &a, const RotatedRect &b)
+{
+	return same(a.center.x, b.center.x) && same(a.center.y, b.center.y)
+		&& same(a.size.width, b.size.width) && same(a.size.height, b.size.height)
+		&& same(a.angle, b.angle);
+}
+
+void DetectorConcurrency::initTestCase()
+{
+	// Synthetic eye images: a dark pupil inside a darker iris, a glint, and
+	// sensor noise, moving and changing size from frame to frame
+	RNG rng(0xE1E);
+	for (int i=0; i<FrameCount; i++) {
+		Mat frame(240, 320, CV_8UC1);
+		for (int r=0; r<frame.rows; r++)
+			frame.row(r).setTo( Scalar(150 + 40 * r / frame.rows) );
+
+		Point2f center(110 + 4.0f * i, 95 + 2.5f * (i % 9));
+		float diameter = 24 + (i % 6) * 6;
+		ellipse(frame, RotatedRect(center, Size2f(2.6f * diameter, 2.5f * diameter), 0), Scalar(95), -1, LINE_AA);
+		ellipse(frame, RotatedRect(center, Size2f(diameter, 0.85f * diameter), 15.0f * i), Scalar(30), -1, LINE_AA);
+		circle(frame, center + Point2f(0.2f * diameter, -0.2f * diameter), 3, Scalar(250), -1, LINE_AA);
+
+		Mat noise(frame.size(), CV_8SC1);
+		rng.fill(noise, RNG::NORMAL, 0, 6);
+		add(frame, noise, frame, noArray(), CV_8U);
+		GaussianBlur(frame, frame, Size(3, 3), 0);
+		frames.push_back(frame);
+	}
+}
+
+template<class Method>
+void DetectorConcurrency::check()
+{
+	vector<Result> serial(FrameCount);
+	{
+		Method method;
+		for (int i=0; i<FrameCount; i++)
+			serial[i] = detect(method, i);
+	}
+
+	int found = 0;
+	for (int i=0; i<FrameCount; i++)
+		if (serial[i].full.center.x > 0)
+			found++;
+	QVERIFY2(found > 0, "No pupil found at all; the frames don't exercise the detector");
+
+	// Each thread keeps its mismatches; QVERIFY may only be used in this one
+	vector< vector<int> > mismatches(ThreadCount);
+	vector<std::thread> threads;
+	for (int t=0; t<ThreadCount; t++)
+		threads.push_back( std::thread([this, t, &serial, &mismatches]() {
+			Method method;
+			for (int k=0; k<Rounds * FrameCount; k++) {
+				int i = (t * FrameCount / ThreadCount + k) % FrameCount;
+				Result result = detect(method, i);
+				if ( !same(result.full, serial[i].full) || !same(result.roi, serial[i].roi) || !same(result.roi.confidence, serial[i].roi.confidence) )
+					mismatches[t].push_back(i);
+			}
+		}) );
+	for (auto t = threads.begin(); t != threads.end(); t++)
+		t->join();
+
+	for (int t=0; t<ThreadCount; t++)
+		QVERIFY2( mismatches[t].empty(),
+			qPrintable( QString("Thread %1 differs from the serial run at %2 frame(s), first at frame %3")
+				.arg(t).arg(mismatches[t].size()).arg(mismatches[t].empty() ? -1 : mismatches[t].front()) ) );
+}
+
+QTEST_APPLESS_MAIN(DetectorConcurrency)
+
+#include "tst_DetectorConcurrency.moc"
@@ -0,0 +1,58 @@
+# Checks PuRe's vectorized canny against the scalar algorithm, on synthetic
+# frames or a recorded eye video (EYERECTOO_CANNY_VIDEO); e.g.,
+# qmake && make && make check
+
+QT       += core testlib
+QT       -= gui
+
+CONFIG += c++14 console testcase
+CONFIG -= app_bundle
+
+TOP = $$PWD/../..
+
+TARGET = tst_PuReCanny
+TEMPLATE = app
+
+SOURCES += \
+	tst_PuReCanny.cpp \
+	$${TOP}/src/AllocationCounter.cpp \
+	$${TOP}/src/WorkerPool.cpp \
+	$${TOP}/src/pupil-detection/PupilDetectionMethod.cpp \
+	$${TOP}/src/pupil-detection/PuRe.cpp \
+	$${TOP}/src/pupil-detection/EdgeFilter.cpp \
+	$${TOP}/src/pupil-detection/ContourSet.cpp \
+	$${TOP}/src/pupil-detection/EllipseSampler.cpp
+
+HEADERS += \
+	$${TOP}/src/AllocationCounter.h \
+	$${TOP}/src/WorkerPool.h \
+	$${TOP}/src/pupil-detection/PupilDetectionMethod.h \
+	$${TOP}/src/pupil-detection/PuRe.h \
+	$${TOP}/src/pupil-detection/Workspace.h \
+	$${TOP}/src/pupil-detection/EdgeFilter.h \
+	$${TOP}/src/pupil-detection/ContourSet.h \
+	$${TOP}/src/pupil-detection/EllipseSampler.h
+
+INCLUDEPATH += "$${TOP}/src"
+unix{
+    LIBS += "-L$${TOP}/deps/runtime/x86_64-linux-gnu/"
+    LIBS += -lpthread
+}
+
+Debug:DBG_SUFFIX = "d"
+
+OPENCVPATH="$${TOP}/deps/opencv-3.2.0"
+INCLUDEPATH += $${OPENCVPATH}/include/
+win32:CV_SUFFIX=320$${DBG_SUFFIX}
+unix:CV_SUFFIX=$${DBG_SUFFIX}
+win32:contains(QMAKE_HOST.arch, x86_64) {
+    LIBS += "-L$${OPENCVPATH}/x64/vc14/lib/"
+} else {
+    LIBS += "-L$${OPENCVPATH}/x86/vc14/lib/"
+}
+LIBS += \
+    -lopencv_core$${CV_SUFFIX} \
+    -lopencv_highgui$${CV_SUFFIX} \
+    -lopencv_imgcodecs$${CV_SUFFIX} \
+    -lopencv_imgproc$${CV_SUFFIX} \
+    -lopencv_videoio$${CV_SUFFIX}
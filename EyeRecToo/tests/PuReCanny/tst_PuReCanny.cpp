@@ -0,0 +1,258 @@
+#include <QtTest>
+
+#include <cmath>
+#include <vector>
+
+#include <opencv2/imgproc.hpp>
+#include <opencv2/videoio.hpp>
+
+#include "pupil-detection/PuRe.h"
+
+using namespace cv;
+using namespace std;
+
+/* PuRe's canny runs its magnitude, histogram and non-maximum suppression row
+ * kernels with OpenCV's universal intrinsics. They must give exactly the
+ * edges of the plain scalar algorithm; the frames have odd widths, so the
+ * scalar tails run too.
+ *
+ * Recorded eye videos can be checked as well by pointing
+ * EYERECTOO_CANNY_VIDEO at one (e.g., a LeftEye.mp4 from the recorder).
+ * Every frame is then compared, and the difference to the original canny
+ * (which normalized the magnitude before thresholding) is reported.
+ */
+class PuReCanny : public QObject
+{
+	Q_OBJECT
+
+private slots:
+	void initTestCase();
+	void matchesScalar();
+
+private:
+	vector<Mat> frames;
+};
+
+// Gives access to the canny with the buffers a detection would use
+class CannyProbe : public PuRe
+{
+public:
+	Mat edges(const Mat &in)
+	{
+		prepareEdgeDetection(in.size());
+		return canny(in, true, true, Bins, NonEdgePixelsRatio, LowHighThresholdRatio).clone();
+	}
+	Mat edgeTypes() const { return edgeType.clone(); }
+
+	static const int Bins = 64;
+	static constexpr float NonEdgePixelsRatio = 0.7f;
+	static constexpr float LowHighThresholdRatio = 0.4f;
+};
+
+static const float tg22_5 = 0.4142135623730950488016887242097f;
+static const float tg67_5 = 2.4142135623730950488016887242097f;
+
+static void suppressNonMaxima(const Mat &dx, const Mat &dy, const Mat &magnitude, const float &low_th, const float &high_th, Mat &edgeType)
+{
+	edgeType = Mat::zeros(magnitude.size(), CV_8U);
+	for (int i=1; i<magnitude.rows-1; i++) {
+		const float *p_res = magnitude.ptr<float>(i);
+		const float *p_res_t = magnitude.ptr<float>(i-1);
+		const float *p_res_b = magnitude.ptr<float>(i+1);
+		const float *p_x = dx.ptr<float>(i);
+		const float *p_y = dy.ptr<float>(i);
+		uchar *_edgeType = edgeType.ptr<uchar>(i);
+		for (int j=1; j<magnitude.cols-1; j++) {
+			float m = p_res[j];
+			if (m < low_th)
+				continue;
+			float iy = p_y[j];
+			float ix = p_x[j];
+			float y = abs( (double) iy );
+			float x = abs( (double) ix );
+			uchar val = m > high_th ? 255 : 128;
+			if (y < tg22_5 * x) {
+				if (m > p_res[j-1] && m >= p_res[j+1])
+					_edgeType[j] = val;
+			} else if (y > tg67_5 * x) {
+				if (m > p_res_b[j] && m >= p_res_t[j])
+					_edgeType[j] = val;
+			} else if ( (iy<=0) == (ix<=0) ) {
+				if (m > p_res_t[j-1] && m >= p_res_b[j+1])
+					_edgeType[j] = val;
+			} else {
+				if (m > p_res_b[j-1] && m >= p_res_t[j+1])
+					_edgeType[j] = val;
+			}
+		}
+	}
+}
+
+static Mat hysteresis(const Mat &edgeType)
+{
+	Mat edge = Mat::zeros(edgeType.size(), CV_8U);
+	const int cols = edgeType.cols;
+	const int area = edgeType.rows * cols;
+	vector<int> lines;
+	for (int i=1; i<edgeType.rows-1; i++)
+		for (int j=1; j<cols-1; j++) {
+			int start = i*cols + j;
+			if (edgeType.data[start] != 255 || edge.data[start] != 0)
+				continue;
+			edge.data[start] = 255;
+			lines.assign(1, start);
+			for (size_t k=0; k<lines.size(); k++) {
+				int pos = lines[k];
+				if (pos - cols - 1 < 0 || pos + cols + 1 >= area)
+					continue;
+				for (int k1=-1; k1<2; k1++)
+					for (int k2=-1; k2<2; k2++) {
+						int n = pos + k1*cols + k2;
+						if (edge.data[n] != 0 || edgeType.data[n] == 0)
+							continue;
+						edge.data[n] = 255;
+						lines.push_back(n);
+					}
+			}
+		}
+	return edge;
+}
+
+static int highThresholdBin(const vector<int> &histogram, const Mat &in)
+{
+	int sum = 0;
+	int nonEdgePixels = CannyProbe::NonEdgePixelsRatio * in.rows * in.cols;
+	for (int i=0; i<CannyProbe::Bins; i++) {
+		sum += histogram[i];
+		if (sum > nonEdgePixels)
+			return i+1;
+	}
+	return 0;
+}
+
+static void derivatives(const Mat &in, Mat &dx, Mat &dy)
+{
+	Mat blurred;
+	GaussianBlur(in, blurred, Size(5,5), 1.5, 1.5, BORDER_REPLICATE);
+	Sobel(blurred, dx, CV_32F, 1, 0, 7, 1, BORDER_REPLICATE);
+	Sobel(blurred, dy, CV_32F, 0, 1, 7, 1, BORDER_REPLICATE);
+}
+
+// The current algorithm, scalar and over the whole image at once
+static Mat scalarCanny(const Mat &in, Mat &edgeType)
+{
+	Mat dx, dy;
+	derivatives(in, dx, dy);
+
+	Mat magnitude(in.size(), CV_32F);
+	float maxMag = 0;
+	for (int i=0; i<in.rows; i++)
+		for (int j=0; j<in.cols; j++) {
+			float ix = dx.at<float>(i,j), iy = dy.at<float>(i,j);
+			magnitude.at<float>(i,j) = std::sqrt(ix*ix + iy*iy);
+			maxMag = max<float>(maxMag, magnitude.at<float>(i,j));
+		}
+	if (maxMag <= 0) {
+		edgeType = Mat::zeros(in.size(), CV_8U);
+		return Mat::zeros(in.size(), CV_8U);
+	}
+
+	vector<int> histogram(CannyProbe::Bins, 0);
+	const float scale = (CannyProbe::Bins-1) / maxMag;
+	for (int i=0; i<in.rows; i++)
+		for (int j=0; j<in.cols; j++)
+			histogram[ cvRound(magnitude.at<float>(i,j) * scale) ]++;
+	float high_th = highThresholdBin(histogram, in) / (float) CannyProbe::Bins;
+	float low_th = CannyProbe::LowHighThresholdRatio * high_th;
+
+	suppressNonMaxima(dx, dy, magnitude, low_th * maxMag, high_th * maxMag, edgeType);
+	return hysteresis(edgeType);
+}
+
+// The canny before it was vectorized: thresholds on the normalized magnitude
+static Mat originalCanny(const Mat &in)
+{
+	Mat dx, dy, magnitude;
+	derivatives(in, dx, dy);
+	cv::magnitude(dx, dy, magnitude);
+	double maxMag = 0;
+	minMaxLoc(magnitude, NULL, &maxMag);
+	magnitude = magnitude / maxMag;
+
+	vector<int> histogram(CannyProbe::Bins, 0);
+	Mat idx = (CannyProbe::Bins-1) * magnitude;
+	idx.convertTo(idx, CV_16U);
+	for (int i=0; i<idx.rows; i++)
+		for (int j=0; j<idx.cols; j++)
+			histogram[ idx.at<ushort>(i,j) ]++;
+	float high_th = highThresholdBin(histogram, in) / (float) CannyProbe::Bins;
+	float low_th = CannyProbe::LowHighThresholdRatio * high_th;
+
+	Mat edgeType;
+	suppressNonMaxima(dx, dy, magnitude, low_th, high_th, edgeType);
+	return hysteresis(edgeType);
+}
+
+void PuReCanny::initTestCase()
+{
+	QByteArray video = qgetenv("EYERECTOO_CANNY_VIDEO");
+	if (!video.isEmpty()) {
+		VideoCapture capture(video.constData());
+		QVERIFY2( capture.isOpened(), qPrintable( QString("Could not open %1").arg(video.constData()) ) );
+		Mat bgr, gray;
+		while (capture.read(bgr)) {
+			cvtColor(bgr, gray, CV_BGR2GRAY);
+			frames.push_back(gray.clone());
+		}
+		QVERIFY2( !frames.empty(), "No frames in the video" );
+		return;
+	}
+
+	// Synthetic eye images (see DetectorConcurrency) at sizes with scalar tails
+	const Size sizes[] = { Size(320, 240), Size(193, 147), Size(251, 199) };
+	RNG rng(0xCA7);
+	for (int s=0; s<3; s++)
+		for (int i=0; i<8; i++) {
+			Mat frame(sizes[s], CV_8UC1);
+			for (int r=0; r<frame.rows; r++)
+				frame.row(r).setTo( Scalar(150 + 40 * r / frame.rows) );
+			Point2f center( frame.cols * (0.3f + 0.05f * i), frame.rows * (0.35f + 0.03f * i) );
+			float diameter = frame.rows * (0.1f + 0.02f * i);
+			ellipse(frame, RotatedRect(center, Size2f(2.6f * diameter, 2.5f * diameter), 0), Scalar(95), -1, LINE_AA);
+			ellipse(frame, RotatedRect(center, Size2f(diameter, 0.85f * diameter), 20.0f * i), Scalar(30), -1, LINE_AA);
+			circle(frame, center + Point2f(0.2f * diameter, -0.2f * diameter), 3, Scalar(250), -1, LINE_AA);
+			Mat noise(frame.size(), CV_8SC1);
+			rng.fill(noise, RNG::NORMAL, 0, 6);
+			add(frame, noise, frame, noArray(), CV_8U);
+			frames.push_back(frame);
+		}
+}
+
+void PuReCanny::matchesScalar()
+{
+	CannyProbe probe;
+	size_t pixels = 0, originalDiffs = 0, framesDiffering = 0;
+	for (size_t f=0; f<frames.size(); f++) {
+		Mat edges = probe.edges(frames[f]);
+		Mat referenceTypes;
+		Mat reference = scalarCanny(frames[f], referenceTypes);
+
+		QVERIFY2( countNonZero(probe.edgeTypes() != referenceTypes) == 0,
+			qPrintable( QString("Frame %1: non-maximum suppression differs from the scalar code").arg(f) ) );
+		QVERIFY2( countNonZero(edges != reference) == 0,
+			qPrintable( QString("Frame %1: edges differ from the scalar code").arg(f) ) );
+
+		int diffs = countNonZero(edges != originalCanny(frames[f]));
+		originalDiffs += diffs;
+		framesDiffering += diffs > 0 ? 1 : 0;
+		pixels += frames[f].total();
+	}
+
+	qInfo() << frames.size() << "frames match the scalar canny exactly;"
+		<< framesDiffering << "differ from the original canny, in"
+		<< originalDiffs << "of" << pixels << "pixels";
+}
+
+QTEST_APPLESS_MAIN(PuReCanny)
+
+#include "tst_PuReCanny.moc"
@@ -0,0 +1,7 @@
+TEMPLATE = subdirs
+
+SUBDIRS += \
+	ClockModel \
+	DetectionAllocations \
+	DetectorConcurrency \
+	PuReCanny